@@ -0,0 +1,613 @@
+//*****************************************************************************
+// purpose: Automatic parallelization of independent WHILE loops
+//          Finds loops whose iterations share only an induction variable
+//          and sums, then runs their iterations on a thread pool
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#include "autopar.h"
+#include "parser.h"
+#include <set>
+#include <map>
+#include <sstream>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+// Largest |I| for which I + k is exact and distinct I give distinct indices
+#define EXACT_INTEGERS 16777216.0f // 2^24
+
+// ---------------------------------------------------------------------
+// Threads that wait for a job, run it together with the caller, and
+// wait again. One loop uses the pool at a time.
+class LoopPool {
+public:
+  mutex claim;  // held by the loop running on the pool
+  LoopPool(int threads);
+  ~LoopPool();
+  int size() const { return helpers.size() + 1; }
+  void run(const function<void()>& work); // on every thread, caller included
+private:
+  vector<thread> helpers;
+  mutex lock;
+  condition_variable wake, done;
+  const function<void()>* job = nullptr;
+  long long generation = 0;  // jobs started so far
+  int busy = 0;              // helpers still running the current job
+  bool stopping = false;
+  void serve();
+};
+
+LoopPool::LoopPool(int threads) {
+  for (int i = 1; i < threads; ++i)
+    helpers.emplace_back(&LoopPool::serve, this);
+}
+
+LoopPool::~LoopPool() {
+  {
+    lock_guard<mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (thread& t : helpers)
+    t.join();
+}
+
+void LoopPool::serve() {
+  long long seen = 0;
+  unique_lock<mutex> guard(lock);
+  for (;;) {
+    wake.wait(guard, [&] { return stopping || generation != seen; });
+    if (stopping)
+      return;
+    seen = generation;
+    const function<void()>* work = job;
+    guard.unlock();
+    (*work)();
+    guard.lock();
+    if (--busy == 0)
+      done.notify_one();
+  }
+}
+
+void LoopPool::run(const function<void()>& work) {
+  {
+    lock_guard<mutex> guard(lock);
+    job = &work;
+    busy = helpers.size();
+    ++generation;
+  }
+  wake.notify_all();
+  work();
+  unique_lock<mutex> guard(lock);
+  done.wait(guard, [&] { return busy == 0; });
+  job = nullptr;
+}
+
+static unique_ptr<LoopPool> threadPool; // started by autoParallelize
+
+// ---------------------------------------------------------------------
+// Scalars and array elements an expression reads. False if it calls a
+// function, which could change anything.
+struct Reads {
+  vector<int> scalars;
+  vector<pair<ArrayT*, ExpressionNode*> > elements; // array and index
+};
+
+static bool reads(ExpressionNode* expr, Reads& r);
+
+static bool reads(FactorNode* factor, Reads& r) {
+  if (IdentifierNode* n = dynamic_cast<IdentifierNode*>(factor)) {
+    r.scalars.push_back(n->slot);
+    return !n->local;
+  }
+  if (IndexedIdentifierNode* n = dynamic_cast<IndexedIdentifierNode*>(factor)) {
+    r.elements.push_back(make_pair(n->array, n->index.get()));
+    return reads(n->index.get(), r);
+  }
+  if (NestedExpressionNode* n = dynamic_cast<NestedExpressionNode*>(factor))
+    return reads(n->exprPtr.get(), r);
+  if (NotNode* n = dynamic_cast<NotNode*>(factor))
+    return reads(n->factor.get(), r);
+  if (MinusNode* n = dynamic_cast<MinusNode*>(factor))
+    return reads(n->factor.get(), r);
+  return !dynamic_cast<FunctionCallNode*>(factor); // otherwise a literal
+}
+
+static bool reads(TermNode* term, Reads& r) {
+  bool ok = reads(term->firstFactor.get(), r);
+  for (auto& f : term->restFactors)
+    ok = reads(f.get(), r) && ok;
+  return ok;
+}
+
+static bool reads(SimpleExpressionNode* simple, Reads& r) {
+  bool ok = reads(simple->firstTerm.get(), r);
+  for (auto& t : simple->restTerms)
+    ok = reads(t.get(), r) && ok;
+  return ok;
+}
+
+static bool reads(ExpressionNode* expr, Reads& r) {
+  bool ok = reads(expr->firstSimpleExpr.get(), r);
+  if (expr->secondSimpleExpr)
+    ok = reads(expr->secondSimpleExpr.get(), r) && ok;
+  return ok;
+}
+
+// The only factor of term, if it has no operators
+static FactorNode* loneFactor(TermNode* term) {
+  return term->restFactors.empty() ? term->firstFactor.get() : nullptr;
+}
+
+static bool isVariable(FactorNode* factor, int slot) {
+  IdentifierNode* n = dynamic_cast<IdentifierNode*>(factor);
+  return n && !n->local && n->slot == slot;
+}
+
+// Is expr "V + t1 - t2 ..." for the variable at slot, with V in no term?
+static bool isSum(ExpressionNode* expr, int slot) {
+  SimpleExpressionNode* simple = expr->firstSimpleExpr.get();
+  if (expr->relop != 0 || simple->restTerms.empty() || !isVariable(loneFactor(simple->firstTerm.get()), slot))
+    return false;
+  for (int i = 0; i < simple->restTerms.size(); ++i) {
+    Reads r;
+    int op = simple->restSmplExprOps[i];
+    if ((op != TOK_PLUS && op != TOK_MINUS) || !reads(simple->restTerms[i].get(), r))
+      return false;
+    for (int s : r.scalars)
+      if (s == slot)
+        return false;
+  }
+  return true;
+}
+
+// k if index is "I", "I + k" or "I - k" with integer literals
+static bool offsetOf(ExpressionNode* index, int induction, float& k) {
+  SimpleExpressionNode* simple = index->firstSimpleExpr.get();
+  if (index->relop != 0 || !isVariable(loneFactor(simple->firstTerm.get()), induction))
+    return false;
+  k = 0;
+  for (int i = 0; i < simple->restTerms.size(); ++i) {
+    IntLitNode* n = dynamic_cast<IntLitNode*>(loneFactor(simple->restTerms[i].get()));
+    int op = simple->restSmplExprOps[i];
+    if (!n || (op != TOK_PLUS && op != TOK_MINUS))
+      return false;
+    k += op == TOK_PLUS ? n->int_literal : -n->int_literal;
+  }
+  return true;
+}
+
+// ---------------------------------------------------------------------
+// What one candidate loop's body does, gathered before deciding
+struct LoopAnalysis {
+  int induction = 0;
+  set<int> written;                   // scalars the body assigns, I aside
+  set<int> notSums;                   // of those, ones assigned other than as a sum
+  vector<AssignmentNode*> sums;       // assignments of the form V := V + t ...
+  set<ArrayT*> arraysWritten;
+  vector<pair<ArrayT*, ExpressionNode*> > elements; // every array access
+  set<int> sumsOnly;                  // written \ notSums: the reductions
+  bool collect(StatementNode* stmt, int loops);
+  bool readsOk(Reads& r, const set<int>& defined);
+  bool invariant(Reads& r);
+  bool ordered(StatementNode* stmt, set<int>& defined);
+  bool analyze(WhileNode* loop, ParallelWhile* plan);
+};
+
+// Record what stmt writes and every array it touches. False if it can
+// do something no worker may: READ, call, leave the loop being analyzed
+// (loops counts the loops around stmt inside it).
+bool LoopAnalysis::collect(StatementNode* stmt, int loops) {
+  Reads r;
+  if (AssignmentNode* n = dynamic_cast<AssignmentNode*>(stmt)) {
+    if (n->local || !reads(n->expr.get(), r))
+      return false;
+    written.insert(n->slot);
+    if (isSum(n->expr.get(), n->slot))
+      sums.push_back(n);
+    else
+      notSums.insert(n->slot);
+  } else if (ArrayAssignmentNode* n = dynamic_cast<ArrayAssignmentNode*>(stmt)) {
+    if (!reads(n->index.get(), r) || !reads(n->expr.get(), r))
+      return false;
+    arraysWritten.insert(n->array);
+    elements.push_back(make_pair(n->array, n->index.get()));
+  } else if (CompoundNode* n = dynamic_cast<CompoundNode*>(stmt)) {
+    for (auto& s : n->statements)
+      if (!collect(s.get(), loops))
+        return false;
+  } else if (IfNode* n = dynamic_cast<IfNode*>(stmt)) {
+    if (!reads(n->expr.get(), r) || !collect(n->thenStatement.get(), loops)
+        || (n->elseStatement && !collect(n->elseStatement.get(), loops)))
+      return false;
+  } else if (WhileNode* n = dynamic_cast<WhileNode*>(stmt)) {
+    if (!reads(n->expr.get(), r) || !collect(n->statement.get(), loops + 1))
+      return false;
+  } else if (ForNode* n = dynamic_cast<ForNode*>(stmt)) {
+    if (n->local || !reads(n->startExpr.get(), r) || !reads(n->endExpr.get(), r)
+        || !collect(n->statement.get(), loops + 1))
+      return false;
+    written.insert(n->slot);
+    notSums.insert(n->slot);
+  } else if (dynamic_cast<BreakNode*>(stmt) || dynamic_cast<ContinueNode*>(stmt)) {
+    return loops > 0; // an inner loop's own
+  } else if (!dynamic_cast<WriteNode*>(stmt)) {
+    return false; // READ or a procedure call
+  }
+  elements.insert(elements.end(), r.elements.begin(), r.elements.end());
+  return true;
+}
+
+// May an iteration read these? Only I, what the loop never writes, and
+// privates already assigned in this iteration.
+bool LoopAnalysis::readsOk(Reads& r, const set<int>& defined) {
+  for (int s : r.scalars)
+    if (s != induction && written.count(s) && !defined.count(s))
+      return false;
+  return true;
+}
+
+// Is every value r reads the same in all iterations?
+bool LoopAnalysis::invariant(Reads& r) {
+  for (int s : r.scalars)
+    if (s == induction || written.count(s))
+      return false;
+  for (auto& e : r.elements)
+    if (arraysWritten.count(e.first))
+      return false;
+  return true;
+}
+
+// Check that stmt reads every private after this iteration assigned it,
+// and add to defined the scalars it assigns on every path
+bool LoopAnalysis::ordered(StatementNode* stmt, set<int>& defined) {
+  Reads r;
+  if (AssignmentNode* n = dynamic_cast<AssignmentNode*>(stmt)) {
+    if (sumsOnly.count(n->slot)) {
+      // Only the terms are read; V itself is never looked at
+      SimpleExpressionNode* simple = n->expr->firstSimpleExpr.get();
+      for (auto& t : simple->restTerms)
+        reads(t.get(), r);
+      return readsOk(r, defined);
+    }
+    reads(n->expr.get(), r);
+    if (!readsOk(r, defined))
+      return false;
+    defined.insert(n->slot);
+    return true;
+  }
+  if (ArrayAssignmentNode* n = dynamic_cast<ArrayAssignmentNode*>(stmt)) {
+    reads(n->index.get(), r);
+    reads(n->expr.get(), r);
+    return readsOk(r, defined);
+  }
+  if (CompoundNode* n = dynamic_cast<CompoundNode*>(stmt)) {
+    for (auto& s : n->statements)
+      if (!ordered(s.get(), defined))
+        return false;
+    return true;
+  }
+  if (IfNode* n = dynamic_cast<IfNode*>(stmt)) {
+    reads(n->expr.get(), r);
+    set<int> thenDefined = defined, elseDefined = defined;
+    if (!readsOk(r, defined) || !ordered(n->thenStatement.get(), thenDefined)
+        || (n->elseStatement && !ordered(n->elseStatement.get(), elseDefined)))
+      return false;
+    for (int s : thenDefined)
+      if (elseDefined.count(s))
+        defined.insert(s);
+    return true;
+  }
+  if (WhileNode* n = dynamic_cast<WhileNode*>(stmt)) {
+    // The body may not run, so it assigns nothing for sure
+    reads(n->expr.get(), r);
+    set<int> inside = defined;
+    return readsOk(r, defined) && ordered(n->statement.get(), inside);
+  }
+  if (ForNode* n = dynamic_cast<ForNode*>(stmt)) {
+    reads(n->startExpr.get(), r);
+    reads(n->endExpr.get(), r);
+    set<int> inside = defined;
+    inside.insert(n->slot);
+    if (!readsOk(r, defined) || !ordered(n->statement.get(), inside))
+      return false;
+    // Bounds the loop never changes assign the counter in every
+    // iteration or in none, and in none it keeps its value from before
+    if (invariant(r))
+      defined.insert(n->slot);
+    return true;
+  }
+  if (WriteNode* n = dynamic_cast<WriteNode*>(stmt)) {
+    for (const WriteField& field : n->fields)
+      r.scalars.push_back(field.slot);
+    return readsOk(r, defined);
+  }
+  return true; // BREAK or CONTINUE of an inner loop
+}
+
+bool LoopAnalysis::analyze(WhileNode* loop, ParallelWhile* plan) {
+  CompoundNode* body = dynamic_cast<CompoundNode*>(loop->statement.get());
+  if (!body || body->statements.size() < 2)
+    return false;
+  // The last statement steps I by an amount the loop never changes
+  AssignmentNode* step = dynamic_cast<AssignmentNode*>(body->statements.back().get());
+  if (!step || step->local || !isSum(step->expr.get(), step->slot)
+      || step->expr->firstSimpleExpr->restTerms.size() != 1)
+    return false;
+  induction = step->slot;
+  for (int i = 0; i + 1 < body->statements.size(); ++i)
+    if (!collect(body->statements[i].get(), 0))
+      return false;
+  if (written.count(induction))
+    return false;
+  for (int s : written)
+    if (!notSums.count(s))
+      sumsOnly.insert(s);
+
+  // The condition and the step read only I and what the loop never writes
+  Reads fixed;
+  if (!reads(loop->expr.get(), fixed) || !reads(step->expr->firstSimpleExpr->restTerms[0].get(), fixed))
+    return false;
+  for (int s : fixed.scalars)
+    if (written.count(s))
+      return false;
+  for (auto& e : fixed.elements)
+    if (arraysWritten.count(e.first))
+      return false;
+
+  // Every array the body writes: the same element I + k everywhere
+  map<ArrayT*, float> offsets;
+  for (auto& e : elements) {
+    if (!arraysWritten.count(e.first))
+      continue;
+    float k;
+    if (!offsetOf(e.second, induction, k))
+      return false;
+    if (offsets.count(e.first) && offsets[e.first] != k)
+      return false;
+    offsets[e.first] = k;
+  }
+  for (auto& o : offsets)
+    plan->arrays.push_back(make_pair(o.first, static_cast<int>(o.second)));
+
+  // Every private is assigned, on every path, before it is read
+  set<int> defined;
+  for (int i = 0; i + 1 < body->statements.size(); ++i)
+    if (!ordered(body->statements[i].get(), defined))
+      return false;
+  plan->assigned.push_back(induction);
+  for (int s : written) {
+    if (sumsOnly.count(s))
+      continue;
+    if (!defined.count(s))
+      return false; // its final value could come from any iteration
+    plan->assigned.push_back(s);
+  }
+  for (AssignmentNode* n : sums)
+    n->reduction = sumsOnly.count(n->slot) > 0;
+  return true;
+}
+
+// ---------------------------------------------------------------------
+static int findLoops(StatementNode* stmt, int nesting) {
+  if (CompoundNode* n = dynamic_cast<CompoundNode*>(stmt)) {
+    int found = 0;
+    for (auto& s : n->statements)
+      found += findLoops(s.get(), nesting);
+    return found;
+  }
+  if (IfNode* n = dynamic_cast<IfNode*>(stmt))
+    return findLoops(n->thenStatement.get(), nesting)
+           + (n->elseStatement ? findLoops(n->elseStatement.get(), nesting) : 0);
+  if (ForNode* n = dynamic_cast<ForNode*>(stmt))
+    return findLoops(n->statement.get(), nesting);
+  WhileNode* n = dynamic_cast<WhileNode*>(stmt);
+  if (!n)
+    return 0;
+  unique_ptr<ParallelWhile> plan(new ParallelWhile);
+  LoopAnalysis analysis;
+  if (!analysis.analyze(n, plan.get()))
+    return findLoops(n->statement.get(), nesting);
+  plan->loop = n;
+  plan->pool = threadPool.get();
+  plan->nesting = nesting;
+  n->parallel = std::move(plan);
+  return 1;
+}
+
+int autoParallelize(ProgramNode* root, int threads) {
+  if (threads <= 0)
+    threads = thread::hardware_concurrency();
+  if (threads > 1 && !threadPool)
+    threadPool.reset(new LoopPool(threads));
+  int found = 0;
+  onStackFor(root->nesting, [&] { found = findLoops(root->block->compound.get(), root->nesting); });
+  return found;
+}
+
+// ---------------------------------------------------------------------
+long long ParallelWhile::count(long long stride, vector<float>* starts, float* last) {
+  StatementNode* step = static_cast<CompoundNode*>(loop->statement.get())->statements.back().get();
+  float& i = state->vars[assigned[0]];
+  float first = i;
+  long long n = 0;
+  float direction = 0;
+  try {
+    while (truth(loop->expr->interpret())) {
+      if (starts && n % stride == 0)
+        starts->push_back(i);
+      if (last)
+        *last = i;
+      if (i != floor(i) || fabs(i) >= EXACT_INTEGERS) {
+        n = -1;
+        break;
+      }
+      float before = i;
+      step->interpret();
+      ++n;
+      // I must keep moving the same way, or iterations would share elements
+      if (direction == 0)
+        direction = i - before;
+      if (i == before || (i - before > 0) != (direction > 0)) {
+        n = -1;
+        break;
+      }
+    }
+  } catch (RuntimeError&) {
+    n = -1; // the sequential loop reports it at the right moment
+  }
+  i = first;
+  return n;
+}
+
+// The work and results of a run of consecutive iterations
+struct LoopChunk {
+  float start = 0;              // I at the first iteration
+  long long iterations = 0;
+  stringbuf out;                // what its WRITEs printed
+  vector<Reduction> reductions; // its sum terms, in order
+  vector<float> vars;           // the worker's scalars when it ended
+  long long steps = 0;
+  long long written = 0;
+  bool failed = false;
+  RuntimeError error;
+};
+
+// Elements of an array the loop writes as they were before it ran, for
+// every I from the first iteration's to the last's
+struct SavedElements {
+  ArrayT* array = nullptr;
+  int k = 0;                    // the loop writes element I + k
+  int from = 0;                 // index of the first element saved
+  vector<int> ints;
+  vector<float> reals;
+};
+
+// The indexes I + k of array for I between a and b, within its bounds;
+// false if there are none
+static bool elementSpan(ArrayT* array, int k, float a, float b, int& from, int& to) {
+  from = max(static_cast<int>(min(a, b)) + k, array->low);
+  to = min(static_cast<int>(max(a, b)) + k, array->high);
+  return from <= to;
+}
+
+bool ParallelWhile::run() {
+  State* main = state;
+  if (!pool || main->owner || main->depth > 0 || main->trace || main->profile || main->checkpoint
+      || main->limits.maxSteps > 0 || main->limits.timeout > 0 || main->limits.maxOutput > 0)
+    return false;
+  unique_lock<mutex> claim(pool->claim, try_to_lock);
+  if (!claim.owns_lock())
+    return false; // another run's loop has the threads
+
+  long long n = count(1, nullptr);
+  if (n < 2)
+    return false;
+  long long pieces = pool->size() * CHUNKS_PER_THREAD;
+  long long stride = (n + pieces - 1) / pieces;
+  vector<float> starts;
+  float last = 0;
+  count(stride, &starts, &last);
+  vector<LoopChunk> chunks(starts.size());
+  for (int c = 0; c < chunks.size(); ++c) {
+    chunks[c].start = starts[c];
+    chunks[c].iterations = c + 1 < chunks.size() ? stride : n - stride * c;
+  }
+
+  // Chunks after a failed one may already have written their elements
+  vector<SavedElements> saved(arrays.size());
+  for (int a = 0; a < arrays.size(); ++a) {
+    SavedElements& s = saved[a];
+    s.array = arrays[a].first;
+    s.k = arrays[a].second;
+    int to;
+    if (!elementSpan(s.array, s.k, starts[0], last, s.from, to))
+      continue;
+    int low = s.array->low;
+    if (s.array->type == TOK_INTEGER) {
+      vector<int>& elements = main->ints[s.array->number];
+      s.ints.assign(elements.begin() + (s.from - low), elements.begin() + (to - low + 1));
+    } else {
+      vector<float>& elements = main->reals[s.array->number];
+      s.reals.assign(elements.begin() + (s.from - low), elements.begin() + (to - low + 1));
+    }
+  }
+
+  atomic<int> next{0};
+  atomic<int> firstFailed{INT_MAX};
+  int induction = assigned[0];
+  function<void()> work = [&]() {
+    State worker;
+    worker.owner = main;
+    worker.vars = main->vars;
+    worker.startClock();
+    State* outer = state;
+    state = &worker;
+    for (int c = next++; c < chunks.size() && c < firstFailed; c = next++) {
+      LoopChunk& chunk = chunks[c];
+      worker.out = &chunk.out;
+      worker.reductions = &chunk.reductions;
+      worker.steps = worker.written = 0;
+      worker.vars[induction] = chunk.start;
+      try {
+        for (long long k = 0; k < chunk.iterations; ++k) {
+          loop->statement->interpret();
+          ++worker.steps; // the back-edge
+        }
+      } catch (RuntimeError& stop) {
+        chunk.failed = true;
+        chunk.error = stop;
+        int seen = firstFailed.load();
+        while (c < seen && !firstFailed.compare_exchange_weak(seen, c))
+          ;
+      }
+      chunk.vars = worker.vars;
+      chunk.steps = worker.steps;
+      chunk.written = worker.written;
+    }
+    state = outer;
+  };
+  pool->run([&]() { onStackFor(nesting, work); });
+
+  // Replay the chunks in order, as if their iterations had run here
+  for (int c = 0; c < chunks.size(); ++c) {
+    LoopChunk& chunk = chunks[c];
+    string text = chunk.out.str();
+    main->out->sputn(text.data(), text.size());
+    main->written += chunk.written;
+    main->steps += chunk.steps;
+    for (const Reduction& r : chunk.reductions) {
+      float& v = main->vars[r.slot];
+      v = r.minus ? v - r.value : v + r.value;
+    }
+    if (chunk.failed || c + 1 == chunks.size()) {
+      for (int slot : assigned)
+        main->vars[slot] = chunk.vars[slot];
+      if (chunk.failed) {
+        // Take back what the iterations after the failed one wrote
+        for (int a = 0; c + 1 < chunks.size() && a < saved.size(); ++a) {
+          SavedElements& s = saved[a];
+          int from, to;
+          if (!elementSpan(s.array, s.k, chunks[c + 1].start, last, from, to))
+            continue;
+          int low = s.array->low;
+          if (s.array->type == TOK_INTEGER)
+            copy(s.ints.begin() + (from - s.from), s.ints.begin() + (to - s.from + 1),
+                 main->ints[s.array->number].begin() + (from - low));
+          else
+            copy(s.reals.begin() + (from - s.from), s.reals.begin() + (to - s.from + 1),
+                 main->reals[s.array->number].begin() + (from - low));
+        }
+        throw chunk.error;
+      }
+    }
+  }
+  return true;
+}
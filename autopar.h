@@ -0,0 +1,70 @@
+//*****************************************************************************
+// purpose: Automatic parallelization of independent WHILE loops
+//          Finds loops whose iterations share only an induction variable
+//          and sums, then runs their iterations on a thread pool
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#ifndef AUTOPAR_H
+#define AUTOPAR_H
+
+#include "nodes.h"
+
+class LoopPool;
+
+// Iterations each worker thread gets in one piece, at most
+#define CHUNKS_PER_THREAD 8
+
+// ---------------------------------------------------------------------
+// A WHILE of the main block shaped like
+//
+//   WHILE <condition on I and values the loop never changes>
+//   BEGIN
+//     <statements>;
+//     I := I + <expression the loop never changes>
+//   END
+//
+// where no iteration reads a value an earlier one left behind:
+//  - every other scalar the body writes is assigned in each iteration
+//    before it is read (a private), or only updated as V := V + t - ...
+//    and never read otherwise (a reduction);
+//  - every array the body writes is indexed by I + k, for one constant k
+//    per array, wherever the loop reads or writes it, so each iteration
+//    has elements of its own;
+//  - there is no READ, call, or BREAK or CONTINUE of the loop itself.
+//
+// Iterations then run in chunks on a thread pool, each worker with its
+// own scalars. Every WRITE goes to its chunk's buffer and every reduction
+// term to its chunk's log; both are replayed in iteration order once all
+// chunks are done, so output and sums (rounding included) are exactly
+// what the sequential loop gives. Privates and I end with the values the
+// last iteration left. When an iteration fails, the elements the chunks
+// after its own wrote are put back, so the arrays too hold what the
+// sequential loop left when it stopped.
+class ParallelWhile {
+public:
+  WhileNode* loop = nullptr;
+  vector<int> assigned;   // I, then the privates: copied back from the last iteration
+  vector<pair<ArrayT*, int> > arrays; // every array the body writes, with k of its I + k
+  LoopPool* pool = nullptr;
+  int nesting = 0;        // of the program's expressions, for the workers' stacks
+  // Run the whole loop in parallel. False, having changed nothing, when
+  // the loop must run sequentially: in a worker, under limits, --trace,
+  // --profile-gen or --checkpoint, or when the run of I is not a short
+  // enough sequence of distinct integers.
+  bool run();
+
+private:
+  // How many iterations the loop will run from the current State, and
+  // the value of I at the start of every stride-th one and of the last
+  // one; -1 if unknown
+  long long count(long long stride, vector<float>* starts, float* last = nullptr);
+};
+
+// Give every eligible WHILE of root's main block a ParallelWhile that
+// runs it on threads threads (0: one per core). Loops inside an eligible
+// loop are left alone. Returns how many loops were found.
+int autoParallelize(ProgramNode* root, int threads);
+
+#endif /* AUTOPAR_H */
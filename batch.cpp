@@ -0,0 +1,636 @@
+//*****************************************************************************
+// purpose: SIMD batch execution of one program over many input rows
+//          Runs rows in lockstep, one vector lane per row
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#include "batch.h"
+#include "parser.h"
+#include "input.h"
+#include "format.h"
+#include <fstream>
+#include <cstdlib>
+
+// Rows run together. Every variable holds one value per lane, laid out so
+// the compiler keeps a whole variable in one vector register.
+#define LANES 8
+typedef float laneFloat __attribute__((vector_size(LANES * sizeof(float))));
+typedef int laneInt __attribute__((vector_size(LANES * sizeof(int))));
+typedef unsigned laneUnsigned __attribute__((vector_size(LANES * sizeof(unsigned))));
+
+// A lane mask has every bit set (-1) in lanes that take part, 0 elsewhere.
+// Comparisons of lane vectors produce masks directly.
+
+static inline bool any(laneInt mask) {
+  for (int l = 0; l < LANES; ++l)
+    if (mask[l]) return true;
+  return false;
+}
+static inline laneFloat select(laneInt mask, laneFloat a, laneFloat b) {
+  return (laneFloat)(((laneInt)a & mask) | ((laneInt)b & ~mask));
+}
+static inline laneInt selectInt(laneInt mask, laneInt a, laneInt b) {
+  return (a & mask) | (b & ~mask);
+}
+static inline laneInt truthMask(laneFloat f) {
+  return ~((f < (float)EPSILON) & (f > (float)-EPSILON));
+}
+static inline laneFloat oneOrZero(laneInt mask) {
+  laneFloat one = laneFloat{} + 1.0f;
+  return select(mask, one, laneFloat{});
+}
+
+// ---------------------------------------------------------------------
+// The tree lowered once into a form with resolved variable slots, so the
+// lockstep loop does no name lookups.
+#define BX_CONST   0 // constant
+#define BX_VAR     1 // scalar variable in slot
+#define BX_ELEMENT 2 // array slot indexed by left
+#define BX_BINARY  3 // left op right
+#define BX_NOT     4 // NOT left
+#define BX_NEG     5 // - left
+
+struct BExpr {
+  int kind = BX_CONST;
+  int op = 0;            // token code of a BX_BINARY operator
+  float constant = 0.0f;
+  int slot = -1;         // variable slot or array number
+  bool checked = true;   // does an element access need a bounds check?
+  string name;           // array name, for error messages
+  BExpr* left = nullptr;
+  BExpr* right = nullptr;
+};
+
+#define BS_ASSIGN    0 // slot := expr
+#define BS_STORE     1 // array slot [index] := expr
+#define BS_COMPOUND  2 // body in order
+#define BS_IF        3 // IF expr THEN first ELSE second
+#define BS_WHILE     4 // WHILE expr first
+#define BS_FOR       5 // FOR slot := expr TO/DOWNTO limit DO first
+#define BS_READ      6 // READ(slot)
+#define BS_WRITEVAR  7 // WRITE with the variables slots
+#define BS_WRITESTR  8 // WRITE of literals only, as text
+#define BS_BREAK     9
+#define BS_CONTINUE 10
+
+struct BStmt {
+  int kind = BS_COMPOUND;
+  int slot = -1;
+  bool checked = true;
+  bool downto = false;
+  string text;              // variable name, array name, or literal
+  BExpr* expr = nullptr;
+  BExpr* index = nullptr;   // array subscript of BS_STORE
+  BExpr* limit = nullptr;   // final value of BS_FOR
+  BStmt* first = nullptr;   // THEN branch or loop body
+  BStmt* second = nullptr;  // ELSE branch
+  vector<BStmt*> body;      // statements of BS_COMPOUND
+  WriteNode* write = nullptr; // plan of BS_WRITEVAR
+  vector<int> slots;        // its variables
+};
+
+// One input row: the values it supplies to READ, and where it went bad
+struct Row {
+  vector<float> values;
+  bool malformed = false;   // a bad token follows the last value
+  string badToken;
+  long badOffset = 0;
+};
+
+// ---------------------------------------------------------------------
+class BatchProgram {
+public:
+  map<string, int> slots;             // scalar variable name → slot
+  map<ArrayT*, int> arrays;           // declared array → array number
+  vector<ArrayT*> arrayList;          // array number → declared array
+  BStmt* main = nullptr;
+  ~BatchProgram();
+  BStmt* lowerStatement(StatementNode* node);
+private:
+  vector<BExpr*> exprs;               // every lowered node, for deletion
+  vector<BStmt*> stmts;
+  int slotOf(const string& name);
+  int arrayOf(ArrayT* array);
+  BExpr* newExpr(int kind);
+  BStmt* newStmt(int kind);
+  BExpr* lower(ExpressionNode* node);
+  BExpr* lower(SimpleExpressionNode* node);
+  BExpr* lower(TermNode* node);
+  BExpr* lower(FactorNode* node);
+  BExpr* binary(int op, BExpr* left, BExpr* right);
+};
+
+BatchProgram::~BatchProgram() {
+  for (int i = 0; i < exprs.size(); ++i)
+    delete exprs[i];
+  for (int i = 0; i < stmts.size(); ++i)
+    delete stmts[i];
+}
+int BatchProgram::slotOf(const string& name) {
+  map<string, int>::iterator it = slots.find(name);
+  if (it != slots.end())
+    return it->second;
+  int slot = slots.size();
+  slots[name] = slot;
+  return slot;
+}
+int BatchProgram::arrayOf(ArrayT* array) {
+  map<ArrayT*, int>::iterator it = arrays.find(array);
+  if (it != arrays.end())
+    return it->second;
+  int number = arrayList.size();
+  arrays[array] = number;
+  arrayList.push_back(array);
+  return number;
+}
+BExpr* BatchProgram::newExpr(int kind) {
+  BExpr* e = new BExpr();
+  e->kind = kind;
+  exprs.push_back(e);
+  return e;
+}
+BStmt* BatchProgram::newStmt(int kind) {
+  BStmt* s = new BStmt();
+  s->kind = kind;
+  stmts.push_back(s);
+  return s;
+}
+BExpr* BatchProgram::binary(int op, BExpr* left, BExpr* right) {
+  BExpr* e = newExpr(BX_BINARY);
+  e->op = op;
+  e->left = left;
+  e->right = right;
+  return e;
+}
+
+BExpr* BatchProgram::lower(ExpressionNode* node) {
+  BExpr* value = lower(node->firstSimpleExpr.get());
+  if (node->relop != 0)
+    value = binary(node->relop, value, lower(node->secondSimpleExpr.get()));
+  return value;
+}
+BExpr* BatchProgram::lower(SimpleExpressionNode* node) {
+  BExpr* value = lower(node->firstTerm.get());
+  for (int i = 0; i < node->restTerms.size(); ++i)
+    value = binary(node->restSmplExprOps[i], value, lower(node->restTerms[i].get()));
+  return value;
+}
+BExpr* BatchProgram::lower(TermNode* node) {
+  BExpr* value = lower(node->firstFactor.get());
+  for (int i = 0; i < node->restFactors.size(); ++i)
+    value = binary(node->restTermOps[i], value, lower(node->restFactors[i].get()));
+  return value;
+}
+BExpr* BatchProgram::lower(FactorNode* node) {
+  if (IntLitNode* n = dynamic_cast<IntLitNode*>(node)) {
+    BExpr* e = newExpr(BX_CONST);
+    e->constant = n->int_literal;
+    return e;
+  }
+  if (FloatLitNode* n = dynamic_cast<FloatLitNode*>(node)) {
+    BExpr* e = newExpr(BX_CONST);
+    e->constant = n->float_literal;
+    return e;
+  }
+  if (IdentifierNode* n = dynamic_cast<IdentifierNode*>(node)) {
+    BExpr* e = newExpr(BX_VAR);
+    e->slot = slotOf(n->id);
+    return e;
+  }
+  if (IndexedIdentifierNode* n = dynamic_cast<IndexedIdentifierNode*>(node)) {
+    BExpr* e = newExpr(BX_ELEMENT);
+    e->slot = arrayOf(n->array);
+    e->checked = n->checked;
+    e->name = n->id;
+    e->left = lower(n->index.get());
+    return e;
+  }
+  if (NestedExpressionNode* n = dynamic_cast<NestedExpressionNode*>(node))
+    return lower(n->exprPtr.get());
+  if (NotNode* n = dynamic_cast<NotNode*>(node)) {
+    BExpr* e = newExpr(BX_NOT);
+    e->left = lower(n->factor.get());
+    return e;
+  }
+  MinusNode* n = dynamic_cast<MinusNode*>(node);
+  BExpr* e = newExpr(BX_NEG);
+  e->left = lower(n->factor.get());
+  return e;
+}
+
+BStmt* BatchProgram::lowerStatement(StatementNode* node) {
+  if (AssignmentNode* n = dynamic_cast<AssignmentNode*>(node)) {
+    BStmt* s = newStmt(BS_ASSIGN);
+    s->slot = slotOf(n->id);
+    s->expr = lower(n->expr.get());
+    return s;
+  }
+  if (ArrayAssignmentNode* n = dynamic_cast<ArrayAssignmentNode*>(node)) {
+    BStmt* s = newStmt(BS_STORE);
+    s->slot = arrayOf(n->array);
+    s->checked = n->checked;
+    s->text = n->id;
+    s->index = lower(n->index.get());
+    s->expr = lower(n->expr.get());
+    return s;
+  }
+  if (CompoundNode* n = dynamic_cast<CompoundNode*>(node)) {
+    BStmt* s = newStmt(BS_COMPOUND);
+    for (int i = 0; i < n->statements.size(); ++i)
+      s->body.push_back(lowerStatement(n->statements[i].get()));
+    return s;
+  }
+  if (IfNode* n = dynamic_cast<IfNode*>(node)) {
+    BStmt* s = newStmt(BS_IF);
+    s->expr = lower(n->expr.get());
+    s->first = lowerStatement(n->thenStatement.get());
+    if (n->elseStatement)
+      s->second = lowerStatement(n->elseStatement.get());
+    return s;
+  }
+  if (WhileNode* n = dynamic_cast<WhileNode*>(node)) {
+    BStmt* s = newStmt(BS_WHILE);
+    s->expr = lower(n->expr.get());
+    s->first = lowerStatement(n->statement.get());
+    return s;
+  }
+  if (ForNode* n = dynamic_cast<ForNode*>(node)) {
+    BStmt* s = newStmt(BS_FOR);
+    s->slot = slotOf(n->id);
+    s->expr = lower(n->startExpr.get());
+    s->limit = lower(n->endExpr.get());
+    s->downto = n->downto;
+    s->first = lowerStatement(n->statement.get());
+    return s;
+  }
+  if (ReadNode* n = dynamic_cast<ReadNode*>(node)) {
+    BStmt* s = newStmt(BS_READ);
+    s->slot = slotOf(n->id);
+    s->text = n->id;
+    return s;
+  }
+  if (WriteNode* n = dynamic_cast<WriteNode*>(node)) {
+    if (!n->fields.empty()) {
+      BStmt* s = newStmt(BS_WRITEVAR);
+      s->write = n;
+      for (int i = 0; i < n->fields.size(); ++i)
+        s->slots.push_back(slotOf(n->fields[i].id));
+      return s;
+    }
+    BStmt* s = newStmt(BS_WRITESTR);
+    s->text = n->prefix;
+    return s;
+  }
+  if (dynamic_cast<BreakNode*>(node))
+    return newStmt(BS_BREAK);
+  return newStmt(BS_CONTINUE);
+}
+
+// ---------------------------------------------------------------------
+// Variable state of one group of lanes. Array element e of lane l lives
+// at e * LANES + l, so lanes reading the same element touch one line.
+class BatchRun {
+public:
+  BatchRun(BatchProgram& program, vector<Row*>& rows, vector<string>& out);
+  void run();
+  bool failed[LANES];       // did the lane stop with an error?
+private:
+  BatchProgram& prog;
+  vector<laneFloat> vars;   // scalar slots
+  vector<vector<int> > ints;    // INTEGER array elements, by array number
+  vector<vector<float> > reals; // REAL array elements, by array number
+  Row* row[LANES];          // input of each lane, null past the last row
+  int cursor[LANES];        // next value of the row to READ
+  string* out[LANES];       // output of each lane
+  laneInt alive;            // lanes that have not stopped with an error
+  laneInt broken;           // lanes that left the innermost loop
+  laneInt continued;        // lanes that skip the rest of this iteration
+  laneInt live(laneInt mask) { return mask & alive & ~(broken | continued); }
+  void fail(int lane, const string& message);
+  laneFloat eval(BExpr* e, laneInt mask);
+  void exec(BStmt* s, laneInt mask);
+  void loopBody(BStmt* body, laneInt mask);
+};
+
+BatchRun::BatchRun(BatchProgram& program, vector<Row*>& rows, vector<string>& output)
+  : prog(program) {
+  vars.assign(prog.slots.size(), laneFloat{});
+  for (int a = 0; a < prog.arrayList.size(); ++a) {
+    ArrayT* array = prog.arrayList[a];
+    size_t count = static_cast<size_t>(array->high - array->low + 1) * LANES;
+    ints.push_back(vector<int>(array->type == TOK_INTEGER ? count : 0, 0));
+    reals.push_back(vector<float>(array->type == TOK_INTEGER ? 0 : count, 0.0f));
+  }
+  for (int l = 0; l < LANES; ++l) {
+    row[l] = l < rows.size() ? rows[l] : nullptr;
+    cursor[l] = 0;
+    out[l] = l < rows.size() ? &output[l] : nullptr;
+    failed[l] = false;
+    alive[l] = row[l] ? -1 : 0;
+  }
+  broken = continued = laneInt{};
+}
+
+void BatchRun::fail(int lane, const string& message) {
+  *out[lane] += "\n===========================\n" + message + "\n===========================\n";
+  failed[lane] = true;
+  alive[lane] = 0;
+}
+
+void BatchRun::run() {
+  exec(prog.main, alive);
+}
+
+laneFloat BatchRun::eval(BExpr* e, laneInt mask) {
+  switch (e->kind) {
+    case BX_CONST:
+      return laneFloat{} + e->constant;
+    case BX_VAR:
+      return vars[e->slot];
+    case BX_ELEMENT: {
+      laneFloat index = eval(e->left, mask);
+      mask &= alive; // a lane may have stopped inside the subscript
+      ArrayT* array = prog.arrayList[e->slot];
+      laneFloat value = laneFloat{};
+      for (int l = 0; l < LANES; ++l) {
+        if (!mask[l]) continue;
+        int i = static_cast<int>(index[l]);
+        if (e->checked && (i < array->low || i > array->high)) {
+          fail(l, rangeErrorText(e->name, array, i));
+          continue;
+        }
+        size_t at = static_cast<size_t>(i - array->low) * LANES + l;
+        value[l] = array->type == TOK_INTEGER ? static_cast<float>(ints[e->slot][at])
+                                              : reals[e->slot][at];
+      }
+      return value;
+    }
+    case BX_NOT:
+      return oneOrZero(~truthMask(eval(e->left, mask)));
+    case BX_NEG:
+      return -eval(e->left, mask);
+    default:
+      break;
+  }
+
+  laneFloat left = eval(e->left, mask);
+  if (e->op == TOK_OR || e->op == TOK_AND) {
+    // Only lanes the left side leaves undecided evaluate the right side
+    laneInt leftTrue = truthMask(left);
+    laneInt undecided = mask & alive & (e->op == TOK_OR ? ~leftTrue : leftTrue);
+    laneInt rightTrue = laneInt{};
+    if (any(undecided))
+      rightTrue = truthMask(eval(e->right, undecided)) & undecided;
+    return oneOrZero(e->op == TOK_OR ? (leftTrue | rightTrue) : rightTrue);
+  }
+  laneFloat right = eval(e->right, mask);
+  switch (e->op) {
+    case TOK_PLUS:        return left + right;
+    case TOK_MINUS:       return left - right;
+    case TOK_MULTIPLY:    return left * right;
+    case TOK_DIVIDE:      return left / right;
+    case TOK_MOD: {
+      // Lanes outside the mask may hold anything; keep them from trapping
+      laneInt one = laneInt{} + 1;
+      laneInt a = selectInt(mask, __builtin_convertvector(left, laneInt), laneInt{});
+      laneInt b = selectInt(mask, __builtin_convertvector(right, laneInt), one);
+      return __builtin_convertvector(a % b, laneFloat);
+    }
+    case TOK_EQUALTO:     return oneOrZero(~truthMask(left - right));
+    case TOK_NOTEQUALTO:  return oneOrZero(truthMask(left - right));
+    case TOK_LESSTHAN:    return oneOrZero(left < right);
+    case TOK_GREATERTHAN: return oneOrZero(left > right);
+    default:              return left;
+  }
+}
+
+// Run one iteration's body with a fresh CONTINUE mask
+void BatchRun::loopBody(BStmt* body, laneInt mask) {
+  continued = laneInt{};
+  exec(body, mask);
+  continued = laneInt{};
+}
+
+void BatchRun::exec(BStmt* s, laneInt mask) {
+  mask = live(mask);
+  if (!any(mask))
+    return;
+  switch (s->kind) {
+    case BS_ASSIGN: {
+      laneFloat value = eval(s->expr, mask);
+      vars[s->slot] = select(mask & alive, value, vars[s->slot]);
+      break;
+    }
+    case BS_STORE: {
+      laneFloat index = eval(s->index, mask);
+      ArrayT* array = prog.arrayList[s->slot];
+      int offset[LANES];
+      for (int l = 0; l < LANES; ++l) {
+        if (!(mask[l] & alive[l])) continue;
+        int i = static_cast<int>(index[l]);
+        if (s->checked && (i < array->low || i > array->high))
+          fail(l, rangeErrorText(s->text, array, i));
+        offset[l] = i - array->low;
+      }
+      mask &= alive;
+      if (!any(mask)) break;
+      laneFloat value = eval(s->expr, mask);
+      mask &= alive;
+      for (int l = 0; l < LANES; ++l) {
+        if (!mask[l]) continue;
+        size_t at = static_cast<size_t>(offset[l]) * LANES + l;
+        if (array->type == TOK_INTEGER)
+          ints[s->slot][at] = static_cast<int>(value[l]);
+        else
+          reals[s->slot][at] = value[l];
+      }
+      break;
+    }
+    case BS_COMPOUND:
+      for (int i = 0; i < s->body.size(); ++i) {
+        exec(s->body[i], mask);
+        if (!any(live(mask)))
+          break;
+      }
+      break;
+    case BS_IF: {
+      laneInt condition = truthMask(eval(s->expr, mask));
+      exec(s->first, mask & condition);
+      if (s->second)
+        exec(s->second, mask & ~condition);
+      break;
+    }
+    case BS_WHILE: {
+      laneInt outerBroken = broken, outerContinued = continued;
+      broken = continued = laneInt{};
+      laneInt active = mask;
+      for (;;) {
+        active &= alive & ~broken;
+        if (!any(active)) break;
+        active &= truthMask(eval(s->expr, active)) & alive;
+        if (!any(active)) break;
+        loopBody(s->first, active);
+      }
+      broken = outerBroken;
+      continued = outerContinued;
+      break;
+    }
+    case BS_FOR: {
+      laneInt first = __builtin_convertvector(eval(s->expr, mask), laneInt);
+      laneInt last = __builtin_convertvector(eval(s->limit, mask), laneInt);
+      laneInt active = mask & alive & (s->downto ? first >= last : first <= last);
+      laneUnsigned step = laneUnsigned{} + (s->downto ? -1u : 1u);
+      laneInt i = first;
+      laneInt outerBroken = broken, outerContinued = continued;
+      broken = continued = laneInt{};
+      while (any(active)) {
+        vars[s->slot] = select(active, __builtin_convertvector(i, laneFloat), vars[s->slot]);
+        loopBody(s->first, active);
+        active &= alive & ~broken & (i != last);
+        i = (laneInt)((laneUnsigned)i + step); // finished lanes may wrap harmlessly
+      }
+      broken = outerBroken;
+      continued = outerContinued;
+      break;
+    }
+    case BS_READ: {
+      laneFloat value = vars[s->slot];
+      for (int l = 0; l < LANES; ++l) {
+        if (!mask[l]) continue;
+        Row* r = row[l];
+        if (cursor[l] < r->values.size()) {
+          value[l] = r->values[cursor[l]++];
+        } else if (r->malformed) {
+          fail(l, inputErrorText(s->text, INPUT_MALFORMED, r->badToken, r->badOffset));
+        } else {
+          fail(l, inputErrorText(s->text, INPUT_EOF, "", -1));
+        }
+      }
+      vars[s->slot] = select(mask & alive, value, vars[s->slot]);
+      break;
+    }
+    case BS_WRITEVAR: {
+      // Room for the line and the values on the stack, unless it is long
+      char line[WRITE_BUFFER];
+      float few[WRITE_BUFFER / FORMAT_BUFFER];
+      string longLine;
+      vector<float> many;
+      char* text = line;
+      float* values = few;
+      if (s->write->bound > WRITE_BUFFER) {
+        longLine.resize(s->write->bound);
+        text = &longLine[0];
+      }
+      if (s->slots.size() > WRITE_BUFFER / FORMAT_BUFFER) {
+        many.resize(s->slots.size());
+        values = many.data();
+      }
+      for (int l = 0; l < LANES; ++l) {
+        if (!mask[l]) continue;
+        for (int i = 0; i < s->slots.size(); ++i)
+          values[i] = vars[s->slots[i]][l];
+        out[l]->append(text, s->write->format(values, text));
+      }
+      break;
+    }
+    case BS_WRITESTR:
+      for (int l = 0; l < LANES; ++l)
+        if (mask[l])
+          out[l]->append(s->text);
+      break;
+    case BS_BREAK:
+      broken |= mask;
+      break;
+    case BS_CONTINUE:
+      continued |= mask;
+      break;
+  }
+}
+
+// ---------------------------------------------------------------------
+// Split one line into the values a single run would READ from it
+static void parseRow(const string& line, Row& row) {
+  const char* begin = line.data();
+  const char* p = begin;
+  const char* end = begin + line.size();
+  for (;;) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == ','))
+      ++p;
+    if (p == end)
+      return;
+    const char* stop = p;
+    while (stop < end && *stop != ' ' && *stop != '\t' && *stop != '\r' && *stop != ',')
+      ++stop;
+    float value;
+    int used = parseNumber(p, stop, value);
+    if (used == 0 || p + used != stop) {
+      row.malformed = true;
+      row.badToken.assign(p, stop - p < 64 ? stop - p : 64);
+      row.badOffset = p - begin;
+      return;
+    }
+    row.values.push_back(value);
+    p = stop;
+  }
+}
+
+static int runLanes(ProgramNode* root, const char* rowsPath) {
+  // Lanes share one control path; per-lane call stacks are not modelled
+  if (!root->block->subprograms.empty()) {
+    cout << "ERROR - procedures and functions are not supported with --batch" << endl;
+    return EXIT_FAILURE;
+  }
+  ifstream file(rowsPath);
+  if (!file) {
+    cout << "ERROR - cannot open " << rowsPath << endl;
+    return EXIT_FAILURE;
+  }
+  vector<Row> rows;
+  string line;
+  while (getline(file, line)) {
+    if (line.find_first_not_of(" \t\r,") == string::npos)
+      continue; // blank lines are not rows
+    rows.push_back(Row());
+    parseRow(line, rows.back());
+  }
+
+  // Declared variables keep the slots and numbers the parser gave them
+  BatchProgram program;
+  symbolTableT& symbols = root->tables->symbols;
+  arrayTableT& arrays = root->tables->arrays;
+  for (symbolTableT::iterator it = symbols.begin(); it != symbols.end(); ++it)
+    program.slots.insert(make_pair(it->first, it->second));
+  program.arrayList.resize(arrays.size());
+  for (arrayTableT::iterator it = arrays.begin(); it != arrays.end(); ++it) {
+    program.arrays[&it->second] = it->second.number;
+    program.arrayList[it->second.number] = &it->second;
+  }
+  program.main = program.lowerStatement(root->block->compound.get());
+
+  bool anyFailed = false;
+  for (size_t start = 0; start < rows.size(); start += LANES) {
+    vector<Row*> group;
+    for (size_t r = start; r < rows.size() && r < start + LANES; ++r)
+      group.push_back(&rows[r]);
+    vector<string> output(group.size());
+    BatchRun lanes(program, group, output);
+    lanes.run();
+    for (int l = 0; l < group.size(); ++l) {
+      // Same framing as a single run: banner, output, closing blank line
+      cout << "*** Interpret the Tree ***" << '\n' << output[l];
+      if (lanes.failed[l])
+        anyFailed = true;
+      else
+        cout << '\n';
+    }
+  }
+  cout.flush();
+  return anyFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int runBatch(ProgramNode* root, const char* rowsPath) {
+  int status = EXIT_SUCCESS;
+  onStackFor(root->nesting, [&] { status = runLanes(root, rowsPath); });
+  return status;
+}
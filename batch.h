@@ -0,0 +1,21 @@
+//*****************************************************************************
+// purpose: SIMD batch execution of one program over many input rows
+//          Runs rows in lockstep, one vector lane per row
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "nodes.h"
+
+// Run the parsed program once per line of rowsPath. Each line holds the
+// values its run READs, separated by commas or whitespace. The output of
+// every row is exactly what a single run fed that row would print, and
+// rows are printed in file order. Returns EXIT_FAILURE if the file cannot
+// be read, the program declares procedures or functions, or any row
+// stopped with an error, EXIT_SUCCESS otherwise.
+int runBatch(ProgramNode* root, const char* rowsPath);
+
+#endif /* BATCH_H */
@@ -0,0 +1,20 @@
+PROGRAM CALLS;
+{ Call overhead: 242785 calls of a recursive function doing almost no work }
+{ per call. Time it with: time ./tips bench/call_bench.pas }
+VAR
+  N: INTEGER;
+  R: INTEGER;
+
+FUNCTION FIB(K: INTEGER): INTEGER;
+BEGIN
+  IF K < 2 THEN
+    FIB := K
+  ELSE
+    FIB := FIB(K - 1) + FIB(K - 2)
+END;
+
+BEGIN
+  N := 25;
+  R := FIB(N);
+  WRITE(R)
+END
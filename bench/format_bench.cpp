@@ -0,0 +1,89 @@
+//*****************************************************************************
+// purpose: Microbenchmark of WRITE number formatting
+//          formatNumber() against ostream << float, into the same buffer
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#include "format.h"
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+
+using namespace std;
+
+// A streambuf that only counts bytes, so neither side pays for real I/O
+class CountingBuf : public streambuf {
+public:
+  long bytes = 0;
+protected:
+  int overflow(int c) { ++bytes; return c; }
+  streamsize xsputn(const char*, streamsize n) { bytes += n; return n; }
+};
+
+static double seconds(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+  long count = argc > 1 ? atol(argv[1]) : 5000000;
+
+  // Mix of what WRITE usually sees: counters, money-like reals, and
+  // values that need an exponent
+  mt19937 rng(4714);
+  uniform_int_distribution<int> ints(-100000, 100000);
+  uniform_real_distribution<float> reals(-1000.0f, 1000.0f);
+  uniform_real_distribution<float> wide(-30.0f, 30.0f);
+  vector<float> values(count);
+  for (long i = 0; i < count; ++i) {
+    switch (i % 3) {
+      case 0: values[i] = static_cast<float>(ints(rng)); break;
+      case 1: values[i] = reals(rng); break;
+      default: values[i] = powf(10.0f, wide(rng)); break;
+    }
+  }
+
+  // Both paths must agree before timing means anything
+  for (long i = 0; i < count && i < 100000; ++i) {
+    char text[FORMAT_BUFFER];
+    int length = formatNumber(values[i], text);
+    ostringstream expected;
+    expected << values[i];
+    if (expected.str() != string(text, length)) {
+      cout << "MISMATCH for " << expected.str() << ": " << string(text, length) << endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  CountingBuf streamSink;
+  ostream os(&streamSink);
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (long i = 0; i < count; ++i)
+    os << values[i] << '\n';
+  double streamTime = seconds(start);
+
+  CountingBuf fastSink;
+  start = chrono::steady_clock::now();
+  for (long i = 0; i < count; ++i) {
+    char text[FORMAT_BUFFER + 1];
+    int length = formatNumber(values[i], text);
+    text[length++] = '\n';
+    fastSink.sputn(text, length);
+  }
+  double fastTime = seconds(start);
+
+  if (streamSink.bytes != fastSink.bytes) {
+    cout << "MISMATCH in total output size" << endl;
+    return EXIT_FAILURE;
+  }
+  cout << count << " values, " << fastSink.bytes << " bytes" << endl;
+  cout << "ostream << float: " << streamTime * 1e9 / count << " ns/value" << endl;
+  cout << "formatNumber:     " << fastTime * 1e9 / count << " ns/value" << endl;
+  cout << "speedup:          " << streamTime / fastTime << "x" << endl;
+  return EXIT_SUCCESS;
+}
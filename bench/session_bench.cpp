@@ -0,0 +1,136 @@
+//*****************************************************************************
+// purpose: Microbenchmark of many interactive runs served by one thread
+//          TipsLoop multiplexing runs that each READ from their own pipe
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#include "tips.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/resource.h>
+
+using namespace std;
+
+// Adds up numbers until a 0, so every run waits on READ once per value
+static const char* source =
+  "PROGRAM TALLY;\n"
+  "VAR\n"
+  "  X: INTEGER;\n"
+  "  S: INTEGER;\n"
+  "BEGIN\n"
+  "  S := 0;\n"
+  "  READ(X);\n"
+  "  WHILE X <> 0\n"
+  "  BEGIN\n"
+  "    S := S + X;\n"
+  "    READ(X)\n"
+  "  END;\n"
+  "  WRITE(S)\n"
+  "END\n";
+
+// The same with the sum taken through a function, so every run has a
+// frame stack
+static const char* withCalls =
+  "PROGRAM TALLY;\n"
+  "VAR\n"
+  "  X: INTEGER;\n"
+  "  S: INTEGER;\n"
+  "FUNCTION ADD(A: INTEGER; B: INTEGER): INTEGER;\n"
+  "BEGIN\n"
+  "  ADD := A + B\n"
+  "END;\n"
+  "BEGIN\n"
+  "  S := 0;\n"
+  "  READ(X);\n"
+  "  WHILE X <> 0\n"
+  "  BEGIN\n"
+  "    S := ADD(S, X);\n"
+  "    READ(X)\n"
+  "  END;\n"
+  "  WRITE(S)\n"
+  "END\n";
+
+static double seconds(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+  int sessions = argc > 1 ? atoi(argv[1]) : 2000;
+  int values = argc > 2 ? atoi(argv[2]) : 100;
+  bool calls = argc > 3 && string(argv[3]) == "calls";
+
+  // Two descriptors per session, plus a few
+  struct rlimit files;
+  getrlimit(RLIMIT_NOFILE, &files);
+  files.rlim_cur = files.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &files);
+  if (2 * sessions + 16 > files.rlim_cur) {
+    sessions = (files.rlim_cur - 16) / 2;
+    cout << "only " << sessions << " sessions fit in the descriptor limit" << endl;
+  }
+
+  TipsResult result;
+  unique_ptr<TipsProgram> program(TipsProgram::compile(calls ? withCalls : source, result));
+  if (!program) {
+    cout << result.message << endl;
+    return EXIT_FAILURE;
+  }
+
+  vector<unique_ptr<TipsRun> > runs;
+  vector<string> replies(sessions);
+  vector<int> readers(sessions), writers(sessions);
+  TipsLoop loop;
+  int failed = 0;
+  for (int i = 0; i < sessions; ++i) {
+    int ends[2];
+    if (pipe(ends) != 0) {
+      cout << "pipe failed after " << i << " sessions" << endl;
+      return EXIT_FAILURE;
+    }
+    readers[i] = ends[0];
+    writers[i] = ends[1];
+    runs.emplace_back(new TipsRun(*program));
+    runs.back()->output([&replies, i](const char* text, size_t length) { replies[i].append(text, length); });
+    loop.add(*runs.back(), readers[i], [&failed](const TipsResult& r) { failed += !r.ok(); });
+  }
+  cout << loop.waiting() << " runs waiting on READ" << endl;
+
+  // One value to every session in turn, so each run waits between values
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  thread feeder([&] {
+    for (int v = 1; v <= values + 1; ++v) {
+      for (int i = 0; i < sessions; ++i) {
+        string line = (v <= values ? to_string(i + v) : string("0")) + "\n";
+        if (write(writers[i], line.data(), line.size()) != line.size())
+          return;
+      }
+    }
+    for (int i = 0; i < sessions; ++i)
+      close(writers[i]);
+  });
+  loop.run();
+  double elapsed = seconds(start);
+  feeder.join();
+
+  int wrong = 0;
+  for (int i = 0; i < sessions; ++i) {
+    long long sum = (long long)values * i + (long long)values * (values + 1) / 2;
+    if (replies[i] != to_string(sum) + "\n")
+      ++wrong;
+    close(readers[i]);
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  long long reads = (long long)sessions * (values + 1);
+  cout << sessions << " sessions, " << reads << " READs in " << elapsed << " s: "
+       << elapsed / reads * 1e6 << " us per READ on one thread" << endl;
+  cout << "peak resident " << usage.ru_maxrss / 1024 << " MB, "
+       << failed << " runs failed, " << wrong << " wrong sums" << endl;
+  return failed || wrong ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,253 @@
+//*****************************************************************************
+// purpose: Checkpoint and resume of a long tree-walking run
+//          Saves variables, loop position and input offset at back-edges
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#include "checkpoint.h"
+#include "input.h"
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+// File layout, in the machine's own byte order:
+//   "TIPSCKPT", version, source fingerprint
+//   loop number, FOR counters (value, last value) outermost first
+//   steps, bytes written, input offset (-1 when prompting)
+//   scalar variables, then each array's INTEGER and REAL elements
+#define CHECKPOINT_MAGIC   "TIPSCKPT"
+#define CHECKPOINT_VERSION 1
+
+// ---------------------------------------------------------------------
+template <class T> static void put(FILE* file, const T& value) {
+  fwrite(&value, sizeof(T), 1, file);
+}
+template <class T> static void putVector(FILE* file, const vector<T>& v) {
+  put(file, static_cast<int>(v.size()));
+  fwrite(v.data(), sizeof(T), v.size(), file);
+}
+template <class T> static bool get(FILE* file, T& value) {
+  return fread(&value, sizeof(T), 1, file) == 1;
+}
+// Read a vector that must have the size it already has
+template <class T> static bool getVector(FILE* file, vector<T>& v) {
+  int size = -1;
+  return get(file, size) && size == v.size()
+         && fread(v.data(), sizeof(T), v.size(), file) == v.size();
+}
+
+unsigned long long fingerprintFile(const char* fileName) {
+  FILE* file = fopen(fileName, "rb");
+  if (!file)
+    return 0;
+  unsigned long long hash = 14695981039346656037ULL;
+  int c;
+  while ((c = getc(file)) != EOF)
+    hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+  fclose(file);
+  return hash;
+}
+
+// ---------------------------------------------------------------------
+Checkpointer::Checkpointer(ProgramNode* r, unsigned long long f) {
+  root = r;
+  fingerprint = f;
+  number(root->block->compound.get());
+}
+
+// Loops of subprograms are never numbered: a call is never saved
+void Checkpointer::number(StatementNode* stmt) {
+  if (CompoundNode* n = dynamic_cast<CompoundNode*>(stmt)) {
+    for (auto& s : n->statements)
+      number(s.get());
+  } else if (IfNode* n = dynamic_cast<IfNode*>(stmt)) {
+    number(n->thenStatement.get());
+    if (n->elseStatement)
+      number(n->elseStatement.get());
+  } else if (WhileNode* n = dynamic_cast<WhileNode*>(stmt)) {
+    loopNumbers[n] = loops.size();
+    loops.push_back(n);
+    number(n->statement.get());
+  } else if (ForNode* n = dynamic_cast<ForNode*>(stmt)) {
+    loopNumbers[n] = loops.size();
+    loops.push_back(n);
+    number(n->statement.get());
+  }
+}
+
+// The statements from from down to to, both included
+bool Checkpointer::path(StatementNode* from, StatementNode* to, vector<StatementNode*>& nodes) {
+  nodes.push_back(from);
+  if (from == to)
+    return true;
+  if (CompoundNode* n = dynamic_cast<CompoundNode*>(from)) {
+    for (auto& s : n->statements)
+      if (path(s.get(), to, nodes))
+        return true;
+  } else if (IfNode* n = dynamic_cast<IfNode*>(from)) {
+    if (path(n->thenStatement.get(), to, nodes)
+        || (n->elseStatement && path(n->elseStatement.get(), to, nodes)))
+      return true;
+  } else if (WhileNode* n = dynamic_cast<WhileNode*>(from)) {
+    if (path(n->statement.get(), to, nodes))
+      return true;
+  } else if (ForNode* n = dynamic_cast<ForNode*>(from)) {
+    if (path(n->statement.get(), to, nodes))
+      return true;
+  }
+  nodes.pop_back();
+  return false;
+}
+
+// ---------------------------------------------------------------------
+void Checkpointer::start(const char* name, double seconds) {
+  fileName = name;
+  period = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(seconds));
+  next = chrono::steady_clock::now() + period;
+}
+
+bool Checkpointer::due() {
+  return !fileName.empty() && chrono::steady_clock::now() >= next;
+}
+
+void Checkpointer::save(StatementNode* loop) {
+  // Inside a call, wait for the back-edge of a main-block loop
+  map<StatementNode*, int>::iterator at = loopNumbers.find(loop);
+  if (state->depth > 0 || at == loopNumbers.end())
+    return;
+  state->checkpointDue = false;
+  next = chrono::steady_clock::now() + period;
+
+  // The output so far belongs to the run being saved
+  state->out->pubsync();
+  // Write a new file and rename it over the old one, so a crash while
+  // saving leaves the previous checkpoint whole
+  string temp = fileName + ".tmp";
+  FILE* file = fopen(temp.c_str(), "wb");
+  if (!file) {
+    cout << "WARNING - cannot write checkpoint " << temp << endl;
+    return;
+  }
+  fwrite(CHECKPOINT_MAGIC, 1, strlen(CHECKPOINT_MAGIC), file);
+  put(file, static_cast<int>(CHECKPOINT_VERSION));
+  put(file, fingerprint);
+  put(file, at->second);
+  put(file, static_cast<int>(running.size()));
+  for (int i = 0; i < running.size(); ++i) {
+    put(file, *running[i].first);
+    put(file, running[i].second);
+  }
+  put(file, state->steps);
+  put(file, state->written);
+  put(file, static_cast<long long>(state->input ? state->input->offset() : -1));
+  putVector(file, state->vars);
+  put(file, static_cast<int>(state->ints.size()));
+  for (int a = 0; a < state->ints.size(); ++a) {
+    putVector(file, state->ints[a]);
+    putVector(file, state->reals[a]);
+  }
+  bool ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(temp.c_str(), fileName.c_str()) != 0) {
+    cout << "WARNING - cannot write checkpoint " << fileName << endl;
+    return;
+  }
+  ++saved;
+}
+
+// ---------------------------------------------------------------------
+string Checkpointer::load(const char* name) {
+  FILE* file = fopen(name, "rb");
+  if (!file)
+    return string("cannot open ") + name;
+  string problem = string(name) + " is not a checkpoint";
+  char magic[sizeof(CHECKPOINT_MAGIC) - 1];
+  int version = 0;
+  unsigned long long savedBy = 0;
+  int count = -1;
+  long long offset = -1;
+  bool ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+            && memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) == 0
+            && get(file, version) && version == CHECKPOINT_VERSION;
+  if (ok && (!get(file, savedBy) || savedBy != fingerprint)) {
+    ok = false;
+    problem = string(name) + " was saved by another program";
+  }
+  ok = ok && get(file, loop) && loop >= 0 && loop < loops.size() && get(file, count) && count >= 0;
+  // Every FOR from the main block down to the loop left a counter
+  vector<StatementNode*> nodes;
+  int fors = 0;
+  if (ok && path(root->block->compound.get(), loops[loop], nodes))
+    for (StatementNode* n : nodes)
+      fors += dynamic_cast<ForNode*>(n) != nullptr;
+  ok = ok && count == fors;
+  counters.assign(ok ? count : 0, make_pair(0, 0));
+  for (int i = 0; ok && i < count; ++i)
+    ok = get(file, counters[i].first) && get(file, counters[i].second);
+  ok = ok && get(file, state->steps) && get(file, state->written) && get(file, offset)
+       && getVector(file, state->vars);
+  ok = ok && get(file, count) && count == state->ints.size();
+  for (int a = 0; ok && a < count; ++a)
+    ok = getVector(file, state->ints[a]) && getVector(file, state->reals[a]);
+  fclose(file);
+  if (!ok)
+    return problem;
+  // Pass over the input the saved run had read
+  if (offset > 0 && state->input && state->input->skip(offset) != offset)
+    return "the input ends before the position saved in " + string(name);
+  return "";
+}
+
+void Checkpointer::resume() {
+  vector<StatementNode*> nodes;
+  path(root->block->compound.get(), loops[loop], nodes);
+  int counter = 0;
+  resume(nodes, 0, counter);
+}
+
+// Continue nodes[k], which is running nodes[k + 1], as its interpret()
+// would once that returns. The loop at the end of nodes has just passed
+// a back-edge; counter indexes the saved value of the next FOR.
+ExecStatus Checkpointer::resume(vector<StatementNode*>& nodes, int k, int& counter) {
+  bool innermost = k + 1 == nodes.size();
+  if (CompoundNode* n = dynamic_cast<CompoundNode*>(nodes[k])) {
+    int j = 0;
+    while (n->statements[j].get() != nodes[k + 1])
+      ++j;
+    ExecStatus status = resume(nodes, k + 1, counter);
+    if (status != EXEC_NORMAL)
+      return status;
+    return n->runFrom(j + 1);
+  }
+  if (dynamic_cast<IfNode*>(nodes[k]))
+    return resume(nodes, k + 1, counter);
+  if (WhileNode* n = dynamic_cast<WhileNode*>(nodes[k])) {
+    if (!innermost) {
+      if (resume(nodes, k + 1, counter) == EXEC_BREAK)
+        return EXEC_NORMAL;
+      state->backEdge("WHILE loop", n->line);
+      if (state->checkpointDue)
+        save(n);
+    }
+    return n->iterate();
+  }
+  ForNode* n = static_cast<ForNode*>(nodes[k]);
+  int i = counters[counter].first;
+  int last = counters[counter].second;
+  ++counter;
+  if (!innermost) {
+    enter(&i, last);
+    ExecStatus status = resume(nodes, k + 1, counter);
+    bool done = status == EXEC_BREAK || i == last;
+    if (!done) {
+      state->backEdge("FOR loop", n->line);
+      if (state->checkpointDue)
+        save(n);
+    }
+    leave();
+    if (done)
+      return EXEC_NORMAL;
+  }
+  return n->iterate(n->downto ? i - 1 : i + 1, last);
+}
@@ -0,0 +1,64 @@
+//*****************************************************************************
+// purpose: Checkpoint and resume of a long tree-walking run
+//          Saves variables, loop position and input offset at back-edges
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "nodes.h"
+#include <map>
+
+// ---------------------------------------------------------------------
+// Saves the running program to a file every few seconds, at the back-edge
+// of a loop of the main block, and continues a saved run.
+//
+// The tree walker's position is its C++ call stack, but at a back-edge of
+// a main-block loop that stack is fixed by the loop alone: the compounds,
+// IFs and loops around it, and no call in progress. Only the enclosing
+// FOR loops hold anything outside State, their native counters, so the
+// checkpoint is the loop, those counters, and State.
+class Checkpointer {
+public:
+  // fingerprint identifies the program's source; a checkpoint is only
+  // resumed by the same program
+  Checkpointer(ProgramNode* root, unsigned long long fingerprint);
+
+  // Saving: to fileName every period seconds, once start() is called
+  void start(const char* fileName, double period);
+  bool due();                    // has the period passed? (from checkLimits)
+  void save(StatementNode* loop); // at loop's back-edge; waits if a call is running
+  int saved = 0;                 // checkpoints written
+
+  // FOR loops in progress, outermost first
+  void enter(int* counter, int last) { running.push_back(make_pair(counter, last)); }
+  void leave() { running.pop_back(); }
+
+  // Resuming: load fills the reset State and returns "", or why the file
+  // cannot be resumed; resume then runs the rest of the program
+  string load(const char* fileName);
+  void resume();
+
+private:
+  ProgramNode* root;
+  unsigned long long fingerprint;
+  vector<StatementNode*> loops;           // WHILE and FOR of the main block, in source order
+  map<StatementNode*, int> loopNumbers;   // inverse of loops
+  vector<pair<int*, int> > running;       // counter and last value of each running FOR
+  string fileName;                        // where save() writes
+  chrono::steady_clock::duration period;
+  chrono::steady_clock::time_point next;  // when the next checkpoint is due
+  // Position of a loaded checkpoint
+  int loop = -1;
+  vector<pair<int, int> > counters;
+  void number(StatementNode* stmt);
+  bool path(StatementNode* from, StatementNode* to, vector<StatementNode*>& nodes);
+  ExecStatus resume(vector<StatementNode*>& nodes, int k, int& counter);
+};
+
+// FNV-1a hash of a file's bytes; 0 if it cannot be read
+unsigned long long fingerprintFile(const char* fileName);
+
+#endif /* CHECKPOINT_H */
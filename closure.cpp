@@ -0,0 +1,483 @@
+//*****************************************************************************
+// purpose: Closure-compiled execution of a TIPS program
+//          Lowers every node once into a tree of pre-bound function pointers
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#include "closure.h"
+#include "parser.h"
+#include <map>
+
+// ---------------------------------------------------------------------
+// A compiled expression: the function that evaluates it, and everything
+// that function needs already bound. Which function is chosen stands in
+// for the operator, the variable's storage and the element type.
+struct CExpr;
+struct CSub;
+typedef float (*CExprFn)(const CExpr* e);
+
+struct CExpr {
+  CExprFn eval = nullptr;
+  float constant = 0.0f;
+  int slot = 0;                 // variable slot or array number
+  ArrayT* array = nullptr;      // declaration of an indexed array
+  const string* name = nullptr; // array name, for range errors
+  CExpr* left = nullptr;        // operand, or the index of an element
+  CExpr* right = nullptr;
+  CSub* callee = nullptr;       // function of a call
+  vector<CExpr*> args;
+};
+
+#define EVAL(e) ((e)->eval(e))
+
+// A compiled statement, bound the same way
+struct CStmt;
+typedef ExecStatus (*CStmtFn)(const CStmt* s);
+
+struct CStmt {
+  CStmtFn exec = nullptr;
+  int slot = 0;                 // variable slot or array number
+  int line = 0;                 // source line of a loop, for limit reports
+  bool local = false;           // is a FOR counter a local of the frame?
+  ArrayT* array = nullptr;      // declaration of a stored-to array
+  const string* name = nullptr; // array name, for range errors
+  CExpr* expr = nullptr;        // value, condition or first counter value
+  CExpr* index = nullptr;       // subscript of a store
+  CExpr* limit = nullptr;       // last counter value of a FOR
+  CStmt* first = nullptr;       // THEN branch or loop body
+  CStmt* second = nullptr;      // ELSE branch
+  vector<CStmt*> body;          // statements of a compound
+  CSub* callee = nullptr;       // procedure of a call
+  vector<CExpr*> args;
+  StatementNode* node = nullptr; // READ and WRITE run through their node
+};
+
+#define EXEC(s) ((s)->exec(s))
+
+// A compiled procedure or function
+struct CSub {
+  SubprogramNode* node = nullptr; // frame layout, name and line
+  CStmt* body = nullptr;
+};
+
+// ---------------------------------------------------------------------
+// Leaves
+static float constant(const CExpr* e) { return e->constant; }
+static float globalVar(const CExpr* e) { return state->vars[e->slot]; }
+static float localVar(const CExpr* e) { return state->stack[state->frame + e->slot]; }
+
+static inline int offsetOf(const CExpr* index, ArrayT* array, const string* name) {
+  int i = static_cast<int>(EVAL(index));
+  if (i < array->low || i > array->high)
+    throw RuntimeError{rangeErrorText(*name, array, i)};
+  return i - array->low;
+}
+static float intElement(const CExpr* e) {
+  return static_cast<float>(state->ints[e->slot][offsetOf(e->left, e->array, e->name)]);
+}
+static float realElement(const CExpr* e) {
+  return state->reals[e->slot][offsetOf(e->left, e->array, e->name)];
+}
+// The parser proved the index in range
+static float intElementUnchecked(const CExpr* e) {
+  return static_cast<float>(state->ints[e->slot][static_cast<int>(EVAL(e->left)) - e->array->low]);
+}
+static float realElementUnchecked(const CExpr* e) {
+  return state->reals[e->slot][static_cast<int>(EVAL(e->left)) - e->array->low];
+}
+
+// Operators. The left operand is always evaluated first, as in the tree.
+static float add(const CExpr* e) { float a = EVAL(e->left); return a + EVAL(e->right); }
+static float subtract(const CExpr* e) { float a = EVAL(e->left); return a - EVAL(e->right); }
+static float multiply(const CExpr* e) { float a = EVAL(e->left); return a * EVAL(e->right); }
+static float divide(const CExpr* e) { float a = EVAL(e->left); return a / EVAL(e->right); }
+static float modulo(const CExpr* e) {
+  int a = static_cast<int>(EVAL(e->left));
+  return a % static_cast<int>(EVAL(e->right));
+}
+static float logicalOr(const CExpr* e) {
+  return truth(EVAL(e->left)) || truth(EVAL(e->right)) ? 1.0f : 0.0f;
+}
+static float logicalAnd(const CExpr* e) {
+  return truth(EVAL(e->left)) && truth(EVAL(e->right)) ? 1.0f : 0.0f;
+}
+static float equal(const CExpr* e) {
+  float a = EVAL(e->left);
+  return truth(a - EVAL(e->right)) ? 0.0f : 1.0f;
+}
+static float notEqual(const CExpr* e) {
+  float a = EVAL(e->left);
+  return truth(a - EVAL(e->right)) ? 1.0f : 0.0f;
+}
+static float lessThan(const CExpr* e) { float a = EVAL(e->left); return a < EVAL(e->right) ? 1.0f : 0.0f; }
+static float greaterThan(const CExpr* e) { float a = EVAL(e->left); return a > EVAL(e->right) ? 1.0f : 0.0f; }
+static float logicalNot(const CExpr* e) { return truth(EVAL(e->left)) ? 0.0f : 1.0f; }
+static float negative(const CExpr* e) { return -EVAL(e->left); }
+
+// The commonest shapes in loops, a variable against a literal, skip
+// both operand calls
+static float globalPlusConstant(const CExpr* e) { return state->vars[e->slot] + e->constant; }
+static float globalMinusConstant(const CExpr* e) { return state->vars[e->slot] - e->constant; }
+static float globalLessConstant(const CExpr* e) { return state->vars[e->slot] < e->constant ? 1.0f : 0.0f; }
+static float globalGreaterConstant(const CExpr* e) { return state->vars[e->slot] > e->constant ? 1.0f : 0.0f; }
+
+// ---------------------------------------------------------------------
+// Run one activation of sub, as SubprogramNode::call does
+static float call(const CSub* sub, const vector<CExpr*>& args) {
+  SubprogramNode* node = sub->node;
+  if (state->depth == MAX_CALL_DEPTH || state->top + node->frameSize > state->stackSlots)
+    throw RuntimeError{"ERROR - calls nested too deeply in " + node->label};
+  state->backEdge(node->label.c_str(), node->line);
+  int base = state->top;
+  state->top = base + node->frameSize;
+  float* slots = state->stack.get() + base;
+  for (int i = 0; i < node->paramCount; ++i)
+    slots[i] = EVAL(args[i]);
+  for (int i = node->paramCount; i < node->frameSize; ++i)
+    slots[i] = 0.0f;
+  int callerFrame = state->frame;
+  state->frame = base;
+  ++state->depth;
+  EXEC(sub->body);
+  --state->depth;
+  state->frame = callerFrame;
+  state->top = base;
+  return node->resultSlot >= 0 ? slots[node->resultSlot] : 0.0f;
+}
+static float functionCall(const CExpr* e) { return call(e->callee, e->args); }
+
+// ---------------------------------------------------------------------
+// Statements
+static ExecStatus assignGlobal(const CStmt* s) {
+  state->vars[s->slot] = EVAL(s->expr);
+  return EXEC_NORMAL;
+}
+static ExecStatus assignLocal(const CStmt* s) {
+  float value = EVAL(s->expr);
+  state->stack[state->frame + s->slot] = value;
+  return EXEC_NORMAL;
+}
+static ExecStatus storeInt(const CStmt* s) {
+  int offset = offsetOf(s->index, s->array, s->name);
+  state->ints[s->slot][offset] = static_cast<int>(EVAL(s->expr));
+  return EXEC_NORMAL;
+}
+static ExecStatus storeReal(const CStmt* s) {
+  int offset = offsetOf(s->index, s->array, s->name);
+  state->reals[s->slot][offset] = EVAL(s->expr);
+  return EXEC_NORMAL;
+}
+static ExecStatus storeIntUnchecked(const CStmt* s) {
+  int offset = static_cast<int>(EVAL(s->index)) - s->array->low;
+  state->ints[s->slot][offset] = static_cast<int>(EVAL(s->expr));
+  return EXEC_NORMAL;
+}
+static ExecStatus storeRealUnchecked(const CStmt* s) {
+  int offset = static_cast<int>(EVAL(s->index)) - s->array->low;
+  state->reals[s->slot][offset] = EVAL(s->expr);
+  return EXEC_NORMAL;
+}
+static ExecStatus compound(const CStmt* s) {
+  int length = s->body.size();
+  state->steps += length; // counted up front, checked on back-edges
+  for (int i = 0; i < length; ++i) {
+    ExecStatus status = EXEC(s->body[i]);
+    if (status != EXEC_NORMAL)
+      return status;
+  }
+  return EXEC_NORMAL;
+}
+static ExecStatus ifThen(const CStmt* s) {
+  if (truth(EVAL(s->expr)))
+    return EXEC(s->first);
+  return EXEC_NORMAL;
+}
+static ExecStatus ifThenElse(const CStmt* s) {
+  if (truth(EVAL(s->expr)))
+    return EXEC(s->first);
+  return EXEC(s->second);
+}
+static ExecStatus whileLoop(const CStmt* s) {
+  while (truth(EVAL(s->expr))) {
+    if (EXEC(s->first) == EXEC_BREAK)
+      break;
+    state->backEdge("WHILE loop", s->line);
+  }
+  return EXEC_NORMAL;
+}
+static ExecStatus forUp(const CStmt* s) {
+  int first = static_cast<int>(EVAL(s->expr));
+  int last = static_cast<int>(EVAL(s->limit));
+  float& counter = state->var(s->local, s->slot); // vars and stack never move while running
+  if (first > last) return EXEC_NORMAL;
+  for (int i = first; ; ++i) {
+    counter = static_cast<float>(i);
+    if (EXEC(s->first) == EXEC_BREAK) break;
+    if (i == last) break; // test before ++ so INT_MAX cannot overflow
+    state->backEdge("FOR loop", s->line);
+  }
+  return EXEC_NORMAL;
+}
+static ExecStatus forDown(const CStmt* s) {
+  int first = static_cast<int>(EVAL(s->expr));
+  int last = static_cast<int>(EVAL(s->limit));
+  float& counter = state->var(s->local, s->slot);
+  if (first < last) return EXEC_NORMAL;
+  for (int i = first; ; --i) {
+    counter = static_cast<float>(i);
+    if (EXEC(s->first) == EXEC_BREAK) break;
+    if (i == last) break;
+    state->backEdge("FOR loop", s->line);
+  }
+  return EXEC_NORMAL;
+}
+static ExecStatus procedureCall(const CStmt* s) {
+  call(s->callee, s->args);
+  return EXEC_NORMAL;
+}
+// READ and WRITE are dominated by I/O; their nodes already do no lookups
+static ExecStatus throughNode(const CStmt* s) { return s->node->interpret(); }
+static ExecStatus breakLoop(const CStmt* s) { return EXEC_BREAK; }
+static ExecStatus continueLoop(const CStmt* s) { return EXEC_CONTINUE; }
+
+// ---------------------------------------------------------------------
+// Owns every compiled node of one program
+class ClosureProgram {
+public:
+  CStmt* main = nullptr;
+  void compile(ProgramNode* root);
+  ~ClosureProgram();
+private:
+  vector<CExpr*> exprs;               // every compiled node, for deletion
+  vector<CStmt*> stmts;
+  vector<CSub*> subs;
+  map<SubprogramNode*, CSub*> subOf;
+  CExpr* newExpr(CExprFn eval);
+  CStmt* newStmt(CStmtFn exec);
+  CExpr* binary(int op, CExpr* left, CExpr* right);
+  CExpr* compile(ExpressionNode* node);
+  CExpr* compile(SimpleExpressionNode* node);
+  CExpr* compile(TermNode* node);
+  CExpr* compile(FactorNode* node);
+  CStmt* compile(StatementNode* node);
+  void compileArgs(const vector<unique_ptr<ExpressionNode> >& args, vector<CExpr*>& out);
+};
+
+ClosureProgram::~ClosureProgram() {
+  for (int i = 0; i < exprs.size(); ++i)
+    delete exprs[i];
+  for (int i = 0; i < stmts.size(); ++i)
+    delete stmts[i];
+  for (int i = 0; i < subs.size(); ++i)
+    delete subs[i];
+}
+CExpr* ClosureProgram::newExpr(CExprFn eval) {
+  CExpr* e = new CExpr();
+  e->eval = eval;
+  exprs.push_back(e);
+  return e;
+}
+CStmt* ClosureProgram::newStmt(CStmtFn exec) {
+  CStmt* s = new CStmt();
+  s->exec = exec;
+  stmts.push_back(s);
+  return s;
+}
+
+// The one place operators are looked at: each picks its function
+CExpr* ClosureProgram::binary(int op, CExpr* left, CExpr* right) {
+  // A global variable against a literal collapses into one node
+  if (left->eval == globalVar && right->eval == constant) {
+    CExprFn fused = nullptr;
+    switch (op) {
+      case TOK_PLUS:        fused = globalPlusConstant; break;
+      case TOK_MINUS:       fused = globalMinusConstant; break;
+      case TOK_LESSTHAN:    fused = globalLessConstant; break;
+      case TOK_GREATERTHAN: fused = globalGreaterConstant; break;
+      default: break;
+    }
+    if (fused) {
+      CExpr* e = newExpr(fused);
+      e->slot = left->slot;
+      e->constant = right->constant;
+      return e;
+    }
+  }
+  CExprFn eval = nullptr;
+  switch (op) {
+    case TOK_PLUS:        eval = add; break;
+    case TOK_MINUS:       eval = subtract; break;
+    case TOK_OR:          eval = logicalOr; break;
+    case TOK_MULTIPLY:    eval = multiply; break;
+    case TOK_DIVIDE:      eval = divide; break;
+    case TOK_MOD:         eval = modulo; break;
+    case TOK_AND:         eval = logicalAnd; break;
+    case TOK_EQUALTO:     eval = equal; break;
+    case TOK_LESSTHAN:    eval = lessThan; break;
+    case TOK_GREATERTHAN: eval = greaterThan; break;
+    case TOK_NOTEQUALTO:  eval = notEqual; break;
+    default:              return left; // not produced by the parser
+  }
+  CExpr* e = newExpr(eval);
+  e->left = left;
+  e->right = right;
+  return e;
+}
+
+CExpr* ClosureProgram::compile(ExpressionNode* node) {
+  CExpr* value = compile(node->firstSimpleExpr.get());
+  if (node->relop != 0)
+    value = binary(node->relop, value, compile(node->secondSimpleExpr.get()));
+  return value;
+}
+
+CExpr* ClosureProgram::compile(SimpleExpressionNode* node) {
+  CExpr* value = compile(node->firstTerm.get());
+  for (int i = 0; i < node->restTerms.size(); ++i)
+    value = binary(node->restSmplExprOps[i], value, compile(node->restTerms[i].get()));
+  return value;
+}
+
+CExpr* ClosureProgram::compile(TermNode* node) {
+  CExpr* value = compile(node->firstFactor.get());
+  for (int i = 0; i < node->restFactors.size(); ++i)
+    value = binary(node->restTermOps[i], value, compile(node->restFactors[i].get()));
+  return value;
+}
+
+CExpr* ClosureProgram::compile(FactorNode* node) {
+  if (IntLitNode* n = dynamic_cast<IntLitNode*>(node)) {
+    CExpr* e = newExpr(constant);
+    e->constant = n->int_literal;
+    return e;
+  }
+  if (FloatLitNode* n = dynamic_cast<FloatLitNode*>(node)) {
+    CExpr* e = newExpr(constant);
+    e->constant = n->float_literal;
+    return e;
+  }
+  if (IdentifierNode* n = dynamic_cast<IdentifierNode*>(node)) {
+    CExpr* e = newExpr(n->local ? localVar : globalVar);
+    e->slot = n->slot;
+    return e;
+  }
+  if (IndexedIdentifierNode* n = dynamic_cast<IndexedIdentifierNode*>(node)) {
+    bool isInt = n->array->type == TOK_INTEGER;
+    CExpr* e = newExpr(n->checked ? (isInt ? intElement : realElement)
+                                  : (isInt ? intElementUnchecked : realElementUnchecked));
+    e->slot = n->array->number;
+    e->array = n->array;
+    e->name = &n->id;
+    e->left = compile(n->index.get());
+    return e;
+  }
+  if (NestedExpressionNode* n = dynamic_cast<NestedExpressionNode*>(node))
+    return compile(n->exprPtr.get());
+  if (NotNode* n = dynamic_cast<NotNode*>(node)) {
+    CExpr* e = newExpr(logicalNot);
+    e->left = compile(n->factor.get());
+    return e;
+  }
+  if (MinusNode* n = dynamic_cast<MinusNode*>(node)) {
+    CExpr* e = newExpr(negative);
+    e->left = compile(n->factor.get());
+    return e;
+  }
+  FunctionCallNode* n = dynamic_cast<FunctionCallNode*>(node);
+  CExpr* e = newExpr(functionCall);
+  e->callee = subOf[n->callee];
+  compileArgs(n->args, e->args);
+  return e;
+}
+
+void ClosureProgram::compileArgs(const vector<unique_ptr<ExpressionNode> >& args, vector<CExpr*>& out) {
+  for (int i = 0; i < args.size(); ++i)
+    out.push_back(compile(args[i].get()));
+}
+
+CStmt* ClosureProgram::compile(StatementNode* node) {
+  if (AssignmentNode* n = dynamic_cast<AssignmentNode*>(node)) {
+    CStmt* s = newStmt(n->local ? assignLocal : assignGlobal);
+    s->slot = n->slot;
+    s->expr = compile(n->expr.get());
+    return s;
+  }
+  if (ArrayAssignmentNode* n = dynamic_cast<ArrayAssignmentNode*>(node)) {
+    bool isInt = n->array->type == TOK_INTEGER;
+    CStmt* s = newStmt(n->checked ? (isInt ? storeInt : storeReal)
+                                  : (isInt ? storeIntUnchecked : storeRealUnchecked));
+    s->slot = n->array->number;
+    s->array = n->array;
+    s->name = &n->id;
+    s->index = compile(n->index.get());
+    s->expr = compile(n->expr.get());
+    return s;
+  }
+  if (CompoundNode* n = dynamic_cast<CompoundNode*>(node)) {
+    CStmt* s = newStmt(compound);
+    for (int i = 0; i < n->statements.size(); ++i)
+      s->body.push_back(compile(n->statements[i].get()));
+    return s;
+  }
+  if (IfNode* n = dynamic_cast<IfNode*>(node)) {
+    CStmt* s = newStmt(n->elseStatement ? ifThenElse : ifThen);
+    s->expr = compile(n->expr.get());
+    s->first = compile(n->thenStatement.get());
+    if (n->elseStatement)
+      s->second = compile(n->elseStatement.get());
+    return s;
+  }
+  if (WhileNode* n = dynamic_cast<WhileNode*>(node)) {
+    CStmt* s = newStmt(whileLoop);
+    s->line = n->line;
+    s->expr = compile(n->expr.get());
+    s->first = compile(n->statement.get());
+    return s;
+  }
+  if (ForNode* n = dynamic_cast<ForNode*>(node)) {
+    CStmt* s = newStmt(n->downto ? forDown : forUp);
+    s->slot = n->slot;
+    s->local = n->local;
+    s->line = n->line;
+    s->expr = compile(n->startExpr.get());
+    s->limit = compile(n->endExpr.get());
+    s->first = compile(n->statement.get());
+    return s;
+  }
+  if (CallNode* n = dynamic_cast<CallNode*>(node)) {
+    CStmt* s = newStmt(procedureCall);
+    s->callee = subOf[n->callee];
+    compileArgs(n->args, s->args);
+    return s;
+  }
+  if (dynamic_cast<BreakNode*>(node))
+    return newStmt(breakLoop);
+  if (dynamic_cast<ContinueNode*>(node))
+    return newStmt(continueLoop);
+  CStmt* s = newStmt(throughNode); // READ or WRITE
+  s->node = node;
+  return s;
+}
+
+void ClosureProgram::compile(ProgramNode* root) {
+  BlockNode* block = root->block.get();
+  // Every subprogram gets its entry before any body is compiled, so
+  // recursive and forward calls bind directly
+  for (int i = 0; i < block->subprograms.size(); ++i) {
+    CSub* sub = new CSub();
+    sub->node = block->subprograms[i].get();
+    subs.push_back(sub);
+    subOf[sub->node] = sub;
+  }
+  for (int i = 0; i < subs.size(); ++i)
+    subs[i]->body = compile(subs[i]->node->body.get());
+  main = compile(block->compound.get());
+}
+
+// ---------------------------------------------------------------------
+void runClosures(ProgramNode* root) {
+  ClosureProgram program;
+  program.compile(root);
+  EXEC(program.main);
+}
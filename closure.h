@@ -0,0 +1,21 @@
+//*****************************************************************************
+// purpose: Closure-compiled execution of a TIPS program
+//          Lowers every node once into a tree of pre-bound function pointers
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#ifndef CLOSURE_H
+#define CLOSURE_H
+
+#include "nodes.h"
+
+// Compile the parsed program into closures, then run it once in the
+// current thread's State, which must already be reset. Operators,
+// variable slots and array element types are bound at compile time, so
+// running does no switch on token codes. Output, errors and limits are
+// exactly those of root->interpret(); a RuntimeError stops the run the
+// same way.
+void runClosures(ProgramNode* root);
+
+#endif /* CLOSURE_H */
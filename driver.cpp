@@ -12,31 +12,66 @@
 #include <iostream>
 #include <iomanip>
 #include <cstring>
-#include "lexer.h"
 #include "parser.h"
 #include "nodes.h"
+#include "input.h"
+#include "memstats.h"
+#include "ir.h"
+#include "profile.h"
+#include "trace.h"
+#include "perfcount.h"
+#include "tips.h"
 
 using namespace std;
 
-extern "C"
-{
-  // Instantiate global variables
-  extern FILE *yyin;   // input stream
-  extern FILE *yyout;  // output stream
-  extern int yyleng;   // length of current lexeme
-  extern char *yytext; // text of current lexeme
-  extern int yylex();  // the generated lexical analyzer
-  extern int yylex_destroy(); // deletes memory allocated by yylex
-}
-
 extern bool printParse;       // shall tree be printed while parsing?
 extern bool printTree;        // shall we print the tree?
 
+bool printSymbolTable = false; // shall we print the symbol table?
+
+// --profile-gen: write the counts of the run, however it ended
+static void saveProfile(Profile* profile, const char* fileName, ProgramNode* root) {
+  if (!profile->save(fileName, root->id))
+    cout << "ERROR - cannot write " << fileName << endl;
+}
+
+// --trace: dump the last statements run, however the run ended
+static void saveTrace(Tracer* tracer, int status) {
+  if (!tracer->dump(status))
+    cout << "ERROR - cannot write " << tracer->fileName << endl;
+}
+
 int main( int argc, char* argv[] )
 {
-  // Whether to print these items
-  bool printDelete = false;      // shall we print deleting the tree?
-  bool printSymbolTable = false; // shall we print the symbol table?
+  // Nothing here writes through C stdio, so let cout keep its own buffer.
+  // cin stays tied to cout, so prompts are still flushed before a READ.
+  ios::sync_with_stdio(false);
+
+  // Whether to print these items (printParse, printTree and printDelete
+  // are set on the globals the parser and nodes read)
+  const char* sourceName = nullptr; // program file; stdin if absent
+  const char* inputName = nullptr;  // file holding the values for READ
+  bool noPrompt = false;            // READ from stdin without prompting?
+  bool prefetch = false;            // read input on a background thread?
+  const char* batchName = nullptr;  // rows of input for a batch run
+  const char* recordsName = nullptr; // records of input for a parallel run
+  int threads = 0;                  // worker threads; 0 means one per core
+  InputReader* input = nullptr;     // READ source when not prompting
+  Limits limits;                    // budget of each run; zero fields are unlimited
+  bool memStats = false;            // report memory use before exiting?
+  bool stream = false;              // run statements while still parsing?
+  string engine = "tree";           // how the main run executes the tree
+  bool dumpIR = false;              // print the optimized IR?
+  const char* profileGen = nullptr; // file to record branch and loop counts in
+  const char* profileUse = nullptr; // counts to optimize the tree with
+  const char* checkpointName = nullptr; // file to save the run to periodically
+  double checkpointEvery = 60;      // seconds between checkpoints
+  const char* resumeName = nullptr; // checkpoint to continue from
+  const char* traceName = nullptr;  // file to dump the trace ring to
+  int traceEvents = TRACE_EVENTS;   // statements the ring keeps
+  bool traceJSON = false;           // dump the trace as JSON?
+  bool perfCounters = false;        // report hardware counters per phase?
+  bool autoParallel = false;        // run independent WHILE loops on threads?
   // Process any command-line switches
   for(int i = 1; i < argc; i++) {
     // -p flag: if requested, print while parsing
@@ -44,39 +79,221 @@ int main( int argc, char* argv[] )
       printParse = true;
     }
     // -t flag: if requested, print parse tree
-    if(std::strcmp(argv[i], "-t") == 0) {
+    else if(std::strcmp(argv[i], "-t") == 0) {
       printTree = true;
     }
     // -s flag: if requested, print symbol table
-    if(std::strcmp(argv[i], "-s") == 0) {
+    else if(std::strcmp(argv[i], "-s") == 0) {
       printSymbolTable = true;
     }
     // -d flag: if requested, print while deleting parse tree
-    if(std::strcmp(argv[i], "-d") == 0) {
+    else if(std::strcmp(argv[i], "-d") == 0) {
       printDelete = true;
     }
+    // --input FILE: take READ values from FILE, without prompts
+    else if(std::strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+      inputName = argv[++i];
+    }
+    // --no-prompt: take READ values from stdin, without prompts
+    else if(std::strcmp(argv[i], "--no-prompt") == 0) {
+      noPrompt = true;
+    }
+    // --prefetch: read piped input ahead on a separate thread
+    else if(std::strcmp(argv[i], "--prefetch") == 0) {
+      prefetch = true;
+    }
+    // --batch FILE: run once per line of FILE, many lines in lockstep
+    else if(std::strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+      batchName = argv[++i];
+    }
+    // --records FILE: run once per line of FILE, lines spread over threads
+    else if(std::strcmp(argv[i], "--records") == 0 && i + 1 < argc) {
+      recordsName = argv[++i];
+    }
+    // --threads N: how many threads --records and --auto-parallel use
+    else if(std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    }
+    // --parse-threads N: parse a large main block on N threads
+    else if(std::strcmp(argv[i], "--parse-threads") == 0 && i + 1 < argc) {
+      parseThreads = atoi(argv[++i]);
+    }
+    // --max-steps N: stop after about N statements
+    else if(std::strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc) {
+      limits.maxSteps = atoll(argv[++i]);
+    }
+    // --timeout SECONDS: stop after SECONDS of wall-clock time
+    else if(std::strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+      limits.timeout = atof(argv[++i]);
+    }
+    // --max-output BYTES: stop once WRITE has printed more than BYTES
+    else if(std::strcmp(argv[i], "--max-output") == 0 && i + 1 < argc) {
+      limits.maxOutput = atoll(argv[++i]);
+    }
+    // --mem-stats: report the memory held by the tree, tables and state
+    else if(std::strcmp(argv[i], "--mem-stats") == 0) {
+      memStats = true;
+    }
+    // --stream: run the main block statement by statement while parsing
+    else if(std::strcmp(argv[i], "--stream") == 0) {
+      stream = true;
+    }
+    // --dump-ir: print the program's optimized SSA IR
+    else if(std::strcmp(argv[i], "--dump-ir") == 0) {
+      dumpIR = true;
+    }
+    // --profile-gen FILE: count IF branches and WHILE trips into FILE
+    else if(std::strcmp(argv[i], "--profile-gen") == 0 && i + 1 < argc) {
+      profileGen = argv[++i];
+    }
+    // --profile-use FILE: reorder IF chains and specialize hot loops
+    else if(std::strcmp(argv[i], "--profile-use") == 0 && i + 1 < argc) {
+      profileUse = argv[++i];
+    }
+    // --checkpoint FILE: save the run to FILE every so often
+    else if(std::strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+      checkpointName = argv[++i];
+    }
+    // --checkpoint-every SECONDS: how often --checkpoint saves
+    else if(std::strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc) {
+      checkpointEvery = atof(argv[++i]);
+    }
+    // --resume FILE: continue the run saved in FILE
+    else if(std::strcmp(argv[i], "--resume") == 0 && i + 1 < argc) {
+      resumeName = argv[++i];
+    }
+    // --trace FILE: record statements run, dumped to FILE at the end
+    else if(std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      traceName = argv[++i];
+    }
+    // --trace-events N: how many of the last statements --trace keeps
+    else if(std::strcmp(argv[i], "--trace-events") == 0 && i + 1 < argc) {
+      traceEvents = atoi(argv[++i]);
+    }
+    // --trace-json: dump the trace as JSON rather than binary
+    else if(std::strcmp(argv[i], "--trace-json") == 0) {
+      traceJSON = true;
+    }
+    // --auto-parallel: run WHILE loops with independent iterations on threads
+    else if(std::strcmp(argv[i], "--auto-parallel") == 0) {
+      autoParallel = true;
+    }
+    // --perf-counters: count instructions, cycles and misses per phase
+    else if(std::strcmp(argv[i], "--perf-counters") == 0) {
+      perfCounters = true;
+    }
+    // --engine NAME: run with the tree walker (tree), closures (closure)
+    // or the optimized IR (ir)
+    else if(std::strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+      engine = argv[++i];
+    }
+    // anything else names the program
+    else if(sourceName == nullptr) {
+      sourceName = argv[i];
+    }
+  }
+
+  if (stream && (batchName || recordsName || printTree || dumpIR)) {
+    cout << "ERROR - --stream cannot be used with --batch, --records, -t or --dump-ir" << endl;
+    return(EXIT_FAILURE);
+  }
+
+  if (stream && parseThreads > 1) {
+    cout << "ERROR - --stream cannot be used with --parse-threads" << endl;
+    return(EXIT_FAILURE);
+  }
+
+  if (engine != "tree" && engine != "closure" && engine != "ir") {
+    cout << "ERROR - unknown engine " << engine << endl;
+    return(EXIT_FAILURE);
+  }
+  if (engine != "tree" && (stream || batchName || recordsName)) {
+    cout << "ERROR - --engine " << engine << " cannot be used with --stream, --batch or --records" << endl;
+    return(EXIT_FAILURE);
+  }
+
+  if (profileGen && (stream || batchName || recordsName || engine != "tree")) {
+    cout << "ERROR - --profile-gen only counts a single run of the tree engine" << endl;
+    return(EXIT_FAILURE);
+  }
+  if (profileUse && (stream || profileGen)) {
+    cout << "ERROR - --profile-use cannot be used with --stream or --profile-gen" << endl;
+    return(EXIT_FAILURE);
+  }
+
+  if ((checkpointName || resumeName)
+      && (!sourceName || stream || batchName || recordsName || engine != "tree" || profileGen)) {
+    cout << "ERROR - --checkpoint and --resume need a program file and a single run of the tree engine" << endl;
+    return(EXIT_FAILURE);
+  }
+
+  if (traceName && (stream || batchName || recordsName || engine != "tree")) {
+    cout << "ERROR - --trace only records a single run of the tree engine" << endl;
+    return(EXIT_FAILURE);
+  }
+  if (traceName && (traceEvents < 1 || traceEvents > (1 << 30))) {
+    cout << "ERROR - --trace-events needs a count from 1 to " << (1 << 30) << endl;
+    return(EXIT_FAILURE);
+  }
+
+  if (autoParallel && (stream || batchName || recordsName || engine != "tree")) {
+    cout << "ERROR - --auto-parallel only runs a single run of the tree engine" << endl;
+    return(EXIT_FAILURE);
   }
 
-  if (argc > 1) {
+  FILE* source = stdin;
+  if (sourceName) {
     // If a file name is provided, open it
-    yyin = fopen(argv[1], "r");
-    if (yyin == NULL) {
-      cout << "ERROR - cannot open " << argv[1] << endl;
+    source = fopen(sourceName, "r");
+    if (source == NULL) {
+      cout << "ERROR - cannot open " << sourceName << endl;
       return(EXIT_FAILURE);
     }
   }
 
-  // Create the root of the parse tree
-  ProgramNode* root = nullptr;
+  if (inputName) {
+    input = new InputReader();
+    if (!input->openFile(inputName, prefetch)) {
+      cout << "ERROR - cannot open " << inputName << endl;
+      return(EXIT_FAILURE);
+    }
+  } else if (noPrompt) {
+    input = new InputReader();
+    input->openStream(0, prefetch);
+  }
 
-  lex();  // prime the pump (get first token)
+  // A streamed program runs while it is parsed, in this State
+  State streamState;
+  streamState.limits = limits;
+  streamState.input = input;
+  streamState.out = cout.rdbuf();
 
-  root = program(); // start symbol is <expr>
+  // Counters are opened before parsing so every phase is measured
+  unique_ptr<PerfCounters> perf;
+  if (perfCounters) {
+    perf.reset(new PerfCounters());
+    perf->start("parse");
+  }
 
-  if (yyin)
-    fclose(yyin);
-    
-  yylex_destroy();
+  // Create the root of the parse tree
+  TipsResult compiled;
+  unique_ptr<TipsProgram> program(stream
+    ? TipsProgram::stream(source, streamState,
+                          [] { cout << "*** Interpret the Tree ***" << endl; }, compiled)
+    : TipsProgram::compile(source, compiled));
+  if (sourceName)
+    fclose(source);
+  if (perf)
+    perf->stop();
+  if (!program) {
+    // A syntax error, or an error in a streamed statement
+    cout << errorBanner(compiled.message) << flush;
+    if (perf)
+      perf->report(cout);
+    delete input;
+    return(compiled.status);
+  }
+  ProgramNode* root = program->tree();
 
   // Printing, Interpreting, and Deleting the tree all result in 
   // the same in-order traversal of the tree as parsing.  All
@@ -84,25 +301,153 @@ int main( int argc, char* argv[] )
 
   if(printTree) {
     cout << endl << "*** Print the Tree ***" << endl;
-    cout << *root << endl << endl;
+    onStackFor(root->nesting, [&] { cout << *root << endl << endl; });
+  }
+
+  // Profile sites are numbered on the tree as parsed; the profile is
+  // applied before any engine compiles the tree
+  unique_ptr<Profile> profile;
+  if (profileGen || profileUse)
+    profile.reset(new Profile(root));
+  if (profileUse) {
+    string problem = profile->load(profileUse, root->id);
+    if (problem.empty())
+      profile->apply();
+    else
+      cout << "WARNING - " << problem << "; running without it" << endl;
+  }
+  // Loops are analyzed on the tree the profile has reshaped
+  if (autoParallel)
+    program->parallelize(threads);
+  // The single run; --batch and --records make States of their own
+  TipsRun run(*program);
+  run.limits = limits;
+  run.engine = engine;
+  run.state().input = input;
+  if (profileGen)
+    run.state().profile = profile->counts.data();
+  // Statements are numbered for the trace once the profile has moved them
+  unique_ptr<Tracer> tracer;
+  if (traceName) {
+    tracer.reset(new Tracer(root, traceEvents, traceJSON));
+    tracer->fileName = traceName;
+    tracer->dumpOnSignals();
+    run.state().trace = tracer.get();
+  }
+  // What -s and --mem-stats look at afterwards
+  State& last = stream ? streamState : run.state();
+
+  if (dumpIR) {
+    cout << endl << "*** Print the IR ***" << endl;
+    printIR(cout, program->ir());
+    cout << endl;
+  }
+
+  if (batchName) {
+    if (limits.maxSteps > 0 || limits.timeout > 0 || limits.maxOutput > 0) {
+      cout << "ERROR - limits are not supported with --batch" << endl;
+      return(EXIT_FAILURE);
+    }
+    if (perf)
+      perf->start("interpret");
+    int status = program->batch(batchName).status;
+    if (perf) {
+      perf->stop();
+      perf->report(cout);
+    }
+    if (memStats)
+      printMemStats(root, nullptr);
+    return(status);
+  }
+
+  if (recordsName) {
+    if (perf)
+      perf->start("interpret");
+    int status = program->records(recordsName, threads, limits).status;
+    if (perf) {
+      perf->stop();
+      perf->report(cout);
+    }
+    if (memStats)
+      printMemStats(root, nullptr);
+    return(status);
   }
 
-  cout << "*** Interpret the Tree ***" << endl;
-  root->interpret();
+  // A streamed program has already run, its main block left empty
+  if (!stream) {
+    if (checkpointName)
+      run.checkpoint(checkpointName, checkpointEvery, sourceName);
+    if (resumeName) {
+      string problem = run.resume(resumeName, sourceName);
+      if (!problem.empty()) {
+        cout << "ERROR - " << problem << endl;
+        delete input;
+        return(EXIT_FAILURE);
+      }
+    }
+    cout << "*** Interpret the Tree ***" << endl;
+    if (perf)
+      perf->start("interpret");
+    TipsResult result = run.run();
+    if (perf)
+      perf->stop();
+    if (!result.ok()) {
+      cout << errorBanner(result.message) << flush;
+      if (profileGen)
+        saveProfile(profile.get(), profileGen, root);
+      if (tracer)
+        saveTrace(tracer.get(), result.status);
+      if (memStats)
+        printMemStats(root, &last);
+      if (perf)
+        perf->report(cout);
+      delete input;
+      return(result.status);
+    }
+  }
   cout << endl;
 
+  // A finished run has nothing left to resume
+  if (checkpointName)
+    remove(checkpointName);
+
+  if (profileGen)
+    saveProfile(profile.get(), profileGen, root);
+  if (tracer)
+    saveTrace(tracer.get(), EXIT_SUCCESS);
+
   if(printSymbolTable)
   {
     cout << "*** Print the Symbol Table ***" << endl;
     symbolTableT::iterator it;
-    for(it = symbolTable.begin(); it != symbolTable.end(); ++it )
-      cout << setw(8) << it->first << ": " << it->second << endl;
+    for(it = root->tables->symbols.begin(); it != root->tables->symbols.end(); ++it )
+      cout << setw(8) << it->first << ": " << last.vars[it->second] << endl;
+    arrayTableT::iterator at;
+    for(at = root->tables->arrays.begin(); at != root->tables->arrays.end(); ++at ) {
+      ArrayT& array = at->second;
+      cout << setw(8) << at->first << ": [" << array.low << ".." << array.high << "]";
+      for(int i = 0; i <= array.high - array.low; ++i)
+        cout << " " << (array.type == TOK_INTEGER ? last.ints[array.number][i]
+                                                  : last.reals[array.number][i]);
+      cout << endl;
+    }
   }
   
+  if(memStats)
+    printMemStats(root, &last);
+
   if(printDelete)
     cout << "*** Delete the Tree ***" << endl;
-  delete root;
+  if (perf)
+    perf->start("teardown");
+  program.reset();
   root = nullptr;
+  delete input;
+  input = nullptr;
+  if (perf) {
+    perf->stop();
+    perf->report(cout);
+  }
     
   return(EXIT_SUCCESS);
 }
@@ -0,0 +1,80 @@
+//*****************************************************************************
+// purpose: Fibers, stacks a run can be suspended on and continued later
+//          Let a READ that has no input yet give its thread back
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#include "fiber.h"
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// The fiber this thread is running, if any
+static thread_local Fiber* current = nullptr;
+
+Fiber::Fiber(size_t size) : size(size) {
+}
+
+Fiber::~Fiber() {
+  if (stack)
+    munmap(stack, size + getpagesize());
+}
+
+void Fiber::start(function<void()> b) {
+  if (!stack) {
+    // Reserve the stack without committing it; a run that overflows it
+    // hits the guard page and crashes like one overflowing a thread
+    size_t guard = getpagesize();
+    void* area = mmap(nullptr, size + guard, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (area == MAP_FAILED)
+      throw bad_alloc();
+    mprotect(area, guard, PROT_NONE);
+    stack = area;
+  }
+  body = std::move(b);
+  failure = nullptr;
+  getcontext(&context);
+  context.uc_stack.ss_sp = static_cast<char*>(stack) + getpagesize();
+  context.uc_stack.ss_size = size;
+  context.uc_link = &caller; // where entry() returning goes
+  makecontext(&context, &Fiber::entry, 0);
+  running = true;
+}
+
+void Fiber::entry() {
+  Fiber* self = current;
+  try {
+    self->body();
+  } catch (...) {
+    // An exception cannot unwind past the fiber's first frame
+    self->failure = current_exception();
+  }
+  self->running = false;
+}
+
+void Fiber::resume() {
+  Fiber* outer = current;
+  current = this;
+  swapcontext(&caller, &context);
+  current = outer;
+  if (!running)
+    body = nullptr;
+  if (failure) {
+    exception_ptr thrown = failure;
+    failure = nullptr;
+    rethrow_exception(thrown);
+  }
+}
+
+void Fiber::suspend() {
+  Fiber* self = current;
+  swapcontext(&self->context, &self->caller);
+}
+
+void runOnStack(size_t size, const function<void()>& body) {
+  Fiber fiber(size);
+  fiber.start(body);
+  fiber.resume();
+}
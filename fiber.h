@@ -0,0 +1,54 @@
+//*****************************************************************************
+// purpose: Fibers, stacks a run can be suspended on and continued later
+//          Let a READ that has no input yet give its thread back
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#ifndef FIBER_H
+#define FIBER_H
+
+#include <functional>
+#include <exception>
+#include <ucontext.h>
+
+using namespace std;
+
+// Stack of each fiber, as much as a thread gets by default. Only the
+// pages a run touches are ever backed by memory.
+#define FIBER_STACK (8 << 20)
+
+// ---------------------------------------------------------------------
+// A function running on a stack of its own. resume() runs it until it
+// calls suspend() or returns, then comes back; the next resume()
+// continues it where it was. The tree walker keeps its position in its
+// C++ call stack, so suspending that stack whole suspends a run at any
+// READ, however deep in loops and calls, for every engine alike.
+//
+// A fiber is continued on the thread that started it: code running on
+// it may hold addresses of that thread's thread_local variables.
+class Fiber {
+public:
+  Fiber(size_t size = FIBER_STACK); // bytes of stack
+  ~Fiber();                    // only when not suspended
+  void start(function<void()> body); // body runs on the next resume()
+  void resume();               // rethrows what body threw
+  bool suspended() const { return running; } // started and not returned
+  static void suspend();       // from the body: back to the resume()
+
+private:
+  void* stack = nullptr;       // mapped on first start(), with a guard page below
+  size_t size;                 // bytes of it above the guard page
+  ucontext_t context;          // where the body is
+  ucontext_t caller;           // where resume() was called
+  function<void()> body;
+  bool running = false;        // started and not yet returned
+  exception_ptr failure;       // what body threw
+  static void entry();
+};
+
+// Run body to its end on a fiber of size bytes, for work that recurses
+// deeper than a thread's own stack allows. body must not suspend.
+void runOnStack(size_t size, const function<void()>& body);
+
+#endif /* FIBER_H */
@@ -0,0 +1,131 @@
+//*****************************************************************************
+// purpose: Fast number formatting for WRITE statements
+//          Produces the same text as ostream << float with default flags
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#include "format.h"
+#include <cmath>
+#include <cstdio>
+
+#define PRECISION 6 // significant digits of ostream's default format
+
+// Exact powers of ten that a double holds without rounding
+static const double powersOfTen[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// ---------------------------------------------------------------------
+// Write the decimal digits of n (n > 0) ending just before end; return
+// a pointer to the first digit.
+static char* digitsBackward(unsigned long n, char* end) {
+  do {
+    *--end = static_cast<char>('0' + n % 10);
+    n /= 10;
+  } while (n);
+  return end;
+}
+
+// The rare cases the fast paths cannot prove correct go through printf,
+// which is what ostream uses underneath.
+static int slowFormat(double value, char* out) {
+  return snprintf(out, FORMAT_BUFFER, "%g", value);
+}
+
+// ---------------------------------------------------------------------
+int formatNumber(float value, char* out) {
+  double d = value;
+  if (!std::isfinite(d))
+    return slowFormat(d, out);
+
+  char* p = out;
+  if (std::signbit(d)) {
+    *p++ = '-';
+    d = -d;
+  }
+  if (d == 0.0) {
+    *p++ = '0';
+    return static_cast<int>(p - out);
+  }
+
+  // Integer fast path: %g prints integers below 10^6 digit for digit
+  if (d < 1e6 && d == std::floor(d)) {
+    char digits[8];
+    char* first = digitsBackward(static_cast<unsigned long>(d), digits + sizeof(digits));
+    while (first < digits + sizeof(digits))
+      *p++ = *first++;
+    return static_cast<int>(p - out);
+  }
+
+  // Scale d to six integer digits: d = scaled * 10^(exp10 - 5)
+  int exp10 = static_cast<int>(std::floor(std::log10(d)));
+  int shift = PRECISION - 1 - exp10;
+  if (shift > 22 || shift < -22)
+    return slowFormat(value, out);
+  double scaled = shift >= 0 ? d * powersOfTen[shift] : d / powersOfTen[-shift];
+  if (scaled < 1e5 || scaled >= 1e6) {
+    // log10 landed on the wrong side of a power of ten
+    exp10 += scaled < 1e5 ? -1 : 1;
+    shift = PRECISION - 1 - exp10;
+    if (shift > 22 || shift < -22)
+      return slowFormat(value, out);
+    scaled = shift >= 0 ? d * powersOfTen[shift] : d / powersOfTen[-shift];
+  }
+  // One correctly rounded operation leaves scaled within 2^-32 of the
+  // exact value, so only a fraction right at one half can round the
+  // other way; hand those to printf.
+  double whole = std::floor(scaled);
+  double fraction = scaled - whole;
+  if (std::fabs(fraction - 0.5) < 1e-9)
+    return slowFormat(value, out);
+  unsigned long mantissa = static_cast<unsigned long>(whole) + (fraction > 0.5 ? 1 : 0);
+  if (mantissa >= 1000000) { // rounding carried into a seventh digit
+    mantissa /= 10;
+    ++exp10;
+  }
+
+  char digits[PRECISION];
+  digitsBackward(mantissa, digits + PRECISION);
+  int count = PRECISION;
+  while (count > 1 && digits[count - 1] == '0') // %g drops trailing zeros
+    --count;
+
+  if (exp10 < -4 || exp10 >= PRECISION) {
+    // d.ddddde+XX
+    *p++ = digits[0];
+    if (count > 1) {
+      *p++ = '.';
+      for (int i = 1; i < count; ++i)
+        *p++ = digits[i];
+    }
+    *p++ = 'e';
+    *p++ = exp10 < 0 ? '-' : '+';
+    int magnitude = exp10 < 0 ? -exp10 : exp10;
+    if (magnitude < 10)
+      *p++ = '0';
+    char expDigits[4];
+    char* first = digitsBackward(magnitude, expDigits + sizeof(expDigits));
+    while (first < expDigits + sizeof(expDigits))
+      *p++ = *first++;
+  } else if (exp10 < 0) {
+    // 0.000ddd
+    *p++ = '0';
+    *p++ = '.';
+    for (int i = -1; i > exp10; --i)
+      *p++ = '0';
+    for (int i = 0; i < count; ++i)
+      *p++ = digits[i];
+  } else {
+    // ddd.ddd
+    for (int i = 0; i <= exp10; ++i)
+      *p++ = digits[i];
+    if (count > exp10 + 1) {
+      *p++ = '.';
+      for (int i = exp10 + 1; i < count; ++i)
+        *p++ = digits[i];
+    }
+  }
+  return static_cast<int>(p - out);
+}
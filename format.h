@@ -0,0 +1,18 @@
+//*****************************************************************************
+// purpose: Fast number formatting for WRITE statements
+//          Produces the same text as ostream << float with default flags
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#define FORMAT_BUFFER 32 // room for the longest text formatNumber writes
+
+// Write value into out as ostream's default (%g, 6 significant digits)
+// formatting would, without going through locale facets. Returns the
+// number of characters written; out is not NUL terminated.
+int formatNumber(float value, char* out);
+
+#endif /* FORMAT_H */
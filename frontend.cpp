@@ -0,0 +1,127 @@
+//*****************************************************************************
+// purpose: Parallel front end for very large programs
+//          Lexes the main block and parses it in chunks on worker threads
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#include "frontend.h"
+#include "parser.h"
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+// ---------------------------------------------------------------------
+// Statements between two semicolons of the main block, and what parsing
+// them made
+struct Chunk {
+  TokenRun tokens;
+  vector<StatementNode*> statements;
+  bool ok = false;              // did the tokens parse on their own?
+  int separatorLine = 0;        // line of the semicolon after the chunk
+};
+
+// Chunks waiting for a parsing thread
+struct ChunkQueue {
+  mutex lock;
+  condition_variable ready;
+  deque<Chunk*> waiting;
+  bool closed = false;          // no more chunks will come
+  void push(Chunk* chunk) {
+    lock_guard<mutex> guard(lock);
+    waiting.push_back(chunk);
+    ready.notify_one();
+  }
+  void close() {
+    lock_guard<mutex> guard(lock);
+    closed = true;
+    ready.notify_all();
+  }
+  bool pop(Chunk*& chunk) {
+    unique_lock<mutex> guard(lock);
+    ready.wait(guard, [&] { return !waiting.empty() || closed; });
+    if (waiting.empty())
+      return false;
+    chunk = waiting.front();
+    waiting.pop_front();
+    return true;
+  }
+};
+
+static void parseChunks(ChunkQueue* queue, int level) {
+  Chunk* chunk;
+  while (queue->pop(chunk))
+    chunk->ok = parse_statements(&chunk->tokens, level, chunk->statements);
+}
+
+// The tokens of the whole block when it must be parsed again in order.
+// Static, since an error after the block still prints a lexeme from it.
+static TokenRun again;
+
+// ---------------------------------------------------------------------
+void parallel_statements(CompoundNode* compound, int level) {
+  ChunkQueue queue;
+  vector<thread> workers;
+  for (int i = 0; i < parseThreads; ++i)
+    workers.emplace_back(parseChunks, &queue, level);
+
+  // nextToken is the block's first. Nested BEGIN ... END pairs are
+  // counted so only the block's own semicolons and END are seen; a
+  // semicolon there always lies between two whole statements.
+  vector<unique_ptr<Chunk> > chunks;
+  chunks.emplace_back(new Chunk);
+  int depth = 0;
+  while (nextToken != TOK_EOF && !(nextToken == TOK_END && depth == 0)) {
+    if (nextToken == TOK_BEGIN)
+      ++depth;
+    else if (nextToken == TOK_END)
+      --depth;
+    if (nextToken == TOK_SEMICOLON && depth == 0
+        && chunks.back()->tokens.tokens.size() >= CHUNK_TOKENS) {
+      chunks.back()->separatorLine = tokenLine;
+      queue.push(chunks.back().get());
+      chunks.emplace_back(new Chunk);
+    } else {
+      chunks.back()->tokens.add(nextToken, lexeme, tokenLine);
+    }
+    lex();
+  }
+  queue.push(chunks.back().get());
+  queue.close();
+  for (thread& worker : workers)
+    worker.join();
+
+  bool ok = true;
+  for (auto& chunk : chunks)
+    ok = ok && chunk->ok;
+  if (ok) {
+    for (auto& chunk : chunks)
+      for (StatementNode* s : chunk->statements)
+        compound->addStatement(s);
+    return;
+  }
+
+  // A chunk failed: put the tokens back together, with the semicolons
+  // between chunks and the token that stopped lexing, and parse them as
+  // compound_statement() does. Its error() reports and exits.
+  for (auto& chunk : chunks)
+    for (StatementNode* s : chunk->statements)
+      delete s;
+  again = TokenRun();
+  for (int k = 0; k < chunks.size(); ++k) {
+    TokenRun& tokens = chunks[k]->tokens;
+    for (int i = 0; i < tokens.tokens.size(); ++i)
+      again.add(tokens.tokens[i], tokens.lexemes.data() + tokens.starts[i], tokens.lines[i]);
+    if (k + 1 < chunks.size())
+      again.add(TOK_SEMICOLON, ";", chunks[k]->separatorLine);
+  }
+  again.add(nextToken, lexeme, tokenLine);
+  lex_from(&again);
+  lex(); // Prime the pump
+  compound->addStatement(statement());
+  while (nextToken == TOK_SEMICOLON) {
+    lex(); // Read past the semicolon
+    compound->addStatement(statement());
+  }
+}
@@ -0,0 +1,25 @@
+//*****************************************************************************
+// purpose: Parallel front end for very large programs
+//          Lexes the main block and parses it in chunks on worker threads
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#ifndef FRONTEND_H
+#define FRONTEND_H
+
+#include "nodes.h"
+
+// Tokens per chunk handed to a parsing thread
+#define CHUNK_TOKENS (1 << 15)
+
+// Parse the statements of the main block into compound, whose BEGIN has
+// just been read, leaving the lexer at its END as compound_statement()
+// would. The tokens are cut into chunks at the block's own semicolons
+// and the chunks parsed on parseThreads threads while lexing goes on.
+// If any chunk does not parse on its own, the whole block is parsed
+// again in order on this thread, so errors are reported exactly as the
+// ordinary parser reports them.
+void parallel_statements(CompoundNode* compound, int level);
+
+#endif /* FRONTEND_H */
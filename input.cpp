@@ -0,0 +1,301 @@
+//*****************************************************************************
+// purpose: Non-interactive input for READ statements
+//          Buffered/mmapped number reader with an optional prefetch thread
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#include "input.h"
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CHUNK_SIZE   (1 << 16) // bytes per read()
+#define QUEUE_CHUNKS 8         // how far the reader thread may run ahead
+#define MAX_TOKEN    64        // longest number we accept
+
+// ---------------------------------------------------------------------
+// Chunks read by the prefetch thread. Shared so a thread still blocked
+// in read() at exit can be detached without touching a dead reader.
+struct PrefetchQueue {
+  mutex lock;
+  condition_variable changed;
+  deque<vector<char> > chunks;
+  bool done = false;
+};
+
+static void prefetchLoop(int fd, shared_ptr<PrefetchQueue> q) {
+  for (;;) {
+    vector<char> chunk(CHUNK_SIZE);
+    ssize_t n = read(fd, chunk.data(), chunk.size());
+    unique_lock<mutex> guard(q->lock);
+    if (n <= 0) {
+      q->done = true;
+      q->changed.notify_all();
+      return;
+    }
+    chunk.resize(n);
+    q->changed.wait(guard, [&] { return q->chunks.size() < QUEUE_CHUNKS; });
+    q->chunks.push_back(std::move(chunk));
+    q->changed.notify_all();
+  }
+}
+
+// ---------------------------------------------------------------------
+InputReader::InputReader() {
+}
+InputReader::~InputReader() {
+  if (mapped)
+    munmap(mapped, mappedLength);
+  if (ownsFd && fd >= 0 && !queue)
+    close(fd); // a live reader thread still owns the descriptor
+}
+
+bool InputReader::openFile(const char* path, bool prefetch) {
+  int file = open(path, O_RDONLY);
+  if (file < 0)
+    return false;
+  struct stat info;
+  if (fstat(file, &info) == 0 && S_ISREG(info.st_mode)) {
+    if (info.st_size == 0) {
+      close(file);
+      cur = end = nullptr;
+      atEof = true;
+      return true;
+    }
+    void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (data != MAP_FAILED) {
+      close(file);
+      madvise(data, info.st_size, MADV_SEQUENTIAL);
+      mapped = data;
+      mappedLength = info.st_size;
+      cur = base = static_cast<const char*>(data);
+      end = cur + info.st_size;
+      atEof = true; // the whole file is already visible
+      return true;
+    }
+  }
+  openStream(file, prefetch); // pipes, FIFOs, or mmap failed
+  ownsFd = true;
+  return true;
+}
+
+void InputReader::openStream(int descriptor, bool prefetch) {
+  fd = descriptor;
+  buffer.reserve(2 * CHUNK_SIZE);
+  cur = end = buffer.data();
+  if (prefetch) {
+    queue = make_shared<PrefetchQueue>();
+    thread(prefetchLoop, fd, queue).detach();
+  }
+}
+
+void InputReader::openBuffer(const char* data, long length) {
+  cur = base = data;
+  end = data + length;
+  consumed = 0;
+  atEof = true; // nothing more will arrive
+  badToken.clear();
+}
+
+void InputReader::openFed() {
+  fed = true;
+  finished = false;
+  pending.clear();
+  buffer.clear();
+  cur = end = buffer.data();
+  consumed = 0;
+  atEof = false;
+  badToken.clear();
+}
+
+void InputReader::feed(const char* data, long length) {
+  pending.insert(pending.end(), data, data + length);
+}
+
+void InputReader::finish() {
+  finished = true;
+}
+
+long InputReader::offset() const {
+  if (base)
+    return cur - base;
+  return consumed + (cur - buffer.data());
+}
+
+// Resuming a run: the input it had consumed is passed over
+long InputReader::skip(long bytes) {
+  long left = bytes;
+  while (left > 0 && (cur < end || refill())) {
+    long n = end - cur < left ? end - cur : left;
+    cur += n;
+    left -= n;
+  }
+  return bytes - left;
+}
+
+// Keep the unread tail and append the next block of input
+bool InputReader::refill() {
+  if (atEof)
+    return false;
+  size_t keep = end - cur;
+  consumed += cur - buffer.data();
+  if (keep > 0)
+    memmove(buffer.data(), cur, keep);
+  buffer.resize(keep);
+  if (fed) {
+    while (pending.empty() && !finished)
+      wait();
+    if (pending.empty())
+      atEof = true;
+    buffer.insert(buffer.end(), pending.begin(), pending.end());
+    pending.clear();
+  } else if (queue) {
+    unique_lock<mutex> guard(queue->lock);
+    queue->changed.wait(guard, [&] { return !queue->chunks.empty() || queue->done; });
+    if (queue->chunks.empty()) {
+      atEof = true;
+    } else {
+      vector<char>& chunk = queue->chunks.front();
+      buffer.insert(buffer.end(), chunk.begin(), chunk.end());
+      queue->chunks.pop_front();
+      queue->changed.notify_all();
+    }
+  } else {
+    buffer.resize(keep + CHUNK_SIZE);
+    ssize_t n = read(fd, buffer.data() + keep, CHUNK_SIZE);
+    if (n <= 0) {
+      n = 0;
+      atEof = true;
+    }
+    buffer.resize(keep + n);
+  }
+  cur = buffer.data();
+  end = cur + buffer.size();
+  return !atEof || keep != buffer.size();
+}
+
+static inline bool separator(char c) {
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == ',';
+}
+
+int InputReader::next(float& value) {
+  // Skip separators, pulling more input as needed
+  for (;;) {
+    while (cur < end && separator(*cur))
+      ++cur;
+    if (cur < end)
+      break;
+    if (!refill())
+      return INPUT_EOF;
+  }
+  // Make sure a whole token is buffered before parsing it
+  const char* stop = cur;
+  while (stop < end && !separator(*stop))
+    ++stop;
+  while (stop == end && !atEof && stop - cur < MAX_TOKEN) {
+    long scanned = stop - cur;
+    refill();
+    stop = cur + scanned;
+    while (stop < end && !separator(*stop))
+      ++stop;
+  }
+  int used = parseNumber(cur, stop, value);
+  if (used == 0 || cur + used != stop) {
+    badToken.assign(cur, stop - cur < MAX_TOKEN ? stop - cur : MAX_TOKEN);
+    return INPUT_MALFORMED;
+  }
+  cur = stop;
+  return INPUT_OK;
+}
+
+// ---------------------------------------------------------------------
+// Exact powers of ten that a double holds without rounding
+static const double powersOfTen[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+int parseNumber(const char* s, const char* e, float& value) {
+  const char* p = s;
+  bool negative = false;
+  if (p < e && (*p == '+' || *p == '-')) {
+    negative = (*p == '-');
+    ++p;
+  }
+  unsigned long long mantissa = 0;
+  int digits = 0;   // significant digits kept in mantissa
+  int exponent = 0; // decimal exponent applied to mantissa
+  bool any = false;
+  for (; p < e && *p >= '0' && *p <= '9'; ++p, any = true) {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      if (mantissa) ++digits;
+    } else {
+      ++exponent; // dropped digit
+    }
+  }
+  if (p < e && *p == '.') {
+    ++p;
+    for (; p < e && *p >= '0' && *p <= '9'; ++p, any = true) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        if (mantissa) ++digits;
+        --exponent;
+      }
+    }
+  }
+  if (!any)
+    return 0;
+  if (p < e && (*p == 'e' || *p == 'E')) {
+    const char* q = p + 1;
+    bool negativeExp = false;
+    if (q < e && (*q == '+' || *q == '-')) {
+      negativeExp = (*q == '-');
+      ++q;
+    }
+    if (q < e && *q >= '0' && *q <= '9') {
+      int power = 0;
+      for (; q < e && *q >= '0' && *q <= '9'; ++q)
+        if (power < 10000) power = power * 10 + (*q - '0');
+      exponent += negativeExp ? -power : power;
+      p = q;
+    }
+  }
+  double result;
+  if (mantissa == 0) {
+    result = 0.0;
+  } else if (digits <= 15 && exponent >= -22 && exponent <= 22) {
+    // Both factors are exact, so one rounding gives the nearest double
+    result = exponent < 0 ? mantissa / powersOfTen[-exponent]
+                          : mantissa * powersOfTen[exponent];
+  } else {
+    // Rare long or extreme numbers: let the C library round them
+    char text[MAX_TOKEN + 1];
+    size_t length = p - s < MAX_TOKEN ? p - s : MAX_TOKEN;
+    memcpy(text, s, length);
+    text[length] = 0;
+    result = fabs(strtod(text, nullptr));
+  }
+  value = static_cast<float>(negative ? -result : result);
+  return static_cast<int>(p - s);
+}
+
+// ---------------------------------------------------------------------
+string inputErrorText(const string& name, int status, const string& badToken, long offset) {
+  if (status == INPUT_EOF)
+    return "ERROR - input ended before READ(" + name + ")";
+  if (offset < 0)
+    return "ERROR - malformed input for READ(" + name + ")";
+  return "ERROR - malformed input '" + badToken + "' for READ(" + name
+         + ") at byte " + to_string(offset);
+}
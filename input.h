@@ -0,0 +1,72 @@
+//*****************************************************************************
+// purpose: Non-interactive input for READ statements
+//          Buffered/mmapped number reader with an optional prefetch thread
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+using namespace std;
+
+// Result codes of InputReader::next()
+#define INPUT_OK        0  // a number was read
+#define INPUT_EOF       1  // no more numbers
+#define INPUT_MALFORMED 2  // the next token is not a number
+
+struct PrefetchQueue; // chunks handed over by the reader thread
+
+// ---------------------------------------------------------------------
+// Reads whitespace- or comma-separated numbers from a file or pipe.
+// Regular files are mapped into memory; anything else is read in large
+// blocks, optionally by a background thread that stays ahead of parsing.
+// Input can also be handed over piece by piece as it arrives (openFed):
+// then a READ that runs out calls wait, which returns after more came.
+class InputReader {
+public:
+  InputReader();
+  ~InputReader();
+  bool openFile(const char* path, bool prefetch); // false if it cannot be opened
+  void openStream(int fd, bool prefetch);         // read from an open descriptor
+  void openBuffer(const char* data, long length); // read [data, data+length), not copied
+  void openFed();                                 // read what feed() hands over
+  void feed(const char* data, long length);       // more input for openFed(), copied
+  void finish();                                  // no more will be fed
+  function<void()> wait;    // called until feed() or finish() was
+  int next(float& value);   // INPUT_OK, INPUT_EOF, or INPUT_MALFORMED
+  long offset() const;      // bytes consumed so far
+  long skip(long bytes);    // drop bytes unread; returns how many there were
+  string badToken;          // text of the last malformed token
+private:
+  const char* cur = nullptr; // next unread byte
+  const char* end = nullptr; // one past the last buffered byte
+  const char* base = nullptr; // start of an input that is visible all at once
+  long consumed = 0;         // bytes dropped from the front of the buffer
+  void* mapped = nullptr;    // mmapped file, if any
+  long mappedLength = 0;
+  int fd = -1;
+  bool ownsFd = false;
+  bool atEof = false;        // no more bytes will arrive
+  bool fed = false;          // input comes from feed()
+  bool finished = false;     // finish() was called
+  vector<char> pending;      // fed and not yet in buffer
+  vector<char> buffer;       // window over a streamed input
+  shared_ptr<PrefetchQueue> queue; // set when a reader thread is running
+  bool refill();             // pull more bytes into buffer
+};
+
+// Locale-free number parser shared with other input paths.
+// Parses [+-]digits[.digits][(e|E)[+-]digits] from [s, e); returns the
+// number of bytes used, or 0 if [s, e) does not start with a number.
+int parseNumber(const char* s, const char* e, float& value);
+
+// Message for a failed READ of variable name; offset < 0 when unknown
+string inputErrorText(const string& name, int status, const string& badToken, long offset);
+
+#endif /* INPUT_H */
@@ -0,0 +1,1119 @@
+//*****************************************************************************
+// purpose: SSA intermediate representation of a TIPS program
+//          Lowering from the parse tree, scalar optimizations and printing
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#include "ir.h"
+#include "parser.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <map>
+
+// Optimization rounds before giving up on reaching a fixed point
+#define MAX_ROUNDS 10
+
+IRFunction::~IRFunction() {
+  for (int i = 0; i < all.size(); ++i)
+    delete all[i];
+  for (int i = 0; i < blocks.size(); ++i)
+    delete blocks[i];
+}
+
+IRProgram::~IRProgram() {
+  delete main;
+  for (int i = 0; i < functions.size(); ++i)
+    delete functions[i];
+}
+
+// ---------------------------------------------------------------------
+// Lowering. SSA form is built while the tree is walked, following Braun
+// et al., "Simple and Efficient Construction of Static Single Assignment
+// Form": each block remembers the value every variable last received in
+// it, and a read that misses asks the predecessors, placing a phi where
+// they may disagree. A block whose predecessors are not all known yet
+// (a loop header) is not sealed; its phis get their operands on sealing.
+class IRBuilder {
+public:
+  IRBuilder(IRProgram* p, map<SubprogramNode*, IRFunction*>& functions);
+  void lowerMain(IRFunction* f, ProgramNode* root);
+  void lowerSubprogram(IRFunction* f);
+private:
+  IRProgram* program;
+  map<SubprogramNode*, IRFunction*>& functionOf;
+  IRFunction* fn = nullptr;
+  IRBlock* current = nullptr;
+  bool inMain = true;                       // variables are the globals?
+  vector<const string*> names;              // variable number → name
+  map<IRBlock*, map<int, IRInst*> > defs;   // last value of each variable
+  map<IRBlock*, map<int, IRInst*> > incomplete; // phis of unsealed blocks
+  vector<pair<IRBlock*, IRBlock*> > loops;  // BREAK and CONTINUE targets
+  IRInst* zero = nullptr;                   // value of unreachable reads
+
+  IRBlock* newBlock();
+  IRInst* make(int op);
+  IRInst* emit(int op);
+  IRInst* emit(int op, IRInst* a);
+  IRInst* emit(int op, IRInst* a, IRInst* b);
+  IRInst* constant(float value);
+  void jump(IRBlock* to);
+  void branch(IRInst* cond, IRBlock* ifTrue, IRBlock* ifFalse);
+  void seal(IRBlock* b);
+  IRInst* newPhi(IRBlock* b, const string* name);
+  IRInst* undefined();
+  void writeVariable(int var, IRBlock* b, IRInst* value);
+  IRInst* readVariable(int var, IRBlock* b);
+  IRInst* readVariableRecursive(int var, IRBlock* b);
+  void addPhiOperands(int var, IRInst* phi);
+  IRInst* readName(const string& id, int slot, bool local);
+  void writeName(const string& id, int slot, bool local, IRInst* value);
+  void storeGlobals();
+  void loadGlobals();
+  IRInst* call(SubprogramNode* callee, const vector<unique_ptr<ExpressionNode> >& args);
+  IRInst* shortCircuit(bool isOr, IRInst* left, TermNode* term, FactorNode* factor);
+  IRInst* lower(ExpressionNode* node);
+  IRInst* lower(SimpleExpressionNode* node);
+  IRInst* lower(TermNode* node);
+  IRInst* lower(FactorNode* node);
+  void lower(StatementNode* node);
+  IRInst* element(ArrayT* array, const string* name, bool checked, IRInst* index);
+};
+
+IRBuilder::IRBuilder(IRProgram* p, map<SubprogramNode*, IRFunction*>& functions)
+  : program(p), functionOf(functions) {
+}
+
+IRBlock* IRBuilder::newBlock() {
+  IRBlock* b = new IRBlock();
+  b->id = fn->blocks.size();
+  fn->blocks.push_back(b);
+  return b;
+}
+IRInst* IRBuilder::make(int op) {
+  IRInst* in = new IRInst();
+  in->op = op;
+  in->id = fn->nextId++;
+  fn->all.push_back(in);
+  return in;
+}
+IRInst* IRBuilder::emit(int op) {
+  IRInst* in = make(op);
+  in->block = current;
+  current->insts.push_back(in);
+  return in;
+}
+IRInst* IRBuilder::emit(int op, IRInst* a) {
+  IRInst* in = emit(op);
+  in->args.push_back(a);
+  return in;
+}
+IRInst* IRBuilder::emit(int op, IRInst* a, IRInst* b) {
+  IRInst* in = emit(op, a);
+  in->args.push_back(b);
+  return in;
+}
+IRInst* IRBuilder::constant(float value) {
+  IRInst* in = emit(IR_CONST);
+  in->constant = value;
+  return in;
+}
+void IRBuilder::jump(IRBlock* to) {
+  IRInst* in = emit(IR_JUMP);
+  in->targets[0] = to;
+  to->preds.push_back(current);
+}
+void IRBuilder::branch(IRInst* cond, IRBlock* ifTrue, IRBlock* ifFalse) {
+  IRInst* in = emit(IR_BRANCH, cond);
+  in->targets[0] = ifTrue;
+  in->targets[1] = ifFalse;
+  ifTrue->preds.push_back(current);
+  ifFalse->preds.push_back(current);
+}
+
+// ---------------------------------------------------------------------
+void IRBuilder::seal(IRBlock* b) {
+  map<int, IRInst*>& phis = incomplete[b];
+  for (map<int, IRInst*>::iterator it = phis.begin(); it != phis.end(); ++it)
+    addPhiOperands(it->first, it->second);
+  phis.clear();
+  b->sealed = true;
+}
+IRInst* IRBuilder::newPhi(IRBlock* b, const string* name) {
+  IRInst* phi = make(IR_PHI);
+  phi->block = b;
+  phi->name = name;
+  int at = 0; // after the phis already there
+  while (at < b->insts.size() && b->insts[at]->op == IR_PHI)
+    ++at;
+  b->insts.insert(b->insts.begin() + at, phi);
+  return phi;
+}
+// Reads in code no path reaches; the block is deleted before running
+IRInst* IRBuilder::undefined() {
+  if (!zero) {
+    zero = make(IR_CONST);
+    zero->block = fn->blocks[0];
+    fn->blocks[0]->insts.insert(fn->blocks[0]->insts.begin(), zero);
+  }
+  return zero;
+}
+void IRBuilder::writeVariable(int var, IRBlock* b, IRInst* value) {
+  defs[b][var] = value;
+}
+IRInst* IRBuilder::readVariable(int var, IRBlock* b) {
+  map<int, IRInst*>& known = defs[b];
+  map<int, IRInst*>::iterator it = known.find(var);
+  if (it != known.end())
+    return it->second;
+  return readVariableRecursive(var, b);
+}
+IRInst* IRBuilder::readVariableRecursive(int var, IRBlock* b) {
+  IRInst* value;
+  if (!b->sealed) {
+    value = newPhi(b, names[var]);
+    incomplete[b][var] = value;
+  } else if (b->preds.empty()) {
+    value = undefined();
+  } else if (b->preds.size() == 1) {
+    value = readVariable(var, b->preds[0]);
+  } else {
+    value = newPhi(b, names[var]);
+    writeVariable(var, b, value); // breaks cycles through loops
+    addPhiOperands(var, value);
+  }
+  writeVariable(var, b, value);
+  return value;
+}
+void IRBuilder::addPhiOperands(int var, IRInst* phi) {
+  for (int i = 0; i < phi->block->preds.size(); ++i)
+    phi->args.push_back(readVariable(var, phi->block->preds[i]));
+}
+
+// A variable of the source. In the main program the globals are SSA
+// variables; in a subprogram only its locals are, and globals are read
+// from and written to State.
+IRInst* IRBuilder::readName(const string& id, int slot, bool local) {
+  if (inMain || local) {
+    if (!names[slot])
+      names[slot] = &id;
+    return readVariable(slot, current);
+  }
+  IRInst* in = emit(IR_LOADG);
+  in->slot = slot;
+  in->name = &id;
+  return in;
+}
+void IRBuilder::writeName(const string& id, int slot, bool local, IRInst* value) {
+  if (inMain || local) {
+    if (!names[slot])
+      names[slot] = &id;
+    writeVariable(slot, current, value);
+    return;
+  }
+  IRInst* in = emit(IR_STOREG, value);
+  in->slot = slot;
+  in->name = &id;
+}
+
+// The callee reads and writes globals in State, so the main program's
+// SSA values go there before a call and come back after it
+void IRBuilder::storeGlobals() {
+  if (!inMain)
+    return;
+  for (int slot = 0; slot < names.size(); ++slot) {
+    IRInst* in = emit(IR_STOREG, readVariable(slot, current));
+    in->slot = slot;
+    in->name = names[slot];
+  }
+}
+void IRBuilder::loadGlobals() {
+  if (!inMain)
+    return;
+  for (int slot = 0; slot < names.size(); ++slot) {
+    IRInst* in = emit(IR_LOADG);
+    in->slot = slot;
+    in->name = names[slot];
+    writeVariable(slot, current, in);
+  }
+}
+
+// The frame is claimed before the arguments are evaluated, as
+// SubprogramNode::call does, so limits and depth trip in the same order
+IRInst* IRBuilder::call(SubprogramNode* callee, const vector<unique_ptr<ExpressionNode> >& args) {
+  IRInst* enter = emit(IR_ENTER);
+  enter->callee = functionOf[callee];
+  vector<IRInst*> values;
+  for (int i = 0; i < args.size(); ++i)
+    values.push_back(lower(args[i].get()));
+  storeGlobals();
+  IRInst* in = emit(IR_CALL);
+  in->callee = functionOf[callee];
+  in->args = values;
+  loadGlobals();
+  return in;
+}
+
+// ---------------------------------------------------------------------
+// Expressions
+IRInst* IRBuilder::lower(ExpressionNode* node) {
+  IRInst* value = lower(node->firstSimpleExpr.get());
+  if (node->relop == 0)
+    return value;
+  IRInst* second = lower(node->secondSimpleExpr.get());
+  switch (node->relop) {
+    case TOK_EQUALTO:     return emit(IR_EQ, value, second);
+    case TOK_LESSTHAN:    return emit(IR_LT, value, second);
+    case TOK_GREATERTHAN: return emit(IR_GT, value, second);
+    default:              return emit(IR_NE, value, second);
+  }
+}
+
+// AND and OR only evaluate their right operand when the left one does
+// not decide the result, so they become control flow: the deciding edge
+// carries the constant result straight to the join.
+IRInst* IRBuilder::shortCircuit(bool isOr, IRInst* left, TermNode* term, FactorNode* factor) {
+  IRBlock* right = newBlock();
+  IRBlock* join = newBlock();
+  IRInst* decided = constant(isOr ? 1.0f : 0.0f);
+  if (isOr)
+    branch(left, join, right);
+  else
+    branch(left, right, join);
+  seal(right);
+  current = right;
+  IRInst* value = emit(IR_BOOL, term ? lower(term) : lower(factor));
+  jump(join);
+  seal(join);
+  current = join;
+  IRInst* phi = newPhi(join, nullptr);
+  phi->args.push_back(decided); // join->preds are the branch, then right
+  phi->args.push_back(value);
+  return phi;
+}
+
+IRInst* IRBuilder::lower(SimpleExpressionNode* node) {
+  IRInst* value = lower(node->firstTerm.get());
+  for (int i = 0; i < node->restTerms.size(); ++i) {
+    TermNode* term = node->restTerms[i].get();
+    switch (node->restSmplExprOps[i]) {
+      case TOK_PLUS:  value = emit(IR_ADD, value, lower(term)); break;
+      case TOK_MINUS: value = emit(IR_SUB, value, lower(term)); break;
+      default:        value = shortCircuit(true, value, term, nullptr); break;
+    }
+  }
+  return value;
+}
+
+IRInst* IRBuilder::lower(TermNode* node) {
+  IRInst* value = lower(node->firstFactor.get());
+  for (int i = 0; i < node->restFactors.size(); ++i) {
+    FactorNode* factor = node->restFactors[i].get();
+    switch (node->restTermOps[i]) {
+      case TOK_MULTIPLY: value = emit(IR_MUL, value, lower(factor)); break;
+      case TOK_DIVIDE:   value = emit(IR_DIV, value, lower(factor)); break;
+      case TOK_MOD:      value = emit(IR_MOD, value, lower(factor)); break;
+      default:           value = shortCircuit(false, value, nullptr, factor); break;
+    }
+  }
+  return value;
+}
+
+// Position of an element: an int offset, checked against the bounds
+// unless the parser proved it in range
+IRInst* IRBuilder::element(ArrayT* array, const string* name, bool checked, IRInst* index) {
+  IRInst* in = emit(IR_INDEX, index);
+  in->isInt = true;
+  in->array = array;
+  in->slot = array->number;
+  in->name = name;
+  in->checked = checked;
+  return in;
+}
+
+IRInst* IRBuilder::lower(FactorNode* node) {
+  if (IntLitNode* n = dynamic_cast<IntLitNode*>(node))
+    return constant(n->int_literal);
+  if (FloatLitNode* n = dynamic_cast<FloatLitNode*>(node))
+    return constant(n->float_literal);
+  if (IdentifierNode* n = dynamic_cast<IdentifierNode*>(node))
+    return readName(n->id, n->slot, n->local);
+  if (IndexedIdentifierNode* n = dynamic_cast<IndexedIdentifierNode*>(node)) {
+    IRInst* offset = element(n->array, &n->id, n->checked, lower(n->index.get()));
+    IRInst* in = emit(IR_LOADE, offset);
+    in->array = n->array;
+    in->slot = n->array->number;
+    in->name = &n->id;
+    return in;
+  }
+  if (NestedExpressionNode* n = dynamic_cast<NestedExpressionNode*>(node))
+    return lower(n->exprPtr.get());
+  if (NotNode* n = dynamic_cast<NotNode*>(node))
+    return emit(IR_NOT, lower(n->factor.get()));
+  if (MinusNode* n = dynamic_cast<MinusNode*>(node))
+    return emit(IR_NEG, lower(n->factor.get()));
+  FunctionCallNode* n = dynamic_cast<FunctionCallNode*>(node);
+  return call(n->callee, n->args);
+}
+
+// ---------------------------------------------------------------------
+// Statements
+void IRBuilder::lower(StatementNode* node) {
+  if (AssignmentNode* n = dynamic_cast<AssignmentNode*>(node)) {
+    IRInst* value = lower(n->expr.get());
+    if (inMain || n->local) {
+      value = emit(IR_COPY, value); // names the value in dumps
+      value->name = &n->id;
+    }
+    writeName(n->id, n->slot, n->local, value);
+  } else if (ArrayAssignmentNode* n = dynamic_cast<ArrayAssignmentNode*>(node)) {
+    // The index is checked before the value is evaluated
+    IRInst* offset = element(n->array, &n->id, n->checked, lower(n->index.get()));
+    IRInst* in = emit(IR_STOREE, offset, lower(n->expr.get()));
+    in->array = n->array;
+    in->slot = n->array->number;
+    in->name = &n->id;
+  } else if (CompoundNode* n = dynamic_cast<CompoundNode*>(node)) {
+    IRInst* count = emit(IR_COUNT);
+    count->constant = n->statements.size();
+    for (int i = 0; i < n->statements.size(); ++i)
+      lower(n->statements[i].get());
+  } else if (IfNode* n = dynamic_cast<IfNode*>(node)) {
+    IRInst* cond = lower(n->expr.get());
+    IRBlock* thenBlock = newBlock();
+    IRBlock* elseBlock = n->elseStatement ? newBlock() : nullptr;
+    IRBlock* join = newBlock();
+    branch(cond, thenBlock, elseBlock ? elseBlock : join);
+    seal(thenBlock);
+    current = thenBlock;
+    lower(n->thenStatement.get());
+    jump(join);
+    if (elseBlock) {
+      seal(elseBlock);
+      current = elseBlock;
+      lower(n->elseStatement.get());
+      jump(join);
+    }
+    seal(join);
+    current = join;
+  } else if (WhileNode* n = dynamic_cast<WhileNode*>(node)) {
+    IRBlock* header = newBlock();
+    jump(header);
+    current = header;
+    IRInst* cond = lower(n->expr.get());
+    IRBlock* body = newBlock();
+    IRBlock* exit = newBlock();
+    IRBlock* latch = newBlock();
+    branch(cond, body, exit);
+    seal(body);
+    current = body;
+    loops.push_back(make_pair(exit, latch));
+    lower(n->statement.get());
+    loops.pop_back();
+    jump(latch);
+    seal(latch);
+    current = latch;
+    IRInst* check = emit(IR_CHECK);
+    check->what = "WHILE loop";
+    check->line = n->line;
+    jump(header);
+    seal(header);
+    seal(exit);
+    current = exit;
+  } else if (ForNode* n = dynamic_cast<ForNode*>(node)) {
+    // Both bounds are evaluated once; the loop runs on an int counter
+    IRInst* first = emit(IR_FTOI, lower(n->startExpr.get()));
+    first->isInt = true;
+    IRInst* last = emit(IR_FTOI, lower(n->endExpr.get()));
+    last->isInt = true;
+    IRInst* skip = emit(n->downto ? IR_ILT : IR_IGT, first, last);
+    IRBlock* header = newBlock();
+    IRBlock* exit = newBlock();
+    IRBlock* latch = newBlock();
+    IRBlock* step = newBlock();
+    branch(skip, exit, header);
+    IRInst* counter = newPhi(header, &n->id);
+    counter->isInt = true;
+    counter->args.push_back(first);
+    current = header;
+    IRInst* value = emit(IR_ITOF, counter);
+    writeName(n->id, n->slot, n->local, value);
+    loops.push_back(make_pair(exit, latch));
+    lower(n->statement.get());
+    loops.pop_back();
+    jump(latch);
+    seal(latch);
+    current = latch;
+    branch(emit(IR_IEQ, counter, last), exit, step); // test before the step so INT_MAX cannot overflow
+    seal(step);
+    current = step;
+    IRInst* check = emit(IR_CHECK);
+    check->what = "FOR loop";
+    check->line = n->line;
+    IRInst* next = emit(n->downto ? IR_IDEC : IR_IINC, counter);
+    next->isInt = true;
+    jump(header);
+    counter->args.push_back(next); // header->preds are the entry branch, then step
+    seal(header);
+    seal(exit);
+    current = exit;
+  } else if (CallNode* n = dynamic_cast<CallNode*>(node)) {
+    call(n->callee, n->args);
+  } else if (ReadNode* n = dynamic_cast<ReadNode*>(node)) {
+    IRInst* in = emit(IR_READ);
+    in->name = &n->id;
+    writeName(n->id, n->slot, n->local, in);
+  } else if (WriteNode* n = dynamic_cast<WriteNode*>(node)) {
+    vector<IRInst*> values;
+    for (int i = 0; i < n->fields.size(); ++i)
+      values.push_back(readName(n->fields[i].id, n->fields[i].slot, n->fields[i].local));
+    IRInst* in = emit(values.empty() ? IR_WRITESTR : IR_WRITE);
+    in->args = values;
+    in->write = n;
+  } else {
+    // BREAK or CONTINUE; what follows in the compound is unreachable
+    bool isBreak = dynamic_cast<BreakNode*>(node) != nullptr;
+    jump(isBreak ? loops.back().first : loops.back().second);
+    current = newBlock();
+    current->sealed = true;
+  }
+}
+
+// ---------------------------------------------------------------------
+void IRBuilder::lowerMain(IRFunction* f, ProgramNode* root) {
+  fn = f;
+  inMain = true;
+  symbolTableT& symbols = root->tables->symbols;
+  names.assign(symbols.size(), nullptr);
+  for (symbolTableT::iterator it = symbols.begin(); it != symbols.end(); ++it)
+    names[it->second] = &it->first;
+  current = newBlock();
+  current->sealed = true;
+  loadGlobals(); // State holds every global's starting value
+  lower(root->block->compound.get());
+  storeGlobals(); // leave the final values where -s looks
+  emit(IR_RET);
+}
+
+void IRBuilder::lowerSubprogram(IRFunction* f) {
+  fn = f;
+  inMain = false;
+  SubprogramNode* sub = f->node;
+  names.assign(sub->frameSize, nullptr);
+  current = newBlock();
+  current->sealed = true;
+  for (int i = 0; i < sub->frameSize; ++i) {
+    IRInst* value;
+    if (i < sub->paramCount) {
+      value = emit(IR_PARAM);
+      value->slot = i;
+    } else {
+      value = constant(0.0f); // locals and the result start at zero
+    }
+    writeVariable(i, current, value);
+  }
+  lower(sub->body.get());
+  if (sub->resultSlot >= 0)
+    emit(IR_RET, readVariable(sub->resultSlot, current));
+  else
+    emit(IR_RET);
+}
+
+IRProgram* lowerProgram(ProgramNode* root) {
+  IRProgram* program = new IRProgram();
+  map<SubprogramNode*, IRFunction*> functionOf;
+  BlockNode* block = root->block.get();
+  // Every subprogram exists before any body is lowered, so recursive and
+  // forward calls can name their callee
+  for (int i = 0; i < block->subprograms.size(); ++i) {
+    IRFunction* f = new IRFunction();
+    f->node = block->subprograms[i].get();
+    f->name = f->node->label;
+    program->functions.push_back(f);
+    functionOf[f->node] = f;
+  }
+  for (int i = 0; i < program->functions.size(); ++i) {
+    IRBuilder builder(program, functionOf);
+    builder.lowerSubprogram(program->functions[i]);
+  }
+  program->main = new IRFunction();
+  program->main->name = "PROGRAM " + root->id;
+  IRBuilder builder(program, functionOf);
+  builder.lowerMain(program->main, root);
+  return program;
+}
+
+// ---------------------------------------------------------------------
+// Optimization. Values that are replaced are recorded first and every
+// operand is redirected afterwards, so no pass needs use lists.
+class IROptimizer {
+public:
+  IROptimizer(IRFunction* f, IRStats& s) : fn(f), stats(s) {}
+  void removeUnreachable();
+  bool copies();
+  bool fold();
+  bool number();
+  bool dead();
+private:
+  IRFunction* fn;
+  IRStats& stats;
+  map<IRInst*, IRInst*> replaced;
+  IRInst* resolve(IRInst* in);
+  void replace(IRInst* in, IRInst* by);
+  void applyReplacements();
+  void removeEdge(IRBlock* from, IRBlock* to);
+  vector<IRBlock*> reversePostorder();
+  void dominators(vector<IRBlock*>& order);
+  bool evaluate(IRInst* in);
+};
+
+IRInst* IROptimizer::resolve(IRInst* in) {
+  map<IRInst*, IRInst*>::iterator it = replaced.find(in);
+  while (it != replaced.end()) {
+    in = it->second;
+    it = replaced.find(in);
+  }
+  return in;
+}
+void IROptimizer::replace(IRInst* in, IRInst* by) {
+  replaced[in] = by;
+}
+void IROptimizer::applyReplacements() {
+  if (replaced.empty())
+    return;
+  for (int b = 0; b < fn->blocks.size(); ++b) {
+    vector<IRInst*>& insts = fn->blocks[b]->insts;
+    int kept = 0;
+    for (int i = 0; i < insts.size(); ++i) {
+      IRInst* in = insts[i];
+      if (replaced.count(in))
+        continue;
+      for (int a = 0; a < in->args.size(); ++a)
+        in->args[a] = resolve(in->args[a]);
+      insts[kept++] = in;
+    }
+    insts.resize(kept);
+  }
+  replaced.clear();
+}
+
+// Copies and phis whose operands all agree (apart from the phi itself)
+// are the value they copy
+bool IROptimizer::copies() {
+  int before = stats.copies;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int b = 0; b < fn->blocks.size(); ++b) {
+      vector<IRInst*>& insts = fn->blocks[b]->insts;
+      for (int i = 0; i < insts.size(); ++i) {
+        IRInst* in = insts[i];
+        if (replaced.count(in))
+          continue;
+        if (in->op == IR_COPY) {
+          replace(in, resolve(in->args[0]));
+          ++stats.copies;
+          changed = true;
+        } else if (in->op == IR_PHI) {
+          IRInst* same = nullptr;
+          bool trivial = true;
+          for (int a = 0; a < in->args.size() && trivial; ++a) {
+            IRInst* arg = resolve(in->args[a]);
+            if (arg == in || arg == same)
+              continue;
+            if (same)
+              trivial = false;
+            same = arg;
+          }
+          if (trivial && same) { // a phi with no other operand is unreachable
+            replace(in, same);
+            ++stats.copies;
+            changed = true;
+          }
+        }
+      }
+    }
+  }
+  applyReplacements();
+  return stats.copies != before;
+}
+
+// Compute in as the run would, if its operands are constants. Cases the
+// run would trap on (MOD by zero, an out-of-range conversion) are left
+// for the run.
+bool IROptimizer::evaluate(IRInst* in) {
+  for (int a = 0; a < in->args.size(); ++a)
+    if (in->args[a]->op != IR_CONST)
+      return false;
+  float x = 0, y = 0;
+  int i = 0, j = 0;
+  if (in->args.size() > 0) { x = in->args[0]->constant; i = in->args[0]->integer; }
+  if (in->args.size() > 1) { y = in->args[1]->constant; j = in->args[1]->integer; }
+  float result = 0.0f;
+  int integer = 0;
+  switch (in->op) {
+    case IR_ADD: result = x + y; break;
+    case IR_SUB: result = x - y; break;
+    case IR_MUL: result = x * y; break;
+    case IR_DIV: result = x / y; break;
+    case IR_MOD: {
+      if (!(x > INT_MIN && x < INT_MAX && y > INT_MIN && y < INT_MAX))
+        return false;
+      int a = static_cast<int>(x), b = static_cast<int>(y);
+      if (b == 0 || b == -1)
+        return false;
+      result = a % b;
+      break;
+    }
+    case IR_EQ: result = truth(x - y) ? 0.0f : 1.0f; break;
+    case IR_NE: result = truth(x - y) ? 1.0f : 0.0f; break;
+    case IR_LT: result = x < y ? 1.0f : 0.0f; break;
+    case IR_GT: result = x > y ? 1.0f : 0.0f; break;
+    case IR_NOT: result = truth(x) ? 0.0f : 1.0f; break;
+    case IR_NEG: result = -x; break;
+    case IR_BOOL: result = truth(x) ? 1.0f : 0.0f; break;
+    case IR_FTOI:
+      if (!(x > INT_MIN && x < INT_MAX))
+        return false;
+      integer = static_cast<int>(x);
+      break;
+    case IR_ITOF: result = static_cast<float>(i); break;
+    case IR_IINC: if (i == INT_MAX) return false; integer = i + 1; break;
+    case IR_IDEC: if (i == INT_MIN) return false; integer = i - 1; break;
+    case IR_IEQ: result = i == j ? 1.0f : 0.0f; break;
+    case IR_ILT: result = i < j ? 1.0f : 0.0f; break;
+    case IR_IGT: result = i > j ? 1.0f : 0.0f; break;
+    default: return false;
+  }
+  in->op = IR_CONST;
+  in->args.clear();
+  in->constant = result;
+  in->integer = integer;
+  return true;
+}
+
+// Drop the edge from → to, with the phi operands it carried
+void IROptimizer::removeEdge(IRBlock* from, IRBlock* to) {
+  vector<IRBlock*>& preds = to->preds;
+  int at = find(preds.begin(), preds.end(), from) - preds.begin();
+  if (at == preds.size())
+    return;
+  preds.erase(preds.begin() + at);
+  for (int i = 0; i < to->insts.size() && to->insts[i]->op == IR_PHI; ++i)
+    to->insts[i]->args.erase(to->insts[i]->args.begin() + at);
+}
+
+void IROptimizer::removeUnreachable() {
+  vector<bool> reached(fn->blocks.size(), false);
+  vector<IRBlock*> work(1, fn->blocks[0]);
+  reached[0] = true;
+  while (!work.empty()) {
+    IRInst* t = work.back()->terminator();
+    work.pop_back();
+    for (int k = 0; k < 2; ++k) {
+      IRBlock* s = t ? t->targets[k] : nullptr;
+      if (s && !reached[s->id]) {
+        reached[s->id] = true;
+        work.push_back(s);
+      }
+    }
+  }
+  // Detach every dead block before deleting any, since dead blocks may
+  // branch to each other
+  vector<IRBlock*> kept;
+  for (int b = 0; b < fn->blocks.size(); ++b) {
+    IRBlock* block = fn->blocks[b];
+    IRInst* t = block->terminator();
+    for (int k = 0; !reached[b] && t && k < 2; ++k)
+      if (t->targets[k] && reached[t->targets[k]->id])
+        removeEdge(block, t->targets[k]);
+  }
+  for (int b = 0; b < fn->blocks.size(); ++b) {
+    if (reached[b])
+      kept.push_back(fn->blocks[b]);
+    else
+      delete fn->blocks[b];
+  }
+  fn->blocks = kept;
+  for (int b = 0; b < fn->blocks.size(); ++b)
+    fn->blocks[b]->id = b;
+}
+
+// Constant propagation: fold every operation whose operands are now
+// constants, and turn branches on constants into jumps
+bool IROptimizer::fold() {
+  bool changed = false;
+  for (int b = 0; b < fn->blocks.size(); ++b) {
+    IRBlock* block = fn->blocks[b];
+    for (int i = 0; i < block->insts.size(); ++i) {
+      IRInst* in = block->insts[i];
+      if (in->op != IR_CONST && in->op != IR_PHI && evaluate(in)) {
+        ++stats.folded;
+        changed = true;
+      }
+    }
+    IRInst* t = block->terminator();
+    if (t && t->op == IR_BRANCH && t->args[0]->op == IR_CONST) {
+      IRBlock* taken = truth(t->args[0]->constant) ? t->targets[0] : t->targets[1];
+      IRBlock* dropped = taken == t->targets[0] ? t->targets[1] : t->targets[0];
+      removeEdge(block, dropped);
+      t->op = IR_JUMP;
+      t->args.clear();
+      t->targets[0] = taken;
+      t->targets[1] = nullptr;
+      ++stats.branches;
+      changed = true;
+    }
+  }
+  if (changed)
+    removeUnreachable();
+  return changed;
+}
+
+// ---------------------------------------------------------------------
+vector<IRBlock*> IROptimizer::reversePostorder() {
+  vector<IRBlock*> order;
+  vector<char> seen(fn->blocks.size(), 0);
+  // Iterative depth-first search; next[k] is the successor to try next
+  vector<pair<IRBlock*, int> > stack(1, make_pair(fn->blocks[0], 0));
+  seen[0] = 1;
+  while (!stack.empty()) {
+    IRBlock* b = stack.back().first;
+    int k = stack.back().second++;
+    IRInst* t = b->terminator();
+    if (k < 2) {
+      IRBlock* s = t ? t->targets[k] : nullptr;
+      if (s && !seen[s->id]) {
+        seen[s->id] = 1;
+        stack.push_back(make_pair(s, 0));
+      }
+      continue;
+    }
+    order.push_back(b);
+    stack.pop_back();
+  }
+  reverse(order.begin(), order.end());
+  return order;
+}
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm"
+void IROptimizer::dominators(vector<IRBlock*>& order) {
+  vector<int> position(fn->blocks.size(), -1);
+  for (int i = 0; i < order.size(); ++i) {
+    position[order[i]->id] = i;
+    order[i]->idom = nullptr;
+  }
+  IRBlock* entry = order[0];
+  entry->idom = entry;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int i = 1; i < order.size(); ++i) {
+      IRBlock* b = order[i];
+      IRBlock* idom = nullptr;
+      for (int p = 0; p < b->preds.size(); ++p) {
+        IRBlock* pred = b->preds[p];
+        if (!pred->idom)
+          continue;
+        if (!idom) {
+          idom = pred;
+          continue;
+        }
+        IRBlock* x = pred;
+        IRBlock* y = idom;
+        while (x != y) {
+          while (position[x->id] > position[y->id]) x = x->idom;
+          while (position[y->id] > position[x->id]) y = y->idom;
+        }
+        idom = x;
+      }
+      if (idom != b->idom) {
+        b->idom = idom;
+        changed = true;
+      }
+    }
+  }
+}
+
+// Operations whose result depends only on their operands, and which can
+// therefore share one instruction when they match. A checked INDEX may
+// trap, but only on operands a dominating copy already checked.
+static bool numberable(IRInst* in) {
+  switch (in->op) {
+    case IR_CONST: case IR_PARAM: case IR_PHI:
+    case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD:
+    case IR_EQ: case IR_NE: case IR_LT: case IR_GT:
+    case IR_NOT: case IR_NEG: case IR_BOOL:
+    case IR_FTOI: case IR_ITOF: case IR_IINC: case IR_IDEC:
+    case IR_IEQ: case IR_ILT: case IR_IGT: case IR_INDEX:
+      return true;
+    default:
+      return false;
+  }
+}
+static bool commutative(int op) {
+  return op == IR_ADD || op == IR_MUL || op == IR_EQ || op == IR_NE || op == IR_IEQ;
+}
+
+// Global value numbering: walk the dominator tree keeping the operations
+// seen on the way down; a match in a dominating block is reused. This
+// finds HEIGHT * HEIGHT computed twice, in one statement or in two.
+bool IROptimizer::number() {
+  vector<IRBlock*> order = reversePostorder();
+  dominators(order);
+  vector<vector<IRBlock*> > children(fn->blocks.size());
+  for (int i = 1; i < order.size(); ++i)
+    children[order[i]->idom->id].push_back(order[i]);
+
+  typedef vector<long long> Key;
+  map<Key, IRInst*> table;
+  vector<Key> scope;                   // keys added, innermost block last
+  vector<pair<IRBlock*, int> > stack(1, make_pair(order[0], -1));
+  vector<int> marks;                   // scope size when each block began
+  int before = stats.numbered;
+  while (!stack.empty()) {
+    IRBlock* b = stack.back().first;
+    int next = stack.back().second;
+    if (next == -1) {
+      marks.push_back(scope.size());
+      for (int i = 0; i < b->insts.size(); ++i) {
+        IRInst* in = b->insts[i];
+        if (!numberable(in))
+          continue;
+        Key key;
+        key.push_back(in->op);
+        key.push_back(in->isInt);
+        key.push_back(in->slot);
+        key.push_back(in->checked);
+        key.push_back(reinterpret_cast<long long>(in->array));
+        key.push_back(in->integer);
+        int bits;
+        memcpy(&bits, &in->constant, sizeof bits);
+        key.push_back(bits);
+        if (in->op == IR_PHI)
+          key.push_back(b->id); // phis only match in the same block
+        vector<long long> args;
+        for (int a = 0; a < in->args.size(); ++a)
+          args.push_back(resolve(in->args[a])->id);
+        if (commutative(in->op))
+          sort(args.begin(), args.end());
+        key.insert(key.end(), args.begin(), args.end());
+        map<Key, IRInst*>::iterator found = table.find(key);
+        if (found != table.end()) {
+          replace(in, found->second);
+          ++stats.numbered;
+        } else {
+          table[key] = in;
+          scope.push_back(key);
+        }
+      }
+      stack.back().second = 0;
+      continue;
+    }
+    if (next < children[b->id].size()) {
+      stack.back().second = next + 1;
+      stack.push_back(make_pair(children[b->id][next], -1));
+      continue;
+    }
+    // Leaving b: forget what only b and its dominated blocks computed
+    while (scope.size() > marks.back()) {
+      table.erase(scope.back());
+      scope.pop_back();
+    }
+    marks.pop_back();
+    stack.pop_back();
+  }
+  applyReplacements();
+  return stats.numbered != before;
+}
+
+// ---------------------------------------------------------------------
+// Keep what has an effect and what it uses; delete the rest
+static bool hasEffect(IRInst* in) {
+  switch (in->op) {
+    case IR_STOREG: case IR_STOREE: case IR_ENTER: case IR_CALL:
+    case IR_READ: case IR_WRITE: case IR_WRITESTR: case IR_COUNT:
+    case IR_CHECK: case IR_JUMP: case IR_BRANCH: case IR_RET:
+      return true;
+    case IR_INDEX:
+      return in->checked; // may stop the run
+    default:
+      return false;
+  }
+}
+
+bool IROptimizer::dead() {
+  map<IRInst*, bool> live;
+  vector<IRInst*> work;
+  for (int b = 0; b < fn->blocks.size(); ++b)
+    for (int i = 0; i < fn->blocks[b]->insts.size(); ++i) {
+      IRInst* in = fn->blocks[b]->insts[i];
+      if (hasEffect(in)) {
+        live[in] = true;
+        work.push_back(in);
+      }
+    }
+  while (!work.empty()) {
+    IRInst* in = work.back();
+    work.pop_back();
+    for (int a = 0; a < in->args.size(); ++a)
+      if (!live[in->args[a]]) {
+        live[in->args[a]] = true;
+        work.push_back(in->args[a]);
+      }
+  }
+  int before = stats.dead;
+  for (int b = 0; b < fn->blocks.size(); ++b) {
+    vector<IRInst*>& insts = fn->blocks[b]->insts;
+    int kept = 0;
+    for (int i = 0; i < insts.size(); ++i) {
+      if (live[insts[i]])
+        insts[kept++] = insts[i];
+      else
+        ++stats.dead;
+    }
+    insts.resize(kept);
+  }
+  return stats.dead != before;
+}
+
+void optimize(IRProgram* program) {
+  vector<IRFunction*> functions = program->functions;
+  functions.push_back(program->main);
+  for (int f = 0; f < functions.size(); ++f) {
+    IRFunction* fn = functions[f];
+    IROptimizer pass(fn, program->stats);
+    pass.removeUnreachable(); // code after BREAK and CONTINUE
+    for (int round = 0; round < MAX_ROUNDS; ++round) {
+      bool changed = pass.copies();
+      changed = pass.fold() || changed;
+      changed = pass.number() || changed;
+      changed = pass.dead() || changed;
+      if (!changed)
+        break;
+    }
+    // Number what is left in block order, for readable dumps
+    fn->nextId = 0;
+    for (int b = 0; b < fn->blocks.size(); ++b)
+      for (int i = 0; i < fn->blocks[b]->insts.size(); ++i)
+        fn->blocks[b]->insts[i]->id = fn->nextId++;
+  }
+}
+
+// ---------------------------------------------------------------------
+// Printing
+static const char* opNames[] = {
+  "const", "param", "phi", "copy", "add", "sub", "mul", "div", "mod",
+  "eq", "ne", "lt", "gt", "not", "neg", "bool", "ftoi", "itof", "iinc",
+  "idec", "ieq", "ilt", "igt", "index", "loadg", "loade", "storeg",
+  "storee", "enter", "call", "read", "write", "writestr", "count",
+  "check", "jump", "branch", "ret"
+};
+
+static void printValue(ostream& os, IRInst* in) {
+  os << "%" << in->id;
+}
+
+static void printInst(ostream& os, IRInst* in) {
+  os << "    ";
+  bool hasValue = in->op != IR_STOREG && in->op != IR_STOREE && in->op != IR_ENTER
+               && in->op != IR_WRITE && in->op != IR_WRITESTR && in->op != IR_COUNT
+               && in->op != IR_CHECK && in->op != IR_JUMP && in->op != IR_BRANCH
+               && in->op != IR_RET;
+  if (hasValue) {
+    printValue(os, in);
+    os << (in->isInt ? ":i" : "") << " = ";
+  }
+  os << opNames[in->op];
+  switch (in->op) {
+    case IR_CONST:
+      if (in->isInt) os << " " << in->integer;
+      else os << " " << in->constant;
+      break;
+    case IR_PARAM: os << " " << in->slot; break;
+    case IR_PHI:
+      for (int a = 0; a < in->args.size(); ++a) {
+        os << (a ? ", [" : " [");
+        printValue(os, in->args[a]);
+        os << ", b" << in->block->preds[a]->id << "]";
+      }
+      break;
+    case IR_LOADG: case IR_READ: os << " " << *in->name; break;
+    case IR_STOREG: os << " " << *in->name << ", "; printValue(os, in->args[0]); break;
+    case IR_INDEX:
+      os << " " << *in->name << ", ";
+      printValue(os, in->args[0]);
+      if (!in->checked) os << " unchecked";
+      break;
+    case IR_LOADE: os << " " << *in->name << ", "; printValue(os, in->args[0]); break;
+    case IR_STOREE:
+      os << " " << *in->name << ", ";
+      printValue(os, in->args[0]);
+      os << ", ";
+      printValue(os, in->args[1]);
+      break;
+    case IR_ENTER: os << " " << in->callee->name; break;
+    case IR_CALL:
+      os << " " << in->callee->name << "(";
+      for (int a = 0; a < in->args.size(); ++a) {
+        if (a) os << ", ";
+        printValue(os, in->args[a]);
+      }
+      os << ")";
+      break;
+    case IR_WRITE: case IR_WRITESTR:
+      // The arguments as written, with each variable's value
+      for (int a = 0, v = 0; a < in->write->arguments.size(); ++a) {
+        os << (a ? ", " : " ");
+        if (in->write->arguments[a][0] == '\'')
+          os << in->write->arguments[a];
+        else
+          printValue(os, in->args[v++]);
+      }
+      break;
+    case IR_COUNT: os << " " << in->constant; break;
+    case IR_CHECK: os << " " << in->what << ", line " << in->line; break;
+    case IR_JUMP: os << " b" << in->targets[0]->id; break;
+    case IR_BRANCH:
+      os << " ";
+      printValue(os, in->args[0]);
+      os << ", b" << in->targets[0]->id << ", b" << in->targets[1]->id;
+      break;
+    default:
+      for (int a = 0; a < in->args.size(); ++a) {
+        os << (a ? ", " : " ");
+        printValue(os, in->args[a]);
+      }
+      break;
+  }
+  if ((in->op == IR_PHI || in->op == IR_COPY) && in->name)
+    os << "   ; " << *in->name;
+  os << endl;
+}
+
+static void printFunction(ostream& os, IRFunction* fn) {
+  os << fn->name << endl;
+  for (int b = 0; b < fn->blocks.size(); ++b) {
+    IRBlock* block = fn->blocks[b];
+    os << "  b" << block->id << ":";
+    if (!block->preds.empty()) {
+      os << "   ; preds";
+      for (int p = 0; p < block->preds.size(); ++p)
+        os << (p ? ", b" : " b") << block->preds[p]->id;
+    }
+    os << endl;
+    for (int i = 0; i < block->insts.size(); ++i)
+      printInst(os, block->insts[i]);
+  }
+  os << endl;
+}
+
+void printIR(ostream& os, IRProgram* program) {
+  for (int f = 0; f < program->functions.size(); ++f)
+    printFunction(os, program->functions[f]);
+  printFunction(os, program->main);
+  IRStats& s = program->stats;
+  os << "; folded " << s.folded << ", branches " << s.branches << ", copies " << s.copies
+     << ", numbered " << s.numbered << ", dead " << s.dead << endl;
+}
@@ -0,0 +1,132 @@
+//*****************************************************************************
+// purpose: SSA intermediate representation of a TIPS program
+//          Control-flow graph of basic blocks, lowered from the parse tree
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#ifndef IR_H
+#define IR_H
+
+#include "nodes.h"
+
+// ---------------------------------------------------------------------
+// Operations. Every value is a float unless its instruction is marked
+// isInt (only the native counters of FOR loops are). Pure operations can
+// be folded, numbered and deleted; the rest stay where they are.
+#define IR_CONST     0  // constant
+#define IR_PARAM     1  // value parameter slot of the running call
+#define IR_PHI       2  // args[i] arrives from block->preds[i]
+#define IR_COPY      3  // args[0], as assigned to a variable
+#define IR_ADD       4
+#define IR_SUB       5
+#define IR_MUL       6
+#define IR_DIV       7
+#define IR_MOD       8  // int(args[0]) % int(args[1])
+#define IR_EQ        9  // 1 when args[0] - args[1] is false, else 0
+#define IR_NE       10
+#define IR_LT       11
+#define IR_GT       12
+#define IR_NOT      13
+#define IR_NEG      14
+#define IR_BOOL     15  // 1 when args[0] is true, else 0
+#define IR_FTOI     16  // int counter from a float
+#define IR_ITOF     17  // float from an int counter
+#define IR_IINC     18  // int counter + 1
+#define IR_IDEC     19  // int counter - 1
+#define IR_IEQ      20  // 1 when two int counters are equal, else 0
+#define IR_ILT      21
+#define IR_IGT      22
+#define IR_INDEX    23  // int offset of element args[0] (stops the run if checked and outside)
+#define IR_LOADG    24  // global variable slot (reads memory)
+#define IR_LOADE    25  // element at offset args[0] of array
+#define IR_STOREG   26  // global slot := args[0]
+#define IR_STOREE   27  // array [offset args[0]] := args[1]
+#define IR_ENTER    28  // claim callee's frame: depth and limit checks
+#define IR_CALL     29  // run callee(args...) in the claimed frame; the function's result
+#define IR_READ     30  // next input value for variable name
+#define IR_WRITE    31  // print args, one per field of write
+#define IR_WRITESTR 32  // print write, which has only literals
+#define IR_COUNT    33  // add constant statements to the step count
+#define IR_CHECK    34  // loop back-edge: compare the limits
+#define IR_JUMP     35  // to targets[0]
+#define IR_BRANCH   36  // to targets[0] when args[0] is true, else targets[1]
+#define IR_RET      37  // leave the call, with args[0] if a function
+
+struct IRBlock;
+struct IRFunction;
+
+struct IRInst {
+  int op = IR_CONST;
+  int id = -1;                  // %id in dumps; numbering order
+  bool isInt = false;           // result is an int counter
+  vector<IRInst*> args;         // operands
+  float constant = 0.0f;        // IR_CONST value, IR_COUNT statements
+  int integer = 0;              // IR_CONST value when isInt
+  int slot = 0;                 // global slot, array number or parameter
+  int line = 0;                 // source line of an IR_CHECK
+  const char* what = nullptr;   // loop kind of an IR_CHECK
+  const string* name = nullptr; // variable, array or string literal
+  ArrayT* array = nullptr;      // array of an element access
+  WriteNode* write = nullptr;   // plan of an IR_WRITE or IR_WRITESTR
+  bool checked = true;          // does an element access check bounds?
+  IRFunction* callee = nullptr; // IR_CALL target
+  IRBlock* block = nullptr;     // block holding the instruction
+  IRBlock* targets[2] = {nullptr, nullptr}; // successors of a terminator
+  int reg = -1;                 // register a backend assigned
+};
+
+// Straight-line code ending in one IR_JUMP, IR_BRANCH or IR_RET.
+// Phis come first.
+struct IRBlock {
+  int id = 0;
+  vector<IRInst*> insts;
+  vector<IRBlock*> preds;       // in the order of phi operands
+  IRBlock* idom = nullptr;      // immediate dominator
+  bool sealed = false;          // all predecessors known (while lowering)
+  IRInst* terminator() { return insts.empty() ? nullptr : insts.back(); }
+};
+
+// The main program or one subprogram
+struct IRFunction {
+  string name;
+  SubprogramNode* node = nullptr; // null for the main program
+  vector<IRBlock*> blocks;        // blocks[0] is the entry
+  vector<IRInst*> all;            // every instruction ever made, owned
+  int nextId = 0;
+  int registers = 0;              // registers a backend assigned
+  ~IRFunction();
+};
+
+// Counts of what the optimizer did, for --dump-ir
+struct IRStats {
+  int folded = 0;     // instructions replaced by constants
+  int branches = 0;   // conditional branches on constants
+  int copies = 0;     // copies and trivial phis bypassed
+  int numbered = 0;   // common subexpressions reused
+  int dead = 0;       // unused instructions deleted
+};
+
+class IRProgram {
+public:
+  IRFunction* main = nullptr;
+  vector<IRFunction*> functions;  // subprograms, in declaration order
+  IRStats stats;
+  ~IRProgram();
+};
+
+// Lower the parsed program to SSA form. Global variables of the main
+// program and the locals of each subprogram become SSA values; a call
+// writes the main program's globals back to State before it runs and
+// reads them again afterwards, and subprograms access globals in State.
+IRProgram* lowerProgram(ProgramNode* root);
+
+// Constant propagation and folding, copy propagation, global value
+// numbering (common subexpressions across blocks) and dead code removal,
+// repeated until nothing changes
+void optimize(IRProgram* program);
+
+// Print every function in readable form
+void printIR(ostream& os, IRProgram* program);
+
+#endif /* IR_H */
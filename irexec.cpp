@@ -0,0 +1,330 @@
+//*****************************************************************************
+// purpose: Register-machine execution of the SSA IR
+//          One backend consuming the optimized IR of ir.h
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#include "irexec.h"
+#include "parser.h"
+#include "input.h"
+#include "format.h"
+#include <map>
+#include <mutex>
+
+// A register holds a float, or an int for a FOR counter or an offset
+union IRValue {
+  float f;
+  int i;
+};
+
+// ---------------------------------------------------------------------
+// The IR flattened into code with register numbers and jump targets.
+// Constants are loaded once per call and phis are gone: each edge into
+// a block with phis carries the copies that set them.
+struct XFunction;
+
+struct XMoves {
+  vector<int> from, to;      // register pairs, copied all at once
+  int temp = -1;             // first scratch register when they overlap
+};
+
+struct XInst {
+  int op = IR_CONST;
+  int dst = -1;              // result register
+  int a = -1, b = -1;        // operand registers
+  int count = 0;             // statements of an IR_COUNT
+  int slot = 0;              // global slot or array number
+  int line = 0;
+  const char* what = nullptr;
+  const string* name = nullptr;
+  ArrayT* array = nullptr;
+  bool checked = true;
+  WriteNode* write = nullptr;
+  XFunction* callee = nullptr;
+  vector<int> args;          // argument registers of an IR_CALL or IR_WRITE
+  int next[2] = {-1, -1};    // code position of each target
+  int moves[2] = {-1, -1};   // copies made on the way to each target
+};
+
+struct XFunction {
+  SubprogramNode* node = nullptr;            // null for the main program
+  vector<XInst> code;
+  vector<XMoves> moves;
+  vector<pair<int, IRValue> > constants;     // loaded on entry
+  vector<int> paramRegs;                     // where each argument goes, -1 if unused
+  int registers = 0;
+};
+
+// ---------------------------------------------------------------------
+static void translate(IRFunction* fn, XFunction& x, map<IRFunction*, XFunction*>& xOf) {
+  x.node = fn->node;
+  if (fn->node)
+    x.paramRegs.assign(fn->node->paramCount, -1);
+  // A register for every value
+  int registers = 0;
+  for (int b = 0; b < fn->blocks.size(); ++b)
+    for (int i = 0; i < fn->blocks[b]->insts.size(); ++i)
+      fn->blocks[b]->insts[i]->reg = registers++;
+  // Where each block's code starts; phis, parameters and constants emit none
+  vector<int> start(fn->blocks.size());
+  int pc = 0;
+  for (int b = 0; b < fn->blocks.size(); ++b) {
+    start[b] = pc;
+    for (int i = 0; i < fn->blocks[b]->insts.size(); ++i) {
+      int op = fn->blocks[b]->insts[i]->op;
+      if (op != IR_PHI && op != IR_PARAM && op != IR_CONST)
+        ++pc;
+    }
+  }
+  int scratch = 0; // most scratch registers any edge needs
+  for (int b = 0; b < fn->blocks.size(); ++b) {
+    IRBlock* block = fn->blocks[b];
+    for (int i = 0; i < block->insts.size(); ++i) {
+      IRInst* in = block->insts[i];
+      if (in->op == IR_PHI)
+        continue;
+      if (in->op == IR_PARAM) {
+        x.paramRegs[in->slot] = in->reg;
+        continue;
+      }
+      if (in->op == IR_CONST) {
+        IRValue v;
+        if (in->isInt) v.i = in->integer;
+        else v.f = in->constant;
+        x.constants.push_back(make_pair(in->reg, v));
+        continue;
+      }
+      XInst xi;
+      xi.op = in->op;
+      xi.dst = in->reg;
+      if (in->args.size() > 0) xi.a = in->args[0]->reg;
+      if (in->args.size() > 1) xi.b = in->args[1]->reg;
+      xi.count = static_cast<int>(in->constant);
+      xi.slot = in->slot;
+      xi.line = in->line;
+      xi.what = in->what;
+      xi.name = in->name;
+      xi.array = in->array;
+      xi.checked = in->checked;
+      xi.write = in->write;
+      if (in->callee)
+        xi.callee = xOf[in->callee];
+      if (in->op == IR_CALL || in->op == IR_WRITE)
+        for (int a = 0; a < in->args.size(); ++a)
+          xi.args.push_back(in->args[a]->reg);
+      for (int k = 0; k < 2; ++k) {
+        IRBlock* target = in->targets[k];
+        if (!target)
+          continue;
+        xi.next[k] = start[target->id];
+        // Copies into target's phis along this edge
+        int from = 0;
+        while (target->preds[from] != block)
+          ++from;
+        XMoves moves;
+        for (int p = 0; p < target->insts.size() && target->insts[p]->op == IR_PHI; ++p) {
+          IRInst* phi = target->insts[p];
+          if (phi->args[from]->reg != phi->reg) {
+            moves.from.push_back(phi->args[from]->reg);
+            moves.to.push_back(phi->reg);
+          }
+        }
+        if (moves.from.empty())
+          continue;
+        bool overlap = false;
+        for (int m = 0; m < moves.from.size() && !overlap; ++m)
+          for (int t = 0; t < moves.to.size(); ++t)
+            if (moves.from[m] == moves.to[t])
+              overlap = true;
+        if (overlap) {
+          moves.temp = registers;
+          if (moves.from.size() > scratch)
+            scratch = moves.from.size();
+        }
+        xi.moves[k] = x.moves.size();
+        x.moves.push_back(moves);
+      }
+      x.code.push_back(xi);
+    }
+  }
+  x.registers = registers + scratch;
+}
+
+// ---------------------------------------------------------------------
+class IRRun {
+public:
+  vector<IRValue> regs;       // frames of running calls, innermost last
+  float execute(XFunction* f, int base);
+private:
+  void move(XFunction* f, int which, IRValue* r);
+  float read(const string& name);
+};
+
+void IRRun::move(XFunction* f, int which, IRValue* r) {
+  XMoves& m = f->moves[which];
+  int n = m.from.size();
+  if (m.temp < 0) {
+    for (int i = 0; i < n; ++i)
+      r[m.to[i]] = r[m.from[i]];
+    return;
+  }
+  for (int i = 0; i < n; ++i)
+    r[m.temp + i] = r[m.from[i]];
+  for (int i = 0; i < n; ++i)
+    r[m.to[i]] = r[m.temp + i];
+}
+
+// As ReadNode::interpret reads
+float IRRun::read(const string& name) {
+  float value;
+  if (state->input) {
+    int status = state->input->next(value);
+    if (status != INPUT_OK)
+      throw RuntimeError{inputErrorText(name, status, state->input->badToken, state->input->offset())};
+  } else if (state->read) {
+    if (!state->read(name, value))
+      throw RuntimeError{inputErrorText(name, INPUT_EOF, "", -1)};
+  } else {
+    cout << "Enter value for " << name << ": ";
+    if (!(cin >> value))
+      throw RuntimeError{inputErrorText(name, cin.eof() ? INPUT_EOF : INPUT_MALFORMED, "", -1)};
+  }
+  return value;
+}
+
+float IRRun::execute(XFunction* f, int base) {
+  IRValue* r = regs.data() + base;
+  for (int i = 0; i < f->constants.size(); ++i)
+    r[f->constants[i].first] = f->constants[i].second;
+  const XInst* code = f->code.data();
+  int pc = 0;
+  for (;;) {
+    const XInst& x = code[pc++];
+    switch (x.op) {
+      case IR_COPY: r[x.dst] = r[x.a]; break;
+      case IR_ADD: r[x.dst].f = r[x.a].f + r[x.b].f; break;
+      case IR_SUB: r[x.dst].f = r[x.a].f - r[x.b].f; break;
+      case IR_MUL: r[x.dst].f = r[x.a].f * r[x.b].f; break;
+      case IR_DIV: r[x.dst].f = r[x.a].f / r[x.b].f; break;
+      case IR_MOD: r[x.dst].f = static_cast<int>(r[x.a].f) % static_cast<int>(r[x.b].f); break;
+      case IR_EQ: r[x.dst].f = truth(r[x.a].f - r[x.b].f) ? 0.0f : 1.0f; break;
+      case IR_NE: r[x.dst].f = truth(r[x.a].f - r[x.b].f) ? 1.0f : 0.0f; break;
+      case IR_LT: r[x.dst].f = r[x.a].f < r[x.b].f ? 1.0f : 0.0f; break;
+      case IR_GT: r[x.dst].f = r[x.a].f > r[x.b].f ? 1.0f : 0.0f; break;
+      case IR_NOT: r[x.dst].f = truth(r[x.a].f) ? 0.0f : 1.0f; break;
+      case IR_NEG: r[x.dst].f = -r[x.a].f; break;
+      case IR_BOOL: r[x.dst].f = truth(r[x.a].f) ? 1.0f : 0.0f; break;
+      case IR_FTOI: r[x.dst].i = static_cast<int>(r[x.a].f); break;
+      case IR_ITOF: r[x.dst].f = static_cast<float>(r[x.a].i); break;
+      case IR_IINC: r[x.dst].i = r[x.a].i + 1; break;
+      case IR_IDEC: r[x.dst].i = r[x.a].i - 1; break;
+      case IR_IEQ: r[x.dst].f = r[x.a].i == r[x.b].i ? 1.0f : 0.0f; break;
+      case IR_ILT: r[x.dst].f = r[x.a].i < r[x.b].i ? 1.0f : 0.0f; break;
+      case IR_IGT: r[x.dst].f = r[x.a].i > r[x.b].i ? 1.0f : 0.0f; break;
+      case IR_INDEX: {
+        int i = static_cast<int>(r[x.a].f);
+        if (x.checked && (i < x.array->low || i > x.array->high))
+          throw RuntimeError{rangeErrorText(*x.name, x.array, i)};
+        r[x.dst].i = i - x.array->low;
+        break;
+      }
+      case IR_LOADG: r[x.dst].f = state->vars[x.slot]; break;
+      case IR_LOADE:
+        if (x.array->type == TOK_INTEGER)
+          r[x.dst].f = static_cast<float>(state->ints[x.slot][r[x.a].i]);
+        else
+          r[x.dst].f = state->reals[x.slot][r[x.a].i];
+        break;
+      case IR_STOREG: state->vars[x.slot] = r[x.a].f; break;
+      case IR_STOREE:
+        if (x.array->type == TOK_INTEGER)
+          state->ints[x.slot][r[x.a].i] = static_cast<int>(r[x.b].f);
+        else
+          state->reals[x.slot][r[x.a].i] = r[x.b].f;
+        break;
+      case IR_ENTER: {
+        SubprogramNode* callee = x.callee->node;
+        if (state->depth == MAX_CALL_DEPTH || state->top + callee->frameSize > state->stackSlots)
+          throw RuntimeError{"ERROR - calls nested too deeply in " + callee->label};
+        state->backEdge(callee->label.c_str(), callee->line);
+        state->top += callee->frameSize;
+        break;
+      }
+      case IR_CALL: {
+        XFunction* callee = x.callee;
+        int calleeBase = base + f->registers;
+        if (regs.size() < calleeBase + callee->registers) {
+          regs.resize(2 * (calleeBase + callee->registers));
+          r = regs.data() + base;
+        }
+        IRValue* params = regs.data() + calleeBase;
+        for (int i = 0; i < x.args.size(); ++i)
+          if (callee->paramRegs[i] >= 0)
+            params[callee->paramRegs[i]] = r[x.args[i]];
+        ++state->depth;
+        float result = execute(callee, calleeBase);
+        --state->depth;
+        state->top -= callee->node->frameSize;
+        r = regs.data() + base; // the callee may have grown regs
+        r[x.dst].f = result;
+        break;
+      }
+      case IR_READ: r[x.dst].f = read(*x.name); break;
+      case IR_WRITE: {
+        float few[WRITE_BUFFER / FORMAT_BUFFER];
+        vector<float> many;
+        float* values = few;
+        if (x.args.size() > WRITE_BUFFER / FORMAT_BUFFER) {
+          many.resize(x.args.size());
+          values = many.data();
+        }
+        for (int a = 0; a < x.args.size(); ++a)
+          values[a] = r[x.args[a]].f;
+        x.write->print(values);
+        break;
+      }
+      case IR_WRITESTR: x.write->print(nullptr); break;
+      case IR_COUNT: state->steps += x.count; break;
+      case IR_CHECK: state->backEdge(x.what, x.line); break;
+      case IR_JUMP:
+        if (x.moves[0] >= 0)
+          move(f, x.moves[0], r);
+        pc = x.next[0];
+        break;
+      case IR_BRANCH: {
+        int k = truth(r[x.a].f) ? 0 : 1;
+        if (x.moves[k] >= 0)
+          move(f, x.moves[k], r);
+        pc = x.next[k];
+        break;
+      }
+      case IR_RET:
+        return x.a >= 0 ? r[x.a].f : 0.0f;
+      default:
+        break;
+    }
+  }
+}
+
+// ---------------------------------------------------------------------
+// translate() numbers registers in the IR itself
+static mutex translating;
+
+void runIR(IRProgram* program) {
+  map<IRFunction*, XFunction*> xOf;
+  vector<XFunction> functions(program->functions.size());
+  XFunction main;
+  {
+    lock_guard<mutex> guard(translating);
+    for (int i = 0; i < program->functions.size(); ++i)
+      xOf[program->functions[i]] = &functions[i];
+    for (int i = 0; i < program->functions.size(); ++i)
+      translate(program->functions[i], functions[i], xOf);
+    translate(program->main, main, xOf);
+  }
+
+  IRRun run;
+  run.regs.resize(main.registers + 1024);
+  run.execute(&main, 0);
+}
@@ -0,0 +1,20 @@
+//*****************************************************************************
+// purpose: Register-machine execution of the SSA IR
+//          One backend consuming the optimized IR of ir.h
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#ifndef IREXEC_H
+#define IREXEC_H
+
+#include "ir.h"
+
+// Run the program's IR once in the current thread's State, which must
+// already be reset. Every SSA value gets its own register in the frame of
+// its call; phis become copies on the edges that reach them. Output,
+// errors and limits are those of root->interpret(). Several threads may
+// run the same IR at once.
+void runIR(IRProgram* program);
+
+#endif /* IREXEC_H */
@@ -24,6 +24,11 @@
 #define TOK_VAR         1014
 #define TOK_WHILE       1015
 #define TOK_WRITE       1016
+#define TOK_DO          1017
+#define TOK_ARRAY       1018
+#define TOK_OF          1019
+#define TOK_PROCEDURE   1020
+#define TOK_FUNCTION    1021
 
 // Datatype Specifiers
 #define TOK_INTEGER     1100
@@ -34,6 +39,10 @@
 #define TOK_COLON       2001
 #define TOK_OPENPAREN   2002
 #define TOK_CLOSEPAREN  2003
+#define TOK_OPENBRACKET 2004
+#define TOK_CLOSEBRACKET 2005
+#define TOK_DOTDOT      2006
+#define TOK_COMMA       2007
 
 // Operators
 #define TOK_PLUS        3000
@@ -0,0 +1,297 @@
+//*****************************************************************************
+// purpose: Memory accounting for --mem-stats
+//          Bytes and allocations held by the parse tree, tables and state
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#include "memstats.h"
+#include "parser.h"
+#include <iomanip>
+#include <map>
+#include <sys/resource.h>
+#include <malloc.h>
+
+// Bookkeeping of one std::map entry beyond its value: color and three
+// links in libstdc++'s red-black tree
+#define MAP_NODE_OVERHEAD (4 * sizeof(void*))
+
+// ---------------------------------------------------------------------
+// Totals for one row of the report
+struct Tally {
+  long long count = 0;  // objects of this kind
+  long long bytes = 0;  // bytes they asked the heap for
+  long long allocs = 0; // separate heap blocks
+  long long unused = 0; // reserved but unused container bytes
+};
+
+// Collects the tallies while walking the tree
+class MemWalk {
+public:
+  map<string, Tally> nodes;      // by node class
+  map<string, Tally> containers; // by member holding the container
+  void walk(ProgramNode* program);
+private:
+  void node(const char* name, size_t size);
+  void text(const string& s);
+  template <class T> void container(const char* name, const vector<T>& v);
+  void walk(BlockNode* block);
+  void walk(SubprogramNode* sub);
+  void walk(StatementNode* stmt);
+  void walk(ExpressionNode* expr);
+  void walk(SimpleExpressionNode* simple);
+  void walk(TermNode* term);
+  void walk(FactorNode* factor);
+};
+
+void MemWalk::node(const char* name, size_t size) {
+  Tally& t = nodes[name];
+  t.count += 1;
+  t.bytes += size;
+  t.allocs += 1;
+}
+
+// Names and literals only cost heap when too long for the inline buffer
+void MemWalk::text(const string& s) {
+  const char* data = s.data();
+  bool inline_ = data >= reinterpret_cast<const char*>(&s) && data < reinterpret_cast<const char*>(&s + 1);
+  Tally& t = containers["string text"];
+  t.count += 1;
+  if (!inline_) {
+    t.bytes += s.capacity() + 1;
+    t.allocs += 1;
+    t.unused += s.capacity() - s.size();
+  }
+}
+
+template <class T> void MemWalk::container(const char* name, const vector<T>& v) {
+  Tally& t = containers[name];
+  t.count += 1;
+  if (v.capacity() > 0) {
+    t.bytes += v.capacity() * sizeof(T);
+    t.allocs += 1;
+    t.unused += (v.capacity() - v.size()) * sizeof(T);
+  }
+}
+
+void MemWalk::walk(ProgramNode* program) {
+  node("ProgramNode", sizeof(ProgramNode));
+  text(program->id);
+  walk(program->block.get());
+}
+
+void MemWalk::walk(BlockNode* block) {
+  node("BlockNode", sizeof(BlockNode));
+  container("subprograms", block->subprograms);
+  for (int i = 0; i < block->subprograms.size(); ++i)
+    walk(block->subprograms[i].get());
+  walk(block->compound.get());
+}
+
+void MemWalk::walk(SubprogramNode* sub) {
+  node("SubprogramNode", sizeof(SubprogramNode));
+  text(sub->id);
+  text(sub->label);
+  walk(sub->body.get());
+}
+
+void MemWalk::walk(StatementNode* stmt) {
+  if (AssignmentNode* n = dynamic_cast<AssignmentNode*>(stmt)) {
+    node("AssignmentNode", sizeof(AssignmentNode));
+    text(n->id);
+    walk(n->expr.get());
+  } else if (ArrayAssignmentNode* n = dynamic_cast<ArrayAssignmentNode*>(stmt)) {
+    node("ArrayAssignmentNode", sizeof(ArrayAssignmentNode));
+    text(n->id);
+    walk(n->index.get());
+    walk(n->expr.get());
+  } else if (CompoundNode* n = dynamic_cast<CompoundNode*>(stmt)) {
+    node("CompoundNode", sizeof(CompoundNode));
+    container("statements", n->statements);
+    for (int i = 0; i < n->statements.size(); ++i)
+      walk(n->statements[i].get());
+  } else if (IfNode* n = dynamic_cast<IfNode*>(stmt)) {
+    node("IfNode", sizeof(IfNode));
+    walk(n->expr.get());
+    walk(n->thenStatement.get());
+    if (n->elseStatement)
+      walk(n->elseStatement.get());
+  } else if (WhileNode* n = dynamic_cast<WhileNode*>(stmt)) {
+    node("WhileNode", sizeof(WhileNode));
+    walk(n->expr.get());
+    walk(n->statement.get());
+  } else if (ForNode* n = dynamic_cast<ForNode*>(stmt)) {
+    node("ForNode", sizeof(ForNode));
+    text(n->id);
+    walk(n->startExpr.get());
+    walk(n->endExpr.get());
+    walk(n->statement.get());
+  } else if (CallNode* n = dynamic_cast<CallNode*>(stmt)) {
+    node("CallNode", sizeof(CallNode));
+    container("args", n->args);
+    for (int i = 0; i < n->args.size(); ++i)
+      walk(n->args[i].get());
+  } else if (ReadNode* n = dynamic_cast<ReadNode*>(stmt)) {
+    node("ReadNode", sizeof(ReadNode));
+    text(n->id);
+  } else if (WriteNode* n = dynamic_cast<WriteNode*>(stmt)) {
+    node("WriteNode", sizeof(WriteNode));
+    container("arguments", n->arguments);
+    for (int i = 0; i < n->arguments.size(); ++i)
+      text(n->arguments[i]);
+    text(n->prefix);
+    container("fields", n->fields);
+    for (int i = 0; i < n->fields.size(); ++i) {
+      text(n->fields[i].id);
+      text(n->fields[i].suffix);
+    }
+  } else if (dynamic_cast<BreakNode*>(stmt)) {
+    node("BreakNode", sizeof(BreakNode));
+  } else {
+    node("ContinueNode", sizeof(ContinueNode));
+  }
+}
+
+void MemWalk::walk(ExpressionNode* expr) {
+  node("ExpressionNode", sizeof(ExpressionNode));
+  walk(expr->firstSimpleExpr.get());
+  if (expr->secondSimpleExpr)
+    walk(expr->secondSimpleExpr.get());
+}
+
+void MemWalk::walk(SimpleExpressionNode* simple) {
+  node("SimpleExpressionNode", sizeof(SimpleExpressionNode));
+  container("restSmplExprOps", simple->restSmplExprOps);
+  container("restTerms", simple->restTerms);
+  walk(simple->firstTerm.get());
+  for (int i = 0; i < simple->restTerms.size(); ++i)
+    walk(simple->restTerms[i].get());
+}
+
+void MemWalk::walk(TermNode* term) {
+  node("TermNode", sizeof(TermNode));
+  container("restTermOps", term->restTermOps);
+  container("restFactors", term->restFactors);
+  walk(term->firstFactor.get());
+  for (int i = 0; i < term->restFactors.size(); ++i)
+    walk(term->restFactors[i].get());
+}
+
+void MemWalk::walk(FactorNode* factor) {
+  if (dynamic_cast<IntLitNode*>(factor)) {
+    node("IntLitNode", sizeof(IntLitNode));
+  } else if (dynamic_cast<FloatLitNode*>(factor)) {
+    node("FloatLitNode", sizeof(FloatLitNode));
+  } else if (IdentifierNode* n = dynamic_cast<IdentifierNode*>(factor)) {
+    node("IdentifierNode", sizeof(IdentifierNode));
+    text(n->id);
+  } else if (IndexedIdentifierNode* n = dynamic_cast<IndexedIdentifierNode*>(factor)) {
+    node("IndexedIdentifierNode", sizeof(IndexedIdentifierNode));
+    text(n->id);
+    walk(n->index.get());
+  } else if (NestedExpressionNode* n = dynamic_cast<NestedExpressionNode*>(factor)) {
+    node("NestedExpressionNode", sizeof(NestedExpressionNode));
+    walk(n->exprPtr.get());
+  } else if (NotNode* n = dynamic_cast<NotNode*>(factor)) {
+    node("NotNode", sizeof(NotNode));
+    walk(n->factor.get());
+  } else if (MinusNode* n = dynamic_cast<MinusNode*>(factor)) {
+    node("MinusNode", sizeof(MinusNode));
+    walk(n->factor.get());
+  } else {
+    FunctionCallNode* call = dynamic_cast<FunctionCallNode*>(factor);
+    node("FunctionCallNode", sizeof(FunctionCallNode));
+    container("args", call->args);
+    for (int i = 0; i < call->args.size(); ++i)
+      walk(call->args[i].get());
+  }
+}
+
+// ---------------------------------------------------------------------
+// Entries of a std::map, each its own heap block
+template <class M> static Tally mapTally(const M& table) {
+  Tally t;
+  t.count = table.size();
+  for (typename M::const_iterator it = table.begin(); it != table.end(); ++it) {
+    t.bytes += MAP_NODE_OVERHEAD + sizeof(typename M::value_type);
+    t.allocs += 1;
+    if (it->first.capacity() > 15) { // past libstdc++'s inline buffer
+      t.bytes += it->first.capacity() + 1;
+      t.allocs += 1;
+    }
+  }
+  return t;
+}
+
+static void printRow(const string& name, const Tally& t, bool withUnused) {
+  cout << "  " << left << setw(24) << name << right
+       << setw(8) << t.count << setw(12) << t.bytes << setw(8) << t.allocs;
+  if (withUnused)
+    cout << setw(10) << t.unused;
+  cout << endl;
+}
+
+static void printSection(const char* title, map<string, Tally>& rows, bool withUnused) {
+  cout << left << setw(26) << title << right
+       << setw(8) << "count" << setw(12) << "bytes" << setw(8) << "allocs";
+  if (withUnused)
+    cout << setw(10) << "unused";
+  cout << endl;
+  Tally total;
+  for (map<string, Tally>::iterator it = rows.begin(); it != rows.end(); ++it) {
+    printRow(it->first, it->second, withUnused);
+    total.count += it->second.count;
+    total.bytes += it->second.bytes;
+    total.allocs += it->second.allocs;
+    total.unused += it->second.unused;
+  }
+  printRow("total", total, withUnused);
+}
+
+// ---------------------------------------------------------------------
+void printMemStats(ProgramNode* root, State* run) {
+  MemWalk walk;
+  onStackFor(root->nesting, [&] { walk.walk(root); });
+
+  map<string, Tally> other;
+  other["symbol table"] = mapTally(root->tables->symbols);
+  other["array table"] = mapTally(root->tables->arrays);
+  other["subprogram table"] = mapTally(root->tables->subprograms);
+  Tally lexer;
+  lexer.count = 1;
+  lexer.bytes = lexer_buffer_bytes();
+  lexer.allocs = 2; // buffer state and its character array
+  other["lexer buffer (freed)"] = lexer;
+  if (run) {
+    Tally vars;
+    vars.count = run->vars.size();
+    vars.bytes = run->vars.capacity() * sizeof(float);
+    vars.allocs = run->vars.capacity() > 0;
+    other["State variables"] = vars;
+    Tally arrays;
+    for (int i = 0; i < run->ints.size(); ++i) {
+      arrays.count += run->ints[i].size() + run->reals[i].size();
+      arrays.bytes += run->ints[i].capacity() * sizeof(int) + run->reals[i].capacity() * sizeof(float);
+      arrays.allocs += (run->ints[i].capacity() > 0) + (run->reals[i].capacity() > 0);
+    }
+    other["State arrays"] = arrays;
+    Tally stack;
+    stack.count = run->stackSlots;
+    stack.bytes = run->stackSlots * sizeof(float); // reserved; resident only where calls reached
+    stack.allocs = run->stackSlots > 0;
+    other["State frame stack"] = stack;
+  }
+
+  cout << "*** Memory Statistics ***" << endl;
+  printSection("Parse tree nodes", walk.nodes, false);
+  printSection("Node containers", walk.containers, true);
+  printSection("Tables and buffers", other, false);
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 heap = mallinfo2();
+  cout << "Heap in use: " << heap.uordblks + heap.hblkhd << " bytes" << endl; // arena plus mmapped blocks
+#endif
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    cout << "Peak RSS: " << usage.ru_maxrss << " KB" << endl;
+}
@@ -0,0 +1,20 @@
+//*****************************************************************************
+// purpose: Memory accounting for --mem-stats
+//          Bytes and allocations held by the parse tree, tables and state
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+
+#include "nodes.h"
+
+// Walk the tree rooted at root and print, per node class and per
+// container kind, how many there are and the bytes and heap allocations
+// they hold; then the symbol tables, the lexer buffer, the run-time State
+// run (if any) and the process's peak RSS. Sizes are what the program
+// asked for; malloc's own overhead is not included.
+void printMemStats(ProgramNode* root, State* run);
+
+#endif /* MEMSTATS_H */
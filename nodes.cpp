@@ -8,17 +8,120 @@
 
 #include "nodes.h"
 #include "parser.h"
+#include "input.h"
+#include "format.h"
+#include "checkpoint.h"
+#include "trace.h"
+#include "autopar.h"
+#include "fiber.h"
+#include <climits>
+#include <cstdio>
+#include <cstring>
 
-#define EPSILON 0.001
-// Define truth for a floating-point number:
-// falsehood == F is within EPSILON of 0.0
-// truth == not falsehood
-static bool truth(float F) {
-  return !((EPSILON > F) && (F > -EPSILON));
+bool printDelete = false;   // shall we print deleting the tree?
+
+thread_local State* state = nullptr;
+
+// ---------------------------------------------------------------------
+// Size the state for a program and zero every variable
+void State::reset(const ProgramTables& tables) {
+  vars.assign(tables.symbols.size(), 0.0f);
+  ints.resize(tables.arrays.size());
+  reals.resize(tables.arrays.size());
+  for (auto& entry : tables.arrays) {
+    const ArrayT& array = entry.second;
+    int size = array.high - array.low + 1;
+    if (array.type == TOK_INTEGER)
+      ints[array.number].assign(size, 0);
+    else
+      reals[array.number].assign(size, 0.0f);
+  }
+  if (!tables.subprograms.empty() && !stack) {
+    stack.reset(new float[STACK_SLOTS]);
+    stackSlots = STACK_SLOTS;
+  }
+  frame = top = depth = 0;
+  startClock();
 }
 
+void State::startClock() {
+  steps = 0;
+  written = 0;
+  outputCap = limits.maxOutput > 0 ? limits.maxOutput : LLONG_MAX;
+  if (limits.timeout > 0)
+    deadline = chrono::steady_clock::now()
+               + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(limits.timeout));
+  if (limits.maxSteps > 0 && limits.maxSteps < CHECK_INTERVAL)
+    checkAt = limits.maxSteps + 1;
+  else if (limits.maxSteps > 0 || limits.timeout > 0 || checkpoint)
+    checkAt = CHECK_INTERVAL;
+  else
+    checkAt = LLONG_MAX; // nothing to check but output
+}
 
-bool printDelete = false;   // shall we print deleting the tree?
+// Stop the run if it is over budget, otherwise schedule the next check
+void State::checkLimits(const char* what, int line) {
+  string where = string(" in ") + what + " at line " + to_string(line)
+                 + " after " + to_string(steps) + " statements";
+  if (limits.maxSteps > 0 && steps > limits.maxSteps)
+    throw RuntimeError{"ERROR - statement limit of " + to_string(limits.maxSteps)
+                       + " exceeded" + where, EXIT_STEP_LIMIT};
+  if (written > outputCap)
+    throw RuntimeError{"ERROR - output limit of " + to_string(limits.maxOutput)
+                       + " bytes exceeded" + where, EXIT_OUTPUT_LIMIT};
+  if (limits.timeout > 0 && chrono::steady_clock::now() >= deadline) {
+    char seconds[32];
+    snprintf(seconds, sizeof(seconds), "%g", limits.timeout);
+    throw RuntimeError{string("ERROR - time limit of ") + seconds + "s exceeded" + where,
+                       EXIT_TIME_LIMIT};
+  }
+  if (checkpoint && checkpoint->due())
+    checkpointDue = true;
+  if (checkAt == LLONG_MAX)
+    return;
+  checkAt = steps + CHECK_INTERVAL;
+  if (limits.maxSteps > 0 && checkAt > limits.maxSteps + 1)
+    checkAt = limits.maxSteps + 1;
+}
+
+string errorBanner(const string& message) {
+  return "\n===========================\n" + message + "\n===========================\n";
+}
+
+// Stop the run after a failed READ of variable name
+static void inputError(const string& name, int status) {
+  if (state->input)
+    throw RuntimeError{inputErrorText(name, status, state->input->badToken, state->input->offset())};
+  throw RuntimeError{inputErrorText(name, status, "", -1)};
+}
+
+// ---------------------------------------------------------------------
+// Convert an index value to a position in array, stopping the run when
+// it is outside the declared bounds and the parser could not prove it
+// inside.
+static inline int arrayOffset(const string& name, ArrayT* array, float indexValue, bool checked) {
+  int i = static_cast<int>(indexValue);
+  if (checked && (i < array->low || i > array->high))
+    throw RuntimeError{rangeErrorText(name, array, i)};
+  return i - array->low;
+}
+string rangeErrorText(const string& name, ArrayT* array, int index) {
+  return "ERROR - index " + to_string(index) + " out of range for " + name
+         + "[" + to_string(array->low) + ".." + to_string(array->high) + "]";
+}
+
+size_t stackFor(int nesting) {
+  if (nesting <= SHALLOW_NESTING)
+    return FIBER_STACK;
+  return FIBER_STACK + (size_t)nesting * NESTING_STACK;
+}
+
+void onStackFor(int nesting, const function<void()>& body) {
+  if (nesting <= SHALLOW_NESTING)
+    body();
+  else
+    runOnStack(stackFor(nesting), body);
+}
 
 // ---------------------------------------------------------------------
 // Indent according to tree level
@@ -30,20 +133,16 @@ static void indent(int level) {
 // ---------------------------------------------------------------------
 ProgramNode::ProgramNode(int level, string name, BlockNode* b) {
   _level = level;
-  id = new string(name);
-  block = b;
+  id = std::move(name);
+  block.reset(b);
 }
 ProgramNode::~ProgramNode() {
   if(printDelete) 
     cout << "Deleting ProgramNode " << endl;
-  delete id;
-  id = nullptr;
-  delete block;
-  block = nullptr;
 }
 ostream& operator<<(ostream& os, ProgramNode& pn) {
   os << endl; indent(pn._level); os << "(program ";
-  os << *(pn.id);
+  os << pn.id;
   os << *(pn.block);
   os << endl; indent(pn._level); os << "program) ";
   return os;
@@ -59,22 +158,12 @@ BlockNode::BlockNode(int level) {
 BlockNode::~BlockNode() {
   if(printDelete) 
     cout << "Deleting BlockNode " << endl;
-  /*int nameLength = varNames.size();
-  for (int i = 0; i < nameLength; ++i) {
-    delete varNames[i];
-    varNames[i] = nullptr;
-  }
-  int typeLength = varTypes.size();
-  for (int i = 0; i < typeLength; ++i) {
-    delete varTypes[i];
-    varTypes[i] = nullptr;
-  } // Not needed, as the symbol table is already initialized in the parser and does not store types.*/
-  delete compound;
-  compound = nullptr;
 }
 ostream& operator<<(ostream& os, BlockNode& bn) {
   os << endl; indent(bn._level); os << "(block ";
   indent(bn._level);
+  for (int i = 0; i < bn.subprograms.size(); ++i)
+    os << *bn.subprograms[i];
   os << *(bn.compound);
   os << endl; indent(bn._level); os << "block) ";
   return os;
@@ -95,6 +184,47 @@ void BlockNode::interpret() {
   }
 }
 
+// ---------------------------------------------------------------------
+SubprogramNode::SubprogramNode(int level, string name, bool function) {
+  _level = level;
+  id = std::move(name);
+  isFunction = function;
+  label = (isFunction ? "FUNCTION " : "PROCEDURE ") + id;
+}
+SubprogramNode::~SubprogramNode() {
+  if(printDelete) 
+    cout << "Deleting SubprogramNode " << endl;
+}
+ostream& operator<<(ostream& os, SubprogramNode& sn) {
+  os << endl; indent(sn._level); os << (sn.isFunction ? "(function " : "(procedure ");
+  os << sn.id << " ( params: " << sn.paramCount << " frame: " << sn.frameSize << " )";
+  os << *(sn.body);
+  os << endl; indent(sn._level); os << (sn.isFunction ? "function) " : "procedure) ");
+  return os;
+}
+float SubprogramNode::call(const vector<unique_ptr<ExpressionNode> >& args) {
+  if (state->depth == MAX_CALL_DEPTH || state->top + frameSize > state->stackSlots)
+    throw RuntimeError{"ERROR - calls nested too deeply in " + label};
+  state->backEdge(label.c_str(), line); // recursion can run as long as a loop
+  // Claim the frame first, so calls inside the arguments build theirs
+  // above it. The arguments still see the caller's frame.
+  int base = state->top;
+  state->top = base + frameSize;
+  float* slots = state->stack.get() + base;
+  for (int i = 0; i < paramCount; ++i)
+    slots[i] = args[i]->interpret();
+  for (int i = paramCount; i < frameSize; ++i)
+    slots[i] = 0.0f; // locals and the result start at zero
+  int callerFrame = state->frame;
+  state->frame = base;
+  ++state->depth;
+  body->interpret();
+  --state->depth;
+  state->frame = callerFrame;
+  state->top = base;
+  return resultSlot >= 0 ? slots[resultSlot] : 0.0f;
+}
+
 // ---------------------------------------------------------------------
 StatementNode::~StatementNode() {
   if(printDelete) 
@@ -104,33 +234,81 @@ ostream& operator<<(ostream& os, StatementNode& sn) {
   sn.printTo(os);
   return os;
 }
-void StatementNode::interpret() {
+ExecStatus StatementNode::interpret() {
   return this->interpret();
 }
 
 // ---------------------------------------------------------------------
-AssignmentNode::AssignmentNode(int level, string identifier, ExpressionNode* e) {
+AssignmentNode::AssignmentNode(int level, string identifier, int s, ExpressionNode* e) {
   _level = level;
-  id = new string(identifier);
-  expr = e;
+  id = std::move(identifier);
+  slot = s;
+  expr.reset(e);
 }
 AssignmentNode::~AssignmentNode() {
   if(printDelete) 
     cout << "Deleting AssignmentNode " << endl;
-  delete id;
-  id = nullptr;
-  delete expr;
-  expr = nullptr;
 }
 void AssignmentNode::printTo(ostream & os) {
   os << endl; indent(_level); os << "(assignment ";
-  os << "( " << *id << " := )";
+  os << "( " << id << " := )";
   os << *expr;
   os << endl; indent(_level); os << "assignment) ";
 } 
-void AssignmentNode::interpret() {
-  symbolTableT::iterator variable = symbolTable.find(*id); // Look up the variable that will store expression result
-  variable->second = expr->interpret(); // Put the expression in the variable
+ExecStatus AssignmentNode::interpret() {
+  if (reduction && state->reductions)
+    return reduce();
+  float value = expr->interpret();
+  state->var(local, slot) = value; // Put the expression in the variable
+  if (state->trace)
+    state->trace->record(traceId, line, value);
+  return EXEC_NORMAL;
+}
+
+// V := V + t1 - t2 ... in a worker of a parallel WHILE: log each term
+ExecStatus AssignmentNode::reduce() {
+  SimpleExpressionNode* sum = expr->firstSimpleExpr.get();
+  for (int i = 0; i < sum->restTerms.size(); ++i) {
+    Reduction r;
+    r.slot = slot;
+    r.minus = sum->restSmplExprOps[i] == TOK_MINUS;
+    r.value = sum->restTerms[i]->interpret();
+    state->reductions->push_back(r);
+  }
+  return EXEC_NORMAL;
+}
+
+// ---------------------------------------------------------------------
+ArrayAssignmentNode::ArrayAssignmentNode(int level, string name, ArrayT* a, ExpressionNode* i, ExpressionNode* e) {
+  _level = level;
+  id = std::move(name);
+  array = a;
+  index.reset(i);
+  expr.reset(e);
+}
+ArrayAssignmentNode::~ArrayAssignmentNode() {
+  if(printDelete) 
+    cout << "Deleting ArrayAssignmentNode " << endl;
+}
+void ArrayAssignmentNode::printTo(ostream & os) {
+  os << endl; indent(_level); os << "(assignment ";
+  os << "( " << id << " [";
+  os << *index;
+  os << endl; indent(_level); os << "] := )";
+  os << *expr;
+  os << endl; indent(_level); os << "assignment) ";
+}
+ExecStatus ArrayAssignmentNode::interpret() {
+  int offset = arrayOffset(id, array, index->interpret(), checked);
+  float value = expr->interpret();
+  State* values = state->arrays();
+  if (array->type == TOK_INTEGER)
+    values->ints[array->number][offset] = static_cast<int>(value);
+  else
+    values->reals[array->number][offset] = value;
+  if (state->trace)
+    state->trace->record(traceId, line, value);
+  return EXEC_NORMAL;
 }
 
 // ---------------------------------------------------------------------
@@ -140,13 +318,9 @@ CompoundNode::CompoundNode(int level) {
 CompoundNode::~CompoundNode() {
   if(printDelete) 
     cout << "Deleting CompoundNode " << endl;
-  for (int i = 0; i < statements.size(); ++i) {
-    delete statements[i];
-    statements[i] = nullptr;
-  }
 }
 void CompoundNode::addStatement(StatementNode* s) {
-  statements.push_back(s);
+  statements.emplace_back(s);
 }
 void CompoundNode::printTo(ostream & os) {
   os << endl; indent(_level); os << "(compound_stmt";
@@ -155,28 +329,29 @@ void CompoundNode::printTo(ostream & os) {
   }
   os << endl; indent(_level); os << "compound_stmt)";
 }
-void CompoundNode::interpret() {
-  for (int i = 0; i < statements.size(); ++i) {
-    statements[i]->interpret();
+ExecStatus CompoundNode::interpret() {
+  state->steps += statements.size(); // counted up front, checked on back-edges
+  return runFrom(0);
+}
+ExecStatus CompoundNode::runFrom(int first) {
+  for (int i = first; i < statements.size(); ++i) {
+    ExecStatus status = statements[i]->interpret();
+    if (status != EXEC_NORMAL)
+      return status; // BREAK/CONTINUE skips the rest of the block
   }
+  return EXEC_NORMAL;
 }
 
 // ---------------------------------------------------------------------
 IfNode::IfNode(int level, ExpressionNode* e, StatementNode* ts, StatementNode* es) {
   _level = level;
-  expr = e;
-  thenStatement = ts;
-  elseStatement = es;
+  expr.reset(e);
+  thenStatement.reset(ts);
+  elseStatement.reset(es);
 }
 IfNode::~IfNode() {
   if(printDelete) 
     cout << "Deleting IfNode " << endl;
-  delete expr;
-  expr = nullptr;
-  delete thenStatement;
-  thenStatement = nullptr;
-  delete elseStatement;
-  elseStatement = nullptr;
 }
 void IfNode::printTo(ostream & os) {
   os << endl; indent(_level); os << "(if_stmt ";
@@ -193,27 +368,29 @@ void IfNode::printTo(ostream & os) {
   }
   os << endl; indent(_level); os << "if_stmt)";
 }
-void IfNode::interpret() {
-  if (truth(expr->interpret())) {
-    thenStatement->interpret();
+ExecStatus IfNode::interpret() {
+  bool taken = truth(expr->interpret());
+  if (state->profile)
+    ++state->profile[2 * site + (taken ? 0 : 1)]; // then, else
+  if (state->trace)
+    state->trace->record(traceId, line, taken ? 1.0f : 0.0f);
+  if (taken) {
+    return thenStatement->interpret();
   } else if (elseStatement) {
-    elseStatement->interpret();
+    return elseStatement->interpret();
   }
+  return EXEC_NORMAL;
 }
 
 // ---------------------------------------------------------------------
 WhileNode::WhileNode(int level, ExpressionNode* e, StatementNode* s) {
   _level = level;
-  expr = e;
-  statement = s;
+  expr.reset(e);
+  statement.reset(s);
 }
 WhileNode::~WhileNode() {
   if(printDelete) 
     cout << "Deleting WhileNode " << endl;
-  delete expr;
-  expr = nullptr;
-  delete statement;
-  statement = nullptr;
 }
 void WhileNode::printTo(ostream & os) {
   os << endl; indent(_level); os << "(while ";
@@ -221,57 +398,233 @@ void WhileNode::printTo(ostream & os) {
   os << *statement;
   os << endl; indent(_level); os << "while)";
 }
-void WhileNode::interpret() {
-  while (truth(expr->interpret())) {
-    statement->interpret();
+ExecStatus WhileNode::interpret() {
+  if (state->profile)
+    ++state->profile[2 * site]; // entries, then iterations
+  if (parallel && parallel->run())
+    return EXEC_NORMAL;
+  return iterate();
+}
+ExecStatus WhileNode::iterate() {
+  long long* trips = state->profile ? &state->profile[2 * site + 1] : nullptr;
+  Tracer* tracer = state->trace;
+  long long trip = 0;
+  while (fast ? fast->test() : truth(expr->interpret())) {
+    if (trips)
+      ++*trips;
+    if (tracer)
+      tracer->record(traceId, line, static_cast<float>(++trip));
+    if (statement->interpret() == EXEC_BREAK)
+      break;
+    state->backEdge("WHILE loop", line);
+    if (state->checkpointDue)
+      state->checkpoint->save(this);
+  }
+  return EXEC_NORMAL;
+}
+
+// ---------------------------------------------------------------------
+bool ScalarTest::test() {
+  float value = state->var(leftLocal, leftSlot);
+  float secondValue = rightIsVar ? state->var(rightLocal, rightSlot) : constant;
+  switch (relop) {
+    case TOK_EQUALTO:
+      return !truth(value - secondValue);
+    case TOK_LESSTHAN:
+      return value < secondValue;
+    case TOK_GREATERTHAN:
+      return value > secondValue;
+    default: // TOK_NOTEQUALTO
+      return truth(value - secondValue);
   }
 }
 
 // ---------------------------------------------------------------------
-ReadNode::ReadNode(int level, string name) {
+ForNode::ForNode(int level, string name, int sl, ExpressionNode* s, ExpressionNode* e, bool down, StatementNode* st) {
+  _level = level;
+  id = std::move(name);
+  slot = sl;
+  startExpr.reset(s);
+  endExpr.reset(e);
+  downto = down;
+  statement.reset(st);
+}
+ForNode::~ForNode() {
+  if(printDelete) 
+    cout << "Deleting ForNode " << endl;
+}
+void ForNode::printTo(ostream & os) {
+  os << endl; indent(_level); os << "(for ( " << id << " := )";
+  os << *startExpr;
+  os << endl; indent(_level); os << (downto ? "DOWNTO " : "TO ");
+  os << *endExpr;
+  os << *statement;
+  os << endl; indent(_level); os << "for)";
+}
+ExecStatus ForNode::interpret() {
+  // Both bounds are evaluated once, then the loop runs on a native int
+  // counter. The variable is only written so the body can read it.
+  int first = static_cast<int>(startExpr->interpret());
+  int last = static_cast<int>(endExpr->interpret());
+  if (downto ? first < last : first > last)
+    return EXEC_NORMAL;
+  return iterate(first, last);
+}
+ExecStatus ForNode::iterate(int first, int last) {
+  float& counter = state->var(local, slot); // vars and stack never move while running
+  Checkpointer* saver = state->checkpoint;
+  Tracer* tracer = state->trace;
+  int i = first;
+  if (saver)
+    saver->enter(&i, last); // a checkpoint records where every FOR is
+  if (!downto) {
+    for (; ; ++i) {
+      counter = static_cast<float>(i);
+      if (tracer) tracer->record(traceId, line, counter);
+      if (statement->interpret() == EXEC_BREAK) break;
+      if (i == last) break; // test before ++ so INT_MAX cannot overflow
+      state->backEdge("FOR loop", line);
+      if (state->checkpointDue) saver->save(this);
+    }
+  } else {
+    for (; ; --i) {
+      counter = static_cast<float>(i);
+      if (tracer) tracer->record(traceId, line, counter);
+      if (statement->interpret() == EXEC_BREAK) break;
+      if (i == last) break;
+      state->backEdge("FOR loop", line);
+      if (state->checkpointDue) saver->save(this);
+    }
+  }
+  if (saver)
+    saver->leave();
+  return EXEC_NORMAL;
+}
+
+// ---------------------------------------------------------------------
+BreakNode::BreakNode(int level) {
+  _level = level;
+}
+BreakNode::~BreakNode() {
+  if(printDelete) 
+    cout << "Deleting BreakNode " << endl;
+}
+void BreakNode::printTo(ostream & os) {
+  os << endl; indent(_level); os << "(break_stmt)";
+}
+ExecStatus BreakNode::interpret() {
+  return EXEC_BREAK;
+}
+
+// ---------------------------------------------------------------------
+ContinueNode::ContinueNode(int level) {
+  _level = level;
+}
+ContinueNode::~ContinueNode() {
+  if(printDelete) 
+    cout << "Deleting ContinueNode " << endl;
+}
+void ContinueNode::printTo(ostream & os) {
+  os << endl; indent(_level); os << "(continue_stmt)";
+}
+ExecStatus ContinueNode::interpret() {
+  return EXEC_CONTINUE;
+}
+
+// ---------------------------------------------------------------------
+CallNode::CallNode(int level, SubprogramNode* c) {
   _level = level;
-  id = new string(name);
+  callee = c;
+}
+CallNode::~CallNode() {
+  if(printDelete) 
+    cout << "Deleting CallNode " << endl;
+}
+void CallNode::printTo(ostream & os) {
+  os << endl; indent(_level); os << "(call_stmt ( " << callee->id << " )";
+  for (int i = 0; i < args.size(); ++i)
+    os << *args[i];
+  os << endl; indent(_level); os << "call_stmt)";
+}
+ExecStatus CallNode::interpret() {
+  if (state->trace)
+    state->trace->record(traceId, line, 0.0f);
+  callee->call(args);
+  return EXEC_NORMAL;
+}
+
+// ---------------------------------------------------------------------
+ReadNode::ReadNode(int level, string name, int s) {
+  _level = level;
+  id = std::move(name);
+  slot = s;
 }
 ReadNode::~ReadNode() {
   if(printDelete) 
     cout << "Deleting ReadNode " << endl;
-  delete id;
-  id = nullptr;
 }
 void ReadNode::printTo(ostream & os) {
   os << endl; indent(_level); os << "(read_stmt ( ";
-  os << *id; os << " )";
+  os << id; os << " )";
   os << endl; indent(_level); os << "read_stmt)";
 }
-void ReadNode::interpret() {
+ExecStatus ReadNode::interpret() {
   // Read a value from the user and store it in the variable
   float value;
-  cout << "Enter value for " << *id << ": ";
-  cin >> value;
-  symbolTable[*id] = value; // Store the value in the symbol table
+  if (state->input) {
+    // Non-interactive: no prompt, values come from the buffered reader
+    int status = state->input->next(value);
+    if (status != INPUT_OK)
+      inputError(id, status);
+  } else if (state->read) {
+    if (!state->read(id, value))
+      inputError(id, INPUT_EOF);
+  } else {
+    cout << "Enter value for " << id << ": ";
+    if (!(cin >> value))
+      inputError(id, cin.eof() ? INPUT_EOF : INPUT_MALFORMED);
+  }
+  state->var(local, slot) = value; // Store the value in the variable
+  if (state->trace)
+    state->trace->record(traceId, line, value);
+  return EXEC_NORMAL;
 }
 
 // ---------------------------------------------------------------------
-WriteNode::WriteNode(int level, string name, string str) {
+WriteNode::WriteNode(int level) {
   _level = level;
-  if (!name.empty()) id = new string(name);
-  if (!str.empty()) this->str = new string(str);
 }
 WriteNode::~WriteNode() {
   if(printDelete) 
     cout << "Deleting WriteNode " << endl;
-  delete id;
-  id = nullptr;
-  delete str;
-  str = nullptr;
+}
+void WriteNode::addVariable(string name, int slot, bool local) {
+  arguments.push_back(name);
+  WriteField field;
+  field.id = std::move(name);
+  field.slot = slot;
+  field.local = local;
+  fields.push_back(std::move(field));
+}
+void WriteNode::addLiteral(string str) {
+  // Adjacent literals join into one piece of text
+  string& text = fields.empty() ? prefix : fields.back().suffix;
+  text.append(str, 1, str.length() - 2);
+  arguments.push_back(std::move(str));
+}
+void WriteNode::finish() {
+  (fields.empty() ? prefix : fields.back().suffix) += '\n';
+  bound = prefix.length();
+  for (int i = 0; i < fields.size(); ++i)
+    bound += FORMAT_BUFFER + fields[i].suffix.length();
 }
 void WriteNode::printTo(ostream & os) {
   os << endl; indent(_level); os << "(write_stmt ( ";
-  if (id) {
-    os << *id; os << " )";
-  } else if (str) {
-    os << *str; os << " )";
+  for (int i = 0; i < arguments.size(); ++i) {
+    if (i) os << ", ";
+    os << arguments[i];
   }
+  os << " )";
   os << endl; indent(_level); os << "write_stmt)";
 }
 /*void WriteNode::interpret() {
@@ -281,21 +634,55 @@ void WriteNode::printTo(ostream & os) {
     if (variable != symbolTable.end()) {
       cout << variable->first << " = " << variable->second << endl;
     } else {
-      cout << "Variable " << *id << " not found." << endl;
+      cout << "Variable " << id << " not found." << endl;
     }
   } else if (str) {
     // Print the string literal
     cout << *str << endl;
   }
 }*/
-void WriteNode::interpret() {
-  if (id) {
-    auto variable = symbolTable.find(*id);
-    cout << variable->second << endl;
-  } else if (str) {
-    // Print the string literal
-    cout << str->substr(1, str->length() - 2) << endl;
+int WriteNode::format(const float* values, char* text) const {
+  memcpy(text, prefix.data(), prefix.length());
+  int length = prefix.length();
+  for (int i = 0; i < fields.size(); ++i) {
+    // Format straight into the line, skipping locale and stream state
+    length += formatNumber(values[i], text + length);
+    memcpy(text + length, fields[i].suffix.data(), fields[i].suffix.length());
+    length += fields[i].suffix.length();
+  }
+  return length;
+}
+void WriteNode::print(const float* values) {
+  if (fields.empty()) {
+    state->out->sputn(prefix.data(), prefix.length());
+    state->written += prefix.length();
+    return;
   }
+  char line[WRITE_BUFFER];
+  string longLine;
+  char* text = line;
+  if (bound > WRITE_BUFFER) {
+    longLine.resize(bound);
+    text = &longLine[0];
+  }
+  int length = format(values, text);
+  state->out->sputn(text, length);
+  state->written += length;
+}
+ExecStatus WriteNode::interpret() {
+  if (state->trace)
+    state->trace->record(traceId, line, 0.0f);
+  float few[WRITE_BUFFER / FORMAT_BUFFER];
+  vector<float> many;
+  float* values = few;
+  if (fields.size() > WRITE_BUFFER / FORMAT_BUFFER) {
+    many.resize(fields.size());
+    values = many.data();
+  }
+  for (int i = 0; i < fields.size(); ++i)
+    values[i] = state->var(fields[i].local, fields[i].slot);
+  print(values);
+  return EXEC_NORMAL;
 }
 
 // ---------------------------------------------------------------------
@@ -305,10 +692,6 @@ ExpressionNode::ExpressionNode(int level) {
 ExpressionNode::~ExpressionNode() {
   if(printDelete)
     cout << "Deleting ExprNode " << endl;
-	delete firstSimpleExpr;
-	firstSimpleExpr = nullptr;
-  delete secondSimpleExpr;
-  secondSimpleExpr = nullptr;
 }
 ostream& operator<<(ostream& os, ExpressionNode& en) {
   os << endl; indent(en._level); os << "(expression ";
@@ -342,13 +725,13 @@ float ExpressionNode::interpret() {
     float secondValue = secondSimpleExpr->interpret();
     switch (relop) {
       case TOK_EQUALTO:
-        return truth(value - secondValue) ? 1.0f : 0.0f;
+        return truth(value - secondValue) ? 0.0f : 1.0f; // equal when the difference is false
       case TOK_LESSTHAN:
         return value < secondValue ? 1.0f : 0.0f;
       case TOK_GREATERTHAN:
         return value > secondValue ? 1.0f : 0.0f;
       case TOK_NOTEQUALTO:
-        return truth(value - secondValue) ? 0.0f : 1.0f;
+        return truth(value - secondValue) ? 1.0f : 0.0f;
       default:
         break;
     }
@@ -363,14 +746,6 @@ SimpleExpressionNode::SimpleExpressionNode(int level) {
 SimpleExpressionNode::~SimpleExpressionNode() {
   if(printDelete) 
     cout << "Deleting SimpleExpressionNode " << endl;
-  delete firstTerm;
-  firstTerm = nullptr;
-
-  int length = restTerms.size();
-  for (int i = 0; i < length; ++i) {
-    delete restTerms[i];
-    restTerms[i] = nullptr;
-  }
 }
 ostream & operator<<(ostream& os, SimpleExpressionNode& sen) {
   os << endl; indent(sen._level); os << "(simple_exp ";
@@ -402,16 +777,16 @@ float SimpleExpressionNode::interpret() {
   int length = restTerms.size();
   for (int i = 0; i < length; ++i) {
     int op = restSmplExprOps[i];
-    float nextValue = restTerms[i]->interpret();
     switch (op) {
       case TOK_PLUS:
-        value += nextValue;
+        value += restTerms[i]->interpret();
         break;
       case TOK_MINUS:
-        value -= nextValue;
+        value -= restTerms[i]->interpret();
         break;
       case TOK_OR:
-        value = truth(value) || truth(nextValue) ? 1.0f : 0.0f; // Return 1.0 if either value is true, otherwise return 0.0
+        // A true left operand decides the result; skip the right one
+        value = truth(value) || truth(restTerms[i]->interpret()) ? 1.0f : 0.0f;
         break;
       default:
         break;
@@ -427,14 +802,6 @@ TermNode::TermNode(int level) {
 TermNode::~TermNode() {
   if(printDelete) 
     cout << "Deleting TermNode " << endl;
-  delete firstFactor;
-  firstFactor = nullptr;
-
-  int length = restFactors.size();
-  for (int i = 0; i < length; ++i) {
-    delete restFactors[i];
-    restFactors[i] = nullptr;
-  }
 }
 ostream& operator<<(ostream& os, TermNode& tn) {
   os << endl; indent(tn._level); os << "(term ";
@@ -450,6 +817,9 @@ ostream& operator<<(ostream& os, TermNode& tn) {
       case TOK_DIVIDE:
         os << endl; indent(tn._level); os << "/ ";
         break;
+      case TOK_MOD:
+        os << endl; indent(tn._level); os << "MOD ";
+        break;
       case TOK_AND:
         os << endl; indent(tn._level); os << "AND ";
         break;
@@ -466,16 +836,19 @@ float TermNode::interpret() {
   int length = restFactors.size();
   for (int i = 0; i < length; ++i) {
     int op = restTermOps[i];
-    float nextValue = restFactors[i]->interpret();
     switch (op) {
       case TOK_MULTIPLY:
-        value *= nextValue;
+        value *= restFactors[i]->interpret();
         break;
       case TOK_DIVIDE:
-        value /= nextValue;
+        value /= restFactors[i]->interpret();
         break;
       case TOK_MOD:
-        value = static_cast<int>(value) % static_cast<int>(nextValue);
+        value = static_cast<int>(value) % static_cast<int>(restFactors[i]->interpret());
+        break;
+      case TOK_AND:
+        // A false left operand decides the result; skip the right one
+        value = truth(value) && truth(restFactors[i]->interpret()) ? 1.0f : 0.0f;
         break;
       default:
         break;
@@ -485,6 +858,46 @@ float TermNode::interpret() {
 }
 
 // ---------------------------------------------------------------------
+// Deleting an expression recurses once for every parenthesis, subscript,
+// argument list, NOT and MINUS it nests. Past DISPOSE_DEPTH of them the
+// factors below are set aside, and the shallowest dispose() deletes them
+// once it has finished, so no depth MAX_NESTING allows can overflow the
+// stack. Shallower trees are deleted in the same order as always.
+#define DISPOSE_DEPTH 500
+static thread_local int disposing = 0; // dispose() calls under way
+static thread_local vector<unique_ptr<ExpressionNode> > asideExpressions;
+static thread_local vector<unique_ptr<FactorNode> > asideFactors;
+
+template <class T>
+static void dispose(unique_ptr<T>& child, vector<unique_ptr<T> >& aside) {
+  if (disposing >= DISPOSE_DEPTH) {
+    aside.push_back(std::move(child));
+    return;
+  }
+  ++disposing;
+  child.reset();
+  if (disposing == 1) {
+    while (!asideExpressions.empty() || !asideFactors.empty()) {
+      if (!asideExpressions.empty()) {
+        unique_ptr<ExpressionNode> next = std::move(asideExpressions.back());
+        asideExpressions.pop_back();
+        next.reset();
+      } else {
+        unique_ptr<FactorNode> next = std::move(asideFactors.back());
+        asideFactors.pop_back();
+        next.reset();
+      }
+    }
+  }
+  --disposing;
+}
+static void dispose(unique_ptr<ExpressionNode>& child) {
+  dispose(child, asideExpressions);
+}
+static void dispose(unique_ptr<FactorNode>& child) {
+  dispose(child, asideFactors);
+}
+
 FactorNode::~FactorNode() {
   if(printDelete) 
     cout << "Deleting FactorNode " << endl;
@@ -529,33 +942,56 @@ float FloatLitNode::interpret() {
 }
 
 // ---------------------------------------------------------------------
-IdentifierNode::IdentifierNode(int level, string name) {
+IdentifierNode::IdentifierNode(int level, string name, int s) {
   _level = level;
-  id = new string(name);
+  id = std::move(name);
+  slot = s;
 }
 IdentifierNode::~IdentifierNode() {
   if(printDelete) 
     cout << "Deleting IdentifierNode " << endl;
-  delete id;
-  id = nullptr;
 }
 void IdentifierNode::printTo(ostream& os) {
-  os << "( IDENT: " << *id << " ) ";
+  os << "( IDENT: " << id << " ) ";
 }
 float IdentifierNode::interpret() {
-  return symbolTable[*id];
+  return state->var(local, slot);
+}
+
+// ---------------------------------------------------------------------
+IndexedIdentifierNode::IndexedIdentifierNode(int level, string name, ArrayT* a, ExpressionNode* i) {
+  _level = level;
+  id = std::move(name);
+  array = a;
+  index.reset(i);
+}
+IndexedIdentifierNode::~IndexedIdentifierNode() {
+  if(printDelete) 
+    cout << "Deleting IndexedIdentifierNode " << endl;
+  dispose(index);
+}
+void IndexedIdentifierNode::printTo(ostream& os) {
+  os << "( IDENT: " << id << " [";
+  os << *index;
+  os << "] ) ";
+}
+float IndexedIdentifierNode::interpret() {
+  int offset = arrayOffset(id, array, index->interpret(), checked);
+  State* values = state->arrays();
+  if (array->type == TOK_INTEGER)
+    return static_cast<float>(values->ints[array->number][offset]);
+  return values->reals[array->number][offset];
 }
 
 // ---------------------------------------------------------------------
 NestedExpressionNode::NestedExpressionNode(int level, ExpressionNode* en) {
   _level = level;
-  exprPtr = en;
+  exprPtr.reset(en);
 }
 NestedExpressionNode::~NestedExpressionNode() {
   if(printDelete) 
     cout << "Deleting NestedExpressionNode " << endl;
-  delete exprPtr;
-  exprPtr = nullptr;
+  dispose(exprPtr);
 }
 void NestedExpressionNode::printTo(ostream& os) {
   os << "(NESTED_EXPR: ";
@@ -569,13 +1005,12 @@ float NestedExpressionNode::interpret() {
 // ---------------------------------------------------------------------
 NotNode::NotNode(int level, FactorNode* f) {
   _level = level;
-  factor = f;
+  factor.reset(f);
 }
 NotNode::~NotNode() {
   if(printDelete) 
     cout << "Deleting NotNode " << endl;
-  delete factor;
-  factor = nullptr;
+  dispose(factor);
 }
 void NotNode::printTo(ostream& os) {
   os << "(NOT: ";
@@ -590,13 +1025,12 @@ float NotNode::interpret() {
 // ---------------------------------------------------------------------
 MinusNode::MinusNode(int level, FactorNode* f) {
   _level = level;
-  factor = f;
+  factor.reset(f);
 }
 MinusNode::~MinusNode() {
   if(printDelete) 
     cout << "Deleting MinusNode " << endl;
-  delete factor;
-  factor = nullptr;
+  dispose(factor);
 }
 void MinusNode::printTo(ostream& os) {
   os << "(-: ";
@@ -606,3 +1040,24 @@ void MinusNode::printTo(ostream& os) {
 float MinusNode::interpret() {
   return static_cast<float>(-factor->interpret()); // Negate the value of the factor
 }
+
+// ---------------------------------------------------------------------
+FunctionCallNode::FunctionCallNode(int level, SubprogramNode* c) {
+  _level = level;
+  callee = c;
+}
+FunctionCallNode::~FunctionCallNode() {
+  if(printDelete) 
+    cout << "Deleting FunctionCallNode " << endl;
+  for (int i = 0; i < args.size(); ++i)
+    dispose(args[i]);
+}
+void FunctionCallNode::printTo(ostream& os) {
+  os << "( CALL: " << callee->id << " (";
+  for (int i = 0; i < args.size(); ++i)
+    os << *args[i];
+  os << ") ) ";
+}
+float FunctionCallNode::interpret() {
+  return callee->call(args);
+}
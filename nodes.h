@@ -10,7 +10,10 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <memory>
+#include <functional>
 #include "lexer.h"
+#include "state.h"
 
 
 using namespace std;
@@ -18,15 +21,41 @@ using namespace std;
 extern bool printDelete;      // shall we print deleting the tree?
 extern bool printSymbolTable; // shall we print the symbol table?
 
+struct ArrayT; // storage of an ARRAY variable, see parser.h
+struct ProgramTables; // declarations of a program, see parser.h
+
+// Message for an array index outside the declared bounds
+string rangeErrorText(const string& name, ArrayT* array, int index);
+
+// Walking an expression recurses a few frames for each level it nests.
+// Up to SHALLOW_NESTING levels fit any thread's stack; a deeper tree is
+// walked on a stack of NESTING_STACK bytes a level, more than the
+// largest frames of any engine need.
+#define SHALLOW_NESTING 1000
+#define NESTING_STACK 4096
+
+size_t stackFor(int nesting); // a stack for a tree this deep, at least FIBER_STACK
+// Run body, which walks a tree whose expressions nest nesting levels deep
+void onStackFor(int nesting, const function<void()>& body);
+
+// Every node owns its children through unique_ptr, and constructors take
+// ownership of the node pointers they are given. Names are held by value,
+// so short identifiers live inside the node with no separate allocation.
+
 // ---------------------------------------------------------------------
 // Forward declaration of node types
 class ProgramNode;
 class BlockNode;
 class StatementNode;
 class AssignmentNode;
+class ArrayAssignmentNode;
 class CompoundNode;
+class ParallelWhile;
 class IfNode;
 class WhileNode;
+class ForNode;
+class BreakNode;
+class ContinueNode;
 class ReadNode;
 class WriteNode;
 class ExpressionNode;
@@ -36,9 +65,13 @@ class FactorNode;
 class IntLitNode;
 class FloatLitNode;
 class IdentifierNode;
+class IndexedIdentifierNode;
 class NestedExpressionNode;
 class NotNode;
 class MinusNode;
+class SubprogramNode;
+class CallNode;
+class FunctionCallNode;
 
 // ---------------------------------------------------------------------
 
@@ -47,8 +80,10 @@ class MinusNode;
 class ProgramNode {
 public:
     int _level = 0; // recursion level of this node
-    string* id = nullptr; // program name
-    BlockNode* block = nullptr; // block of the program
+    string id; // program name
+    int nesting = 0; // deepest any of its expressions nest
+    unique_ptr<BlockNode> block; // block of the program
+    unique_ptr<ProgramTables> tables; // its variables, arrays and subprograms
     void interpret(); 
     ProgramNode(int level, string name, BlockNode* b);
     ~ProgramNode();
@@ -56,13 +91,13 @@ public:
 ostream& operator<<(ostream&, ProgramNode&); // Node print operator
 
 // ---------------------------------------------------------------------
-// <block> → ( TOK_VAR TOK_IDENT TOK_COLON type TOK_SEMIOLON {[ TOK_IDENT TOK_COLON type TOK_SEMIOLON ]} <compound> ) | <compound>
+// <block> → [ TOK_VAR TOK_IDENT TOK_COLON type TOK_SEMIOLON {[ TOK_IDENT TOK_COLON type TOK_SEMIOLON ]} ] { <subprogram> } <compound>
+// type → TOK_INTEGER | TOK_REAL | TOK_ARRAY TOK_OPENBRACKET bound TOK_DOTDOT bound TOK_CLOSEBRACKET TOK_OF ( TOK_INTEGER | TOK_REAL )
 class BlockNode {
 public:
     int _level = 0; // recursion level of this node
-    /*vector<string*> varNames; // variable names
-    vector<string*> varTypes; // variable types*/ 
-    CompoundNode* compound = nullptr; // statement of the block
+    vector<unique_ptr<SubprogramNode> > subprograms; // procedures and functions, in declaration order
+    unique_ptr<CompoundNode> compound; // statement of the block
     void interpret();
     BlockNode(int level);
     ~BlockNode();
@@ -70,11 +105,45 @@ public:
 ostream& operator<<(ostream&, BlockNode&); // Node print operator
 
 // ---------------------------------------------------------------------
-// <statement> → <assignment> | <compound> | <if> | <while> | <read> | <write>
+// <subprogram> → ( TOK_PROCEDURE TOK_IDENT [ <params> ] | TOK_FUNCTION TOK_IDENT [ <params> ] TOK_COLON ( TOK_INTEGER | TOK_REAL ) ) TOK_SEMICOLON
+//                [ TOK_VAR TOK_IDENT TOK_COLON ( TOK_INTEGER | TOK_REAL ) TOK_SEMICOLON { ... } ] <compound> TOK_SEMICOLON
+// <params> → TOK_OPENPAREN TOK_IDENT TOK_COLON ( TOK_INTEGER | TOK_REAL ) { TOK_SEMICOLON TOK_IDENT TOK_COLON ( TOK_INTEGER | TOK_REAL ) } TOK_CLOSEPAREN
+// A call gets a frame of frameSize floats on State::stack: the value
+// parameters, then the local variables, then the result of a function.
+class SubprogramNode {
+public:
+    int _level = 0; // recursion level of this node
+    string id; // procedure or function name
+    bool isFunction = false; // does a call produce a value?
+    int paramCount = 0; // value parameters, the first slots of the frame
+    int frameSize = 0; // slots of one activation
+    int resultSlot = -1; // where a function's name is assigned, in the frame
+    int line = 0; // source line of the declaration, for limit reports
+    string label; // "PROCEDURE P" or "FUNCTION F", for limit reports
+    unique_ptr<CompoundNode> body; // statements run by a call
+    float call(const vector<unique_ptr<ExpressionNode> >& args); // run one activation
+    SubprogramNode(int level, string name, bool function);
+    ~SubprogramNode();
+};
+ostream& operator<<(ostream&, SubprogramNode&); // Node print operator
+
+// ---------------------------------------------------------------------
+// How control leaves a statement. Loops consume EXEC_BREAK/EXEC_CONTINUE;
+// every other statement passes a non-normal status straight up.
+enum ExecStatus {
+  EXEC_NORMAL = 0, // fall through to the next statement
+  EXEC_BREAK,      // leave the innermost loop
+  EXEC_CONTINUE    // start the next iteration of the innermost loop
+};
+
+// ---------------------------------------------------------------------
+// <statement> → <assignment> | <call> | <compound> | <if> | <while> | <for> | <read> | <write> | <break> | <continue>
 class StatementNode {
 public:
   int _level = 0; // recursion level of this node
-  virtual void interpret() = 0; 
+  int line = 0; // source line the statement starts on
+  int traceId = -1; // number of the statement in a --trace dump
+  virtual ExecStatus interpret() = 0; 
   virtual void printTo(ostream &os) = 0; // method for abstract base class
   virtual ~StatementNode();
 };
@@ -82,37 +151,73 @@ ostream& operator<<(ostream&, StatementNode&); // Node print operator
 
 // ---------------------------------------------------------------------
 // <assignment> → TOK_IDENT TOK_EQUALTO <expression>
-//AssignmentNode(int level, string identifier, ExpressionNode* e)
+//AssignmentNode(int level, string identifier, int s, ExpressionNode* e)
 class AssignmentNode : public StatementNode {
 public:
-    string* id = nullptr; // identifier name
-    ExpressionNode* expr = nullptr; // expression to assign to the identifier
-    void interpret();
-    AssignmentNode(int level, string identifier, ExpressionNode* e);
+    string id; // identifier name
+    int slot = 0; // where the variable lives in State::vars or the frame
+    bool local = false; // is it a local of the running subprogram?
+    unique_ptr<ExpressionNode> expr; // expression to assign to the identifier
+    bool reduction = false; // a sum "V := V + t ..." of a parallel WHILE
+    ExecStatus interpret();
+    ExecStatus reduce(); // log the terms instead (a parallel WHILE's worker)
+    AssignmentNode(int level, string identifier, int s, ExpressionNode* e);
     ~AssignmentNode();
     void printTo(ostream & os);
 };
 
+// ---------------------------------------------------------------------
+// <assignment> → TOK_IDENT TOK_OPENBRACKET <expression> TOK_CLOSEBRACKET TOK_ASSIGN <expression>
+class ArrayAssignmentNode : public StatementNode {
+public:
+    string id; // array name
+    ArrayT* array = nullptr; // declaration of the array, owned by arrayTable
+    unique_ptr<ExpressionNode> index; // element to assign to
+    unique_ptr<ExpressionNode> expr; // expression to assign to the element
+    bool checked = true; // false once the parser proved index in range
+    ExecStatus interpret();
+    ArrayAssignmentNode(int level, string name, ArrayT* a, ExpressionNode* i, ExpressionNode* e);
+    ~ArrayAssignmentNode();
+    void printTo(ostream & os);
+};
+
 // ---------------------------------------------------------------------
 // <compound> → TOK_BEGIN <statement> { TOK_SEMICOLON <statement> } TOK_END
 class CompoundNode : public StatementNode {
 public:
-  vector<StatementNode*> statements; // vector of statements
-  void interpret();
+  vector<unique_ptr<StatementNode> > statements; // vector of statements
+  ExecStatus interpret();
+  ExecStatus runFrom(int first); // statements[first..], their steps already counted
   CompoundNode(int level);
   ~CompoundNode();
   void addStatement(StatementNode* s); // add a statement to the vector
   void printTo(ostream & os);
 };
 
+// ---------------------------------------------------------------------
+// A condition comparing a scalar variable with another or with a
+// literal, tested without walking its ExpressionNode. --profile-use gives
+// one to each hot WHILE whose condition has this shape.
+struct ScalarTest {
+  int relop = 0;              // TOK_EQUALTO, TOK_LESSTHAN, TOK_GREATERTHAN, or TOK_NOTEQUALTO
+  bool leftLocal = false;     // left variable: a local of the running subprogram?
+  int leftSlot = 0;           // left variable's slot
+  bool rightIsVar = false;    // right operand: a variable, or constant?
+  bool rightLocal = false;
+  int rightSlot = 0;
+  float constant = 0.0f;
+  bool test();                // same truth as the ExpressionNode it replaces
+};
+
 // ---------------------------------------------------------------------
 // <if> → TOK_IF <expression> TOK_THEN <statement> [ TOK_ELSE <statement> ]
 class IfNode : public StatementNode {
 public:
-    ExpressionNode* expr = nullptr; // expression to evaluate
-    StatementNode* thenStatement = nullptr; // statement to execute if expr == true
-    StatementNode* elseStatement = nullptr; // statement to execute if expr == false
-    void interpret();
+    unique_ptr<ExpressionNode> expr; // expression to evaluate
+    unique_ptr<StatementNode> thenStatement; // statement to execute if expr == true
+    unique_ptr<StatementNode> elseStatement; // statement to execute if expr == false
+    int site = -1; // counters of a --profile-gen run, in State::profile
+    ExecStatus interpret();
     IfNode(int level, ExpressionNode* e, StatementNode* ts, StatementNode* es);
     ~IfNode();
     void printTo(ostream & os);
@@ -122,33 +227,113 @@ public:
 // <while> → TOK_WHILE <expression> <statement>
 class WhileNode : public StatementNode {
 public:
-    ExpressionNode* expr = nullptr; // expression to evaluate
-    StatementNode* statement = nullptr; // statement to execute while expr == true
-    void interpret();
+    unique_ptr<ExpressionNode> expr; // expression to evaluate
+    unique_ptr<StatementNode> statement; // statement to execute while expr == true
+    int site = -1; // counters of a --profile-gen run, in State::profile
+    unique_ptr<ScalarTest> fast; // replaces expr in a hot loop (--profile-use)
+    unique_ptr<ParallelWhile> parallel; // runs independent iterations at once (--auto-parallel)
+    ExecStatus interpret();
+    ExecStatus iterate(); // the loop itself, from its next test of expr
     WhileNode(int level, ExpressionNode* e, StatementNode* s);
     ~WhileNode();
     void printTo(ostream & os);
 };
 
+// ---------------------------------------------------------------------
+// <for> → TOK_FOR TOK_IDENT TOK_ASSIGN <expression> ( TOK_TO | TOK_DOWNTO ) <expression> TOK_DO <statement>
+class ForNode : public StatementNode {
+public:
+    string id; // loop counter name
+    int slot = 0; // where the counter lives in State::vars or the frame
+    bool local = false; // is it a local of the running subprogram?
+    unique_ptr<ExpressionNode> startExpr; // initial counter value, evaluated once
+    unique_ptr<ExpressionNode> endExpr; // final counter value, evaluated once
+    bool downto = false; // count down instead of up?
+    unique_ptr<StatementNode> statement; // statement to execute for each counter value
+    ExecStatus interpret();
+    ExecStatus iterate(int first, int last); // the loop from counter value first, which is in range
+    ForNode(int level, string name, int sl, ExpressionNode* s, ExpressionNode* e, bool down, StatementNode* st);
+    ~ForNode();
+    void printTo(ostream & os);
+};
+
+// ---------------------------------------------------------------------
+// <break> → TOK_BREAK
+class BreakNode : public StatementNode {
+public:
+    ExecStatus interpret();
+    BreakNode(int level);
+    ~BreakNode();
+    void printTo(ostream & os);
+};
+
+// ---------------------------------------------------------------------
+// <continue> → TOK_CONTINUE
+class ContinueNode : public StatementNode {
+public:
+    ExecStatus interpret();
+    ContinueNode(int level);
+    ~ContinueNode();
+    void printTo(ostream & os);
+};
+
+// ---------------------------------------------------------------------
+// <call> → TOK_IDENT [ <args> ]
+// <args> → TOK_OPENPAREN <expression> { TOK_COMMA <expression> } TOK_CLOSEPAREN
+class CallNode : public StatementNode {
+public:
+    SubprogramNode* callee = nullptr; // procedure to run, owned by its BlockNode
+    vector<unique_ptr<ExpressionNode> > args; // one value per parameter
+    ExecStatus interpret();
+    CallNode(int level, SubprogramNode* c);
+    ~CallNode();
+    void printTo(ostream & os);
+};
+
 // ---------------------------------------------------------------------
 // <read> → TOK_READ TOK_OPENPAREN TOK_IDENT TOK_CLOSEPAREN
 class ReadNode : public StatementNode {
 public:
-    string* id = nullptr; // identifier name
-    void interpret();
-    ReadNode(int level, string name);
+    string id; // identifier name
+    int slot = 0; // where the variable lives in State::vars or the frame
+    bool local = false; // is it a local of the running subprogram?
+    ExecStatus interpret();
+    ReadNode(int level, string name, int s);
     ~ReadNode();
     void printTo(ostream & os);
 };
 
 // ---------------------------------------------------------------------
-// <write> → TOK_WRITE TOK_OPENPAREN ( TOK_IDENT | TOK_STRINGLIT ) TOK_CLOSEPAREN
+// <write> → TOK_WRITE TOK_OPENPAREN <write_arg> { TOK_COMMA <write_arg> } TOK_CLOSEPAREN
+// <write_arg> → TOK_IDENT | TOK_STRINGLIT
+// The arguments print on one line. The parser turns them into a plan:
+// the literal text before the first variable, then each variable with
+// the literal text after it, quotes already stripped and the newline in
+// place, so a run only formats the numbers between fixed pieces.
+#define WRITE_BUFFER 256 // stack room for one WRITE's line
+
+struct WriteField {
+  string id; // identifier name
+  int slot = -1; // where the variable lives in State::vars or the frame
+  bool local = false; // is it a local of the running subprogram?
+  string suffix; // literal text printed after the variable
+};
+
 class WriteNode : public StatementNode {
 public:
-  string* id = nullptr; // identifier name
-  string* str = nullptr; // string literal
-  void interpret();
-  WriteNode(int level, string name, string str);
+  vector<string> arguments; // identifiers and quoted literals as written
+  string prefix; // literal text printed before the first variable
+  vector<WriteField> fields; // the variables, in order
+  int bound = 0; // most bytes one execution prints
+  void addVariable(string name, int slot, bool local);
+  void addLiteral(string str); // str with its quotes
+  void finish(); // end the line once every argument is added
+  // Put the line into text, which has room for bound bytes, given the
+  // value of each field. Returns its length.
+  int format(const float* values, char* text) const;
+  void print(const float* values); // format and send to the output at once
+  ExecStatus interpret();
+  WriteNode(int level);
   ~WriteNode();
   void printTo(ostream & os);
 };
@@ -159,8 +344,8 @@ class ExpressionNode {
 public:
   int _level = 0; // recursion level of this node
   int relop = 0; // TOK_EQUALTO, TOK_LESSTHAN, TOK_GREATERTHAN, or TOK_NOTEQUALTO
-  SimpleExpressionNode* firstSimpleExpr = nullptr; // first simple expression
-  SimpleExpressionNode* secondSimpleExpr = nullptr; // second simple expression
+  unique_ptr<SimpleExpressionNode> firstSimpleExpr; // first simple expression
+  unique_ptr<SimpleExpressionNode> secondSimpleExpr; // second simple expression
   float interpret();
   ExpressionNode(int level);
   ~ExpressionNode();
@@ -172,9 +357,9 @@ ostream& operator<<(ostream&, ExpressionNode&); // Node print operator
 class SimpleExpressionNode {
 public:
   int _level = 0; // recursion level of this node
-  TermNode* firstTerm = nullptr; // first term
+  unique_ptr<TermNode> firstTerm; // first term
   vector<int> restSmplExprOps; // vector of TOK_ADD, TOK_MINUS, or TOK_OR operators
-  vector<TermNode*> restTerms; // vector of terms
+  vector<unique_ptr<TermNode> > restTerms; // vector of terms
   float interpret();
   SimpleExpressionNode(int level);
   ~SimpleExpressionNode();
@@ -183,13 +368,13 @@ ostream& operator<<(ostream&, SimpleExpressionNode&); // Node print operator
 
 
 // ---------------------------------------------------------------------
-// <term> → <factor> { ( TOK_MULTIPLY | TOK_DIVIDE | TOK_MOD ) <factor> }
+// <term> → <factor> { ( TOK_MULTIPLY | TOK_DIVIDE | TOK_MOD | TOK_AND ) <factor> }
 class TermNode {
 public:
   int _level = 0; // recursion level of this node
-  FactorNode* firstFactor = nullptr; // first factor
-  vector<int> restTermOps; // vector of TOK_MULTIPLY, TOK_DIVIDE, or TOK_MOD operators
-  vector<FactorNode*> restFactors; // vector of factors
+  unique_ptr<FactorNode> firstFactor; // first factor
+  vector<int> restTermOps; // vector of TOK_MULTIPLY, TOK_DIVIDE, TOK_MOD, or TOK_AND operators
+  vector<unique_ptr<FactorNode> > restFactors; // vector of factors
   float interpret();
   TermNode(int level);
   ~TermNode();
@@ -197,7 +382,7 @@ public:
 ostream& operator<<(ostream&, TermNode&); // Node print operator
 
 // ---------------------------------------------------------------------
-// <factor> → TOK_IDENT | TOK_INTLIT | TOK_FLOATLIT | TOK_OPENPAREN <expression> TOK_CLOSEPAREN | TOK_NOT <factor> | TOK_MINUS <factor>
+// <factor> → TOK_IDENT [ TOK_OPENBRACKET <expression> TOK_CLOSEBRACKET | <args> ] | TOK_INTLIT | TOK_FLOATLIT | TOK_OPENPAREN <expression> TOK_CLOSEPAREN | TOK_NOT <factor> | TOK_MINUS <factor>
 class FactorNode {
 public:
   int _level = 0; // recursion level of this node
@@ -227,16 +412,30 @@ public:
 
 class IdentifierNode : public FactorNode {
 public:
-    string* id = nullptr; // identifier name
+    string id; // identifier name
+    int slot = 0; // where the variable lives in State::vars or the frame
+    bool local = false; // is it a local of the running subprogram?
     float interpret();
-    IdentifierNode(int level, string name);
+    IdentifierNode(int level, string name, int s);
     ~IdentifierNode();
     void printTo(ostream & os);
 };
 
+class IndexedIdentifierNode : public FactorNode {
+public:
+    string id; // array name
+    ArrayT* array = nullptr; // declaration of the array, owned by arrayTable
+    unique_ptr<ExpressionNode> index; // element to read
+    bool checked = true; // false once the parser proved index in range
+    float interpret();
+    IndexedIdentifierNode(int level, string name, ArrayT* a, ExpressionNode* i);
+    ~IndexedIdentifierNode();
+    void printTo(ostream & os);
+};
+
 class NestedExpressionNode : public FactorNode {
 public:
-    ExpressionNode* exprPtr = nullptr; // pointer to the expression
+    unique_ptr<ExpressionNode> exprPtr; // the nested expression
     float interpret();
     NestedExpressionNode(int level, ExpressionNode* en);
     ~NestedExpressionNode();
@@ -245,7 +444,7 @@ public:
 
 class NotNode : public FactorNode {
 public:
-    FactorNode* factor; // pointer to the factor
+    unique_ptr<FactorNode> factor; // the factor
     float interpret();
     NotNode(int level, FactorNode* f);
     ~NotNode();
@@ -254,11 +453,21 @@ public:
 
 class MinusNode : public FactorNode {
 public:
-    FactorNode* factor; // pointer to the factor
+    unique_ptr<FactorNode> factor; // the factor
     float interpret();
     MinusNode(int level, FactorNode* f);
     ~MinusNode();
     void printTo(ostream & os);
 };
 
+class FunctionCallNode : public FactorNode {
+public:
+    SubprogramNode* callee = nullptr; // function to run, owned by its BlockNode
+    vector<unique_ptr<ExpressionNode> > args; // one value per parameter
+    float interpret();
+    FunctionCallNode(int level, SubprogramNode* c);
+    ~FunctionCallNode();
+    void printTo(ostream & os);
+};
+
 #endif /* NODES_H */
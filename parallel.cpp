@@ -0,0 +1,185 @@
+//*****************************************************************************
+// purpose: Parallel execution of one program over many input records
+//          Work-stealing thread pool with output merged in record order
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#include "parallel.h"
+#include "parser.h"
+#include "input.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+
+// ---------------------------------------------------------------------
+// Record numbers waiting to run on one worker. The owner takes from the
+// front; idle workers steal from the back, so owner and thief rarely
+// meet on the same record range.
+struct WorkQueue {
+  mutex lock;
+  deque<size_t> records;
+  bool take(size_t& record) {
+    lock_guard<mutex> guard(lock);
+    if (records.empty())
+      return false;
+    record = records.front();
+    records.pop_front();
+    return true;
+  }
+  bool steal(size_t& record) {
+    lock_guard<mutex> guard(lock);
+    if (records.empty())
+      return false;
+    record = records.back();
+    records.pop_back();
+    return true;
+  }
+};
+
+// ---------------------------------------------------------------------
+// Everything the workers share. Finished output waits in results until
+// every earlier record has been written.
+struct RecordRun {
+  ProgramNode* root = nullptr;
+  vector<const char*> starts;          // record text, inside the file buffer
+  vector<long> lengths;
+  vector<string> results;              // framed output of each record
+  unique_ptr<atomic<bool>[]> done;     // results[i] is complete
+  size_t nextToWrite = 0;              // only touched by the writing worker
+  atomic<bool> writing{false};         // some worker is writing output
+  Limits limits;                       // applied to every record
+  atomic<int> status{EXIT_SUCCESS};    // largest exit code of any record
+  vector<unique_ptr<WorkQueue> > queues;
+  void work(int self);
+  void runOne(size_t record, InputReader& reader);
+  void flush();
+};
+
+// Interpret one record in the calling thread's State
+void RecordRun::runOne(size_t record, InputReader& reader) {
+  stringbuf out;
+  state->reset(*root->tables);
+  state->out = &out;
+  reader.openBuffer(starts[record], lengths[record]);
+  // Same framing as a single run: banner, output, closing blank line
+  out.sputn("*** Interpret the Tree ***\n", 27);
+  try {
+    root->interpret();
+    out.sputc('\n');
+  } catch (RuntimeError& stop) {
+    string banner = errorBanner(stop.message);
+    out.sputn(banner.data(), banner.size());
+    int seen = status.load();
+    while (seen < stop.status && !status.compare_exchange_weak(seen, stop.status))
+      ;
+  }
+  results[record] = out.str();
+  done[record].store(true);
+}
+
+// Write every finished record that is next in file order. Whoever wins
+// the writing flag drains the ready prefix; the others return at once.
+// After letting go of the flag the writer looks again, since a record
+// finished while it was writing may have found the flag taken.
+void RecordRun::flush() {
+  for (;;) {
+    bool expected = false;
+    if (!writing.compare_exchange_strong(expected, true))
+      return;
+    size_t n = nextToWrite;
+    while (n < results.size() && done[n].load()) {
+      cout.rdbuf()->sputn(results[n].data(), results[n].size());
+      string().swap(results[n]); // free it now, the run may be long
+      ++n;
+    }
+    nextToWrite = n;
+    writing.store(false);
+    if (n >= results.size() || !done[n].load())
+      return;
+  }
+}
+
+void RecordRun::work(int self) {
+  onStackFor(root->nesting, [&] {
+    State mine;
+    InputReader reader;
+    mine.input = &reader;
+    mine.limits = limits;
+    state = &mine;
+    size_t record;
+    for (;;) {
+      bool found = queues[self]->take(record);
+      for (int i = 1; !found && i < queues.size(); ++i)
+        found = queues[(self + i) % queues.size()]->steal(record);
+      if (!found)
+        break; // nothing is ever added, so every queue is drained
+      runOne(record, reader);
+      flush();
+    }
+    state = nullptr;
+  });
+}
+
+// ---------------------------------------------------------------------
+int runRecords(ProgramNode* root, const char* recordsPath, int threads, const Limits& limits) {
+  ifstream file(recordsPath, ios::binary);
+  if (!file) {
+    cout << "ERROR - cannot open " << recordsPath << endl;
+    return EXIT_FAILURE;
+  }
+  ostringstream contents;
+  contents << file.rdbuf();
+  string text = contents.str();
+
+  RecordRun run;
+  run.root = root;
+  run.limits = limits;
+  size_t at = 0;
+  while (at < text.size()) {
+    size_t end = text.find('\n', at);
+    if (end == string::npos)
+      end = text.size();
+    size_t first = text.find_first_not_of(" \t\r,", at);
+    if (first < end) { // blank lines are not records
+      run.starts.push_back(text.data() + at);
+      run.lengths.push_back(end - at);
+    }
+    at = end + 1;
+  }
+  size_t count = run.starts.size();
+  run.results.resize(count);
+  run.done.reset(new atomic<bool>[count]);
+  for (size_t i = 0; i < count; ++i)
+    run.done[i] = false;
+
+  if (threads <= 0)
+    threads = thread::hardware_concurrency();
+  if (threads <= 0)
+    threads = 1;
+  if (threads > count)
+    threads = count > 0 ? count : 1;
+
+  // Each worker starts on a contiguous share, so output is mostly ready
+  // in order; stealing evens out records that run long.
+  for (int t = 0; t < threads; ++t) {
+    run.queues.push_back(unique_ptr<WorkQueue>(new WorkQueue()));
+    for (size_t r = count * t / threads; r < count * (t + 1) / threads; ++r)
+      run.queues[t]->records.push_back(r);
+  }
+  vector<thread> pool;
+  for (int t = 1; t < threads; ++t)
+    pool.push_back(thread(&RecordRun::work, &run, t));
+  run.work(0);
+  for (int t = 0; t < pool.size(); ++t)
+    pool[t].join();
+  run.flush(); // no-op unless the last record raced the last writer
+
+  cout.flush();
+  return run.status;
+}
@@ -0,0 +1,22 @@
+//*****************************************************************************
+// purpose: Parallel execution of one program over many input records
+//          Work-stealing thread pool with output merged in record order
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "nodes.h"
+
+// Run the parsed program once per line of recordsPath on threads worker
+// threads (0: one per core). Each line holds the values its run READs.
+// Every run has its own State, so the shared tree is only read. Output
+// is exactly what single runs fed each record would print, in file
+// order, and each record runs under its own copy of limits. Returns
+// EXIT_FAILURE if the file cannot be read, otherwise the largest exit
+// code of any record (EXIT_SUCCESS when every record ran to the end).
+int runRecords(ProgramNode* root, const char* recordsPath, int threads, const Limits& limits);
+
+#endif /* PARALLEL_H */
@@ -7,29 +7,37 @@
 
 #include "parser.h"
 #include "nodes.h"
+#include "frontend.h"
 #include <stdlib.h>
+#include <limits.h>
 #include <iostream>
+#include <atomic>
 
 using namespace std;
 
 // Forward declarations of first_of functions
 
 bool first_of_program();            // program should start with TOK_PROGRAM
-bool first_of_block();              // block should start with TOK_VAR or TOK_BEGIN
-bool first_of_statement();          // statement should start with TOK_IDENT, TOK_BEGIN, TOK_IF, TOK_WHILE, TOK_READ, or TOK_WRITE
+bool first_of_block();              // block should start with TOK_VAR, TOK_PROCEDURE, TOK_FUNCTION, or TOK_BEGIN
+bool first_of_statement();          // statement should start with TOK_IDENT, TOK_BEGIN, TOK_IF, TOK_WHILE, TOK_FOR, TOK_READ, TOK_WRITE, TOK_BREAK, or TOK_CONTINUE
 bool first_of_compound_statement(); // compound statement should start with TOK_BEGIN
 bool first_of_expression();         // expression should start with TOK_IDENT, TOK_INTLIT, TOK_FLOATLIT, or TOK_OPENPAREN
-bool first_of_simple_expression();  // simple expression should start with TOK_IDENT, TOK_INTLIT, TOK_FLOATLIT, or TOK_OPENPAREN
-bool first_of_term();               // term should start with TOK_IDENT, TOK_INTLIT, TOK_FLOATLIT, or TOK_OPENPAREN
-bool first_of_factor();             // factor should start with TOK_IDENT, TOK_INTLIT, TOK_FLOATLIT, or TOK_OPENPAREN
+void error();                       // report a syntax error and stop
 
-int nextToken = 0;            // hold nextToken returned by lex
+thread_local int nextToken = 0; // hold nextToken returned by lex
+thread_local const char* lexeme = ""; // text of nextToken
+thread_local int tokenLine = 1; // line of nextToken
+int parseThreads = 0;         // threads parsing the main block; 0 or 1 parse it in line
 bool printParse = false;      // shall we print the parse tree?
 bool printTree = false;
 
+//*****************************************************************************
+// Declarations of the program being parsed
+ProgramTables parsedTables;
+
 //*****************************************************************************
 // Holds variable names and their types and values
-symbolTableT symbolTable;
+symbolTableT& symbolTable = parsedTables.symbols;
 // Determine if a symbol is in the symbol table
 bool inSymbolTable(string idName) {
   symbolTableT::iterator it;
@@ -38,18 +46,203 @@ bool inSymbolTable(string idName) {
   return !(it == symbolTable.end());
 }
 
+//*****************************************************************************
+// Holds array names and their storage
+arrayTableT& arrayTable = parsedTables.arrays;
+// Determine if a symbol is an array
+bool inArrayTable(string idName) {
+  return arrayTable.find(idName) != arrayTable.end();
+}
+
+//*****************************************************************************
+// Holds procedure and function names and their declarations
+subprogramTableT& subprogramTable = parsedTables.subprograms;
+// Determine if a symbol names a procedure or function
+bool inSubprogramTable(string idName) {
+  return subprogramTable.find(idName) != subprogramTable.end();
+}
+
+// The subprogram whose body is being parsed, and its parameters and
+// local variables by frame slot. Locals hide globals of the same name.
+static thread_local SubprogramNode* currentSubprogram = nullptr;
+static thread_local map<string, int> localTable;
+
+// Find the scalar variable name: a local of the subprogram being parsed
+// or a global. False if no such variable is declared.
+static bool lookupVariable(const string& name, int& slot, bool& local) {
+  if (currentSubprogram) {
+    map<string, int>::iterator it = localTable.find(name);
+    if (it != localTable.end()) {
+      slot = it->second;
+      local = true;
+      return true;
+    }
+  }
+  symbolTableT::iterator it = symbolTable.find(name);
+  if (it == symbolTable.end())
+    return false;
+  slot = it->second;
+  local = false;
+  return true;
+}
+
+// Is name an array here, and not hidden by a local?
+static bool isArray(const string& name) {
+  if (currentSubprogram && localTable.count(name))
+    return false;
+  return inArrayTable(name);
+}
+
+// Runs each statement of the main block as it is parsed (--stream)
+void (*streamStatement)(StatementNode* stmt) = nullptr;
+
 // Which tree level are we currently in?  Setting this to -1
 // means the top-level expression is at level 0.
-static int level = -1;
+static thread_local int level = -1;
+
+// How deeply the expression being parsed nests parentheses, subscripts,
+// arguments, NOT and MINUS; no more than MAX_NESTING
+static thread_local int nesting = 0;
+
+// The deepest nesting in the program being parsed, on any thread
+static atomic<int> deepest{0};
+
+// How many WHILE/FOR bodies enclose the statement being parsed?
+// BREAK and CONTINUE are only legal when this is positive.
+static thread_local int loopDepth = 0;
+
+// A FOR loop whose body is being parsed. Array accesses indexed by its
+// counter are collected here; when the loop ends and its literal bounds
+// fit the array, and nothing in the body wrote the counter, their bounds
+// checks are dropped.
+struct IndexUse {
+  ArrayT* array;  // array being indexed
+  bool* checked;  // the node's bounds-check flag
+};
+struct ForContext {
+  string counter;            // loop counter name
+  bool constantBounds;       // are both bounds integer literals?
+  int low, high;             // counter range when constantBounds
+  bool counterWritten;       // body assigns or reads into the counter
+  bool local;                // is the counter a local of a subprogram?
+  vector<IndexUse> uses;     // accesses indexed by the bare counter
+};
+static thread_local vector<ForContext> forContexts; // innermost loop last
+
+// Note that the body of every enclosing loop counting with name writes it
+static void counterWritten(const string& name) {
+  for (int i = 0; i < forContexts.size(); ++i)
+    if (forContexts[i].counter == name)
+      forContexts[i].counterWritten = true;
+}
+
+// A call may assign any global, so no loop with a global counter can
+// trust it any more. Locals are out of the callee's reach.
+static void globalsWritten() {
+  for (int i = 0; i < forContexts.size(); ++i)
+    if (!forContexts[i].local)
+      forContexts[i].counterWritten = true;
+}
+
+// If expr is nothing but an integer literal (possibly negated), store it
+static bool constantInteger(ExpressionNode* expr, int& value) {
+  if (expr->relop != 0 || !expr->firstSimpleExpr->restTerms.empty())
+    return false;
+  TermNode* term = expr->firstSimpleExpr->firstTerm.get();
+  if (!term->restFactors.empty())
+    return false;
+  FactorNode* factor = term->firstFactor.get();
+  int sign = 1;
+  if (MinusNode* minus = dynamic_cast<MinusNode*>(factor)) {
+    sign = -1;
+    factor = minus->factor.get();
+  }
+  IntLitNode* literal = dynamic_cast<IntLitNode*>(factor);
+  if (literal == nullptr)
+    return false;
+  value = sign * static_cast<int>(literal->int_literal);
+  return true;
+}
+
+// If expr is nothing but a variable name, return it
+static string* bareIdentifier(ExpressionNode* expr) {
+  if (expr->relop != 0 || !expr->firstSimpleExpr->restTerms.empty())
+    return nullptr;
+  TermNode* term = expr->firstSimpleExpr->firstTerm.get();
+  if (!term->restFactors.empty())
+    return nullptr;
+  IdentifierNode* ident = dynamic_cast<IdentifierNode*>(term->firstFactor.get());
+  return ident ? &ident->id : nullptr;
+}
+
+// Decide what can be known about index into array at parse time: a
+// literal index is checked now, a FOR counter is handed to its loop.
+static void proveIndex(ArrayT* array, ExpressionNode* index, bool* checked) {
+  int value;
+  if (constantInteger(index, value)) {
+    if (value < array->low || value > array->high)
+      error();
+    *checked = false;
+    return;
+  }
+  string* name = bareIdentifier(index);
+  if (name == nullptr)
+    return;
+  for (int i = forContexts.size() - 1; i >= 0; --i) {
+    if (forContexts[i].counter == *name) {
+      IndexUse use = { array, checked };
+      forContexts[i].uses.push_back(use);
+      return;
+    }
+  }
+}
+
+// Tokens lexed ahead that lex() hands out before going back to the
+// lexer. A speculative run is a chunk of the main block parsed on its
+// own: its end reads as TOK_EOF, and a syntax error in it is thrown to
+// parse_statements() instead of being reported.
+static thread_local TokenRun* run = nullptr;
+static thread_local bool speculative = false;
+
+void lex_from(TokenRun* tokens) {
+  run = tokens;
+  run->next = 0;
+}
+
+void TokenRun::add(int token, const char* text, int line) {
+  tokens.push_back(token);
+  lines.push_back(line);
+  starts.push_back(lexemes.size());
+  lexemes.append(text);
+  lexemes.push_back('\0');
+}
 
-// Handle syntax errors
+// Handle syntax errors. Whoever started the parse reports them; a
+// chunk parsed speculatively is parsed again, so its message is unused.
 void error() {
-  cout << endl << "===========================" << endl;
-  cout << "ERROR near: " << yytext;
-  cout << endl << "===========================" << endl;
-  if (yyin)
-    fclose(yyin);
-  exit(EXIT_FAILURE);
+  if (speculative)
+    throw SyntaxError();
+  throw SyntaxError{string("ERROR near: ") + lexeme};
+}
+
+// Count the level of nesting nextToken opens, keep the deepest, and stop
+// an expression nested deeper than MAX_NESTING
+static void nest() {
+  int seen = deepest.load(memory_order_relaxed);
+  if (++nesting <= seen)
+    return;
+  if (nesting <= MAX_NESTING) {
+    while (nesting > seen && !deepest.compare_exchange_weak(seen, nesting, memory_order_relaxed))
+      ;
+    return;
+  }
+  if (speculative)
+    throw SyntaxError();
+  throw SyntaxError{string("ERROR - expression nested too deeply (more than ") + to_string(MAX_NESTING) + " levels) near: " + lexeme};
+}
+
+int deepest_nesting() {
+  return deepest;
 }
 //*****************************************************************************
 // Print each level with appropriate indentation
@@ -61,34 +254,52 @@ void indent() {
 // Announce what the lexical analyzer has found
 void output() {
   indent();
-  cout << "---> FOUND " << yytext << endl;
+  cout << "---> FOUND " << lexeme << endl;
 }
 //*****************************************************************************
 // Read the next token from the input stream
 int lex() {
-  nextToken = yylex();
-
-  if (nextToken == TOK_EOF) {
-      // save a "lexeme" into yytext
-      yytext[0] = 'E';
-      yytext[1] = 'O';
-      yytext[2] = 'F';
-      yytext[3] = 0;
+  if (run && run->next < run->tokens.size()) {
+    int i = run->next++;
+    nextToken = run->tokens[i];
+    lexeme = run->lexemes.data() + run->starts[i];
+    tokenLine = run->lines[i];
+  } else if (speculative) {
+    nextToken = TOK_EOF;
+    lexeme = "EOF";
+  } else {
+    run = nullptr;
+    nextToken = yylex();
+
+    if (nextToken == TOK_EOF) {
+        // save a "lexeme" into yytext
+        yytext[0] = 'E';
+        yytext[1] = 'O';
+        yytext[2] = 'F';
+        yytext[3] = 0;
+    }
+    lexeme = yytext;
+    tokenLine = line_number;
   }
   if(printParse) {
     // Tell us about the token and lexeme
     indent();
     cout << "Next token is: ";
     switch(nextToken) {
+    case TOK_ARRAY:       cout << "TOK_ARRAY";       break;
     case TOK_BEGIN:       cout << "TOK_BEGIN";       break;
     case TOK_BREAK:       cout << "TOK_BREAK";       break;
     case TOK_CONTINUE:    cout << "TOK_CONTINUE";    break;
+    case TOK_DO:          cout << "TOK_DO";          break;
     case TOK_DOWNTO:      cout << "TOK_DOWNTO";      break;
     case TOK_ELSE:        cout << "TOK_ELSE";        break;
     case TOK_END:         cout << "TOK_END";         break;
     case TOK_FOR:         cout << "TOK_FOR";         break;
     case TOK_IF:          cout << "TOK_IF";          break;
     case TOK_LET:         cout << "TOK_LET";         break;
+    case TOK_OF:          cout << "TOK_OF";          break;
+    case TOK_PROCEDURE:   cout << "TOK_PROCEDURE";   break;
+    case TOK_FUNCTION:    cout << "TOK_FUNCTION";    break;
     case TOK_PROGRAM:     cout << "TOK_PROGRAM";     break;
     case TOK_READ:        cout << "TOK_READ";        break;
     case TOK_THEN:        cout << "TOK_THEN";        break;
@@ -104,6 +315,10 @@ int lex() {
     case TOK_COLON:       cout << "TOK_COLON";       break;
     case TOK_OPENPAREN:   cout << "TOK_OPENPAREN";   break;
     case TOK_CLOSEPAREN:  cout << "TOK_CLOSEPAREN";  break;
+    case TOK_OPENBRACKET: cout << "TOK_OPENBRACKET"; break;
+    case TOK_CLOSEBRACKET: cout << "TOK_CLOSEBRACKET"; break;
+    case TOK_DOTDOT:      cout << "TOK_DOTDOT";      break;
+    case TOK_COMMA:       cout << "TOK_COMMA";       break;
 
     case TOK_PLUS:        cout << "TOK_PLUS";        break;
     case TOK_MINUS:       cout << "TOK_MINUS";       break;
@@ -127,10 +342,36 @@ int lex() {
     
     default: error();
     }
-    cout << ", Next lexeme is: " << yytext << endl;
+    cout << ", Next lexeme is: " << lexeme << endl;
   }
   return nextToken;
 }
+//*****************************************************************************
+// Parse one program from source. A syntax error leaves the parser and the
+// tables anywhere, so everything starts over here.
+ProgramNode* parse_program(FILE* source)
+{
+  symbolTable.clear();
+  arrayTable.clear();
+  subprogramTable.clear();
+  currentSubprogram = nullptr;
+  localTable.clear();
+  level = -1;
+  nesting = 0;
+  deepest = 0;
+  loopDepth = 0;
+  forContexts.clear();
+  run = nullptr;
+  yylex_destroy(); // drop what a failed parse left buffered
+  yyin = source;
+  line_number = 1;
+
+  lex();  // prime the pump (get first token)
+  ProgramNode* root = program();
+  yylex_destroy(); // the lexer's buffers, until the next parse
+  return root;
+}
+
 //*****************************************************************************
 // Parses strings in the language generated by the rule:
 // <program> → TOK_PROGRAM TOK_IDENT TOK_SEMICOLON <block>
@@ -151,7 +392,7 @@ ProgramNode* program()
 
   if (nextToken == TOK_IDENT) {
     if(printParse) output();
-    programName = yytext;
+    programName = lexeme;
     lex(); // Read past the identifier
   } else {
     error();
@@ -164,7 +405,7 @@ ProgramNode* program()
     error();
   }
     
-  BlockNode* blockPtr = block();
+  unique_ptr<BlockNode> blockPtr(block());
 
   if (nextToken == TOK_EOF) {
     if(printParse) output();
@@ -179,7 +420,13 @@ ProgramNode* program()
     cout << "Exit <program>" << endl;
   }
 
-  ProgramNode* newProgramNode = new ProgramNode(level, programName, blockPtr);
+  ProgramNode* newProgramNode = new ProgramNode(level, programName, blockPtr.release());
+  newProgramNode->nesting = deepest;
+  // Swapping keeps every ArrayT where the nodes point to it
+  newProgramNode->tables.reset(new ProgramTables);
+  newProgramNode->tables->symbols.swap(symbolTable);
+  newProgramNode->tables->arrays.swap(arrayTable);
+  newProgramNode->tables->subprograms.swap(subprogramTable);
   return newProgramNode;
 }
 bool first_of_program() 
@@ -189,7 +436,8 @@ bool first_of_program()
 
 //*****************************************************************************
 // Parses strings in the language generated by the rule:
-// <block> → ( TOK_VAR TOK_IDENT TOK_COLON type TOK_SEMIOLON {[ TOK_IDENT TOK_COLON type TOK_SEMIOLON ]} <compound> ) | <compound>
+// <block> → [ TOK_VAR TOK_IDENT TOK_COLON type TOK_SEMIOLON {[ TOK_IDENT TOK_COLON type TOK_SEMIOLON ]} ] { <subprogram> } <compound>
+// type → TOK_INTEGER | TOK_REAL | <array_type>
 BlockNode* block() 
 {
   if (!first_of_block())
@@ -201,16 +449,16 @@ BlockNode* block()
   }
 
   level = level + 1;
-  BlockNode* newBlockNode = new BlockNode(level);
+  unique_ptr<BlockNode> newBlockNode(new BlockNode(level));
 
   if (nextToken == TOK_VAR) {
     if(printParse) output();
     lex(); // Read past TOK_VAR
 
     while (nextToken == TOK_IDENT) {
-      std::string *varName = new std::string(yytext);
+      std::string varName(lexeme);
       if(printParse) output();
-      if (inSymbolTable(*varName)) {
+      if (inSymbolTable(varName) || inSubprogramTable(varName)) {
         error();
       }
       lex(); // Read past the identifier
@@ -222,19 +470,23 @@ BlockNode* block()
         error();
       }
 
-      if (nextToken == TOK_INTEGER || nextToken == TOK_REAL) {
-        if(printParse) output(); // Read past the type
-      } else {
+      if (inArrayTable(varName)) {
         error();
       }
 
-      std::string *varType = new std::string(yytext);
+      if (nextToken == TOK_INTEGER || nextToken == TOK_REAL) {
+        if(printParse) output(); // Read past the type
 
-      /*newBlockNode->varNames.push_back(varName);
-      newBlockNode->varTypes.push_back(varType);*/
-      symbolTable.insert(std::pair<std::string, float>(*varName, 0.0f));
+        // The symbol table keeps only the slot; both types are floats at run time
+        int slot = symbolTable.size(); // next free slot in State::vars
+        symbolTable.insert(std::pair<std::string, int>(varName, slot));
 
-      lex(); // Read past the type
+        lex(); // Read past the type
+      } else if (nextToken == TOK_ARRAY) {
+        array_type(varName);
+      } else {
+        error();
+      }
 
       if (nextToken == TOK_SEMICOLON) {
         if (printParse) output();
@@ -245,7 +497,13 @@ BlockNode* block()
     }
   }
 
-  newBlockNode->compound = compound_statement();
+  while (nextToken == TOK_PROCEDURE || nextToken == TOK_FUNCTION)
+    newBlockNode->subprograms.emplace_back(subprogram());
+
+  // Only the main block is streamed; a subprogram's body must be kept
+  // and only the main block is parsed in chunks on several threads
+  newBlockNode->compound.reset(compound_statement(streamStatement != nullptr,
+                                                  parseThreads > 1 && !printParse));
 
   level = level - 1;
   if(printParse) {
@@ -253,581 +511,1167 @@ BlockNode* block()
     cout << "Exit <block>" << endl;
   }
 
-  return newBlockNode;
+  return newBlockNode.release();
 }
 bool first_of_block() 
 {
-  return nextToken == TOK_BEGIN || nextToken == TOK_VAR;
+  return nextToken == TOK_BEGIN || nextToken == TOK_VAR
+      || nextToken == TOK_PROCEDURE || nextToken == TOK_FUNCTION;
 }
 
 //*****************************************************************************
-// Parses strings in the language generated by the rule:
-// <statement> → <assignment> | <compound> | <if> | <while> | <read> | <write>
-StatementNode* statement() 
-{
-  if (!first_of_statement())
+// Parses a local name and its type: TOK_IDENT TOK_COLON ( TOK_INTEGER | TOK_REAL ),
+// giving it the next slot of the frame
+static void local_declaration() {
+  if (nextToken != TOK_IDENT)
     error();
-  
-  if(printParse) {
-    indent();
-    cout << "Enter <statement>" << endl;
-  }
-
-  level = level + 1;
-
-  StatementNode* newStatementNode = nullptr;
+  string name(lexeme);
+  if(printParse) output();
+  // Locals may hide globals, but not each other or a subprogram
+  if (localTable.count(name) || inSubprogramTable(name))
+    error();
+  lex(); // Read past the identifier
 
-  switch (nextToken) {
-    case TOK_IDENT:
-      newStatementNode = assignment_statement();
-      break;
-    case TOK_BEGIN:
-      newStatementNode = compound_statement();
-      break;
-    case TOK_IF:
-      newStatementNode = if_statement();
-      break;
-    case TOK_WHILE:
-      newStatementNode = while_statement();
-      break;
-    case TOK_READ:
-      newStatementNode = read_statement();
-      break;
-    case TOK_WRITE:
-      newStatementNode = write_statement();
-      break;
-    default:
-      error();
+  if (nextToken == TOK_COLON) {
+    if(printParse) output();
+    lex(); // Read past the colon
+  } else {
+    error();
   }
 
-  level = level - 1;
-  if(printParse) {
-    indent();
-    cout << "Exit <statement>" << endl;
+  if (nextToken == TOK_INTEGER || nextToken == TOK_REAL) {
+    if(printParse) output();
+    int slot = localTable.size(); // next free slot of the frame
+    localTable[name] = slot;
+    lex(); // Read past the type
+  } else {
+    error();
   }
-
-  return newStatementNode;
-}
-bool first_of_statement() 
-{
-  switch (nextToken) {
-    case TOK_IDENT:
-      return true;
-    case TOK_BEGIN:
-      return true;
-    case TOK_IF:
-      return true;
-    case TOK_WHILE:
-      return true;
-    case TOK_READ:
-      return true;
-    case TOK_WRITE:
-      return true;
-    default:
-      return false;
-    }
 }
 
 //*****************************************************************************
 // Parses strings in the language generated by the rule:
-// <assignment> → TOK_IDENT TOK_ASSIGN <expression>
-AssignmentNode* assignment_statement() 
-{
-  if (nextToken != TOK_IDENT)
+// <subprogram> → ( TOK_PROCEDURE TOK_IDENT [ <params> ] | TOK_FUNCTION TOK_IDENT [ <params> ] TOK_COLON ( TOK_INTEGER | TOK_REAL ) ) TOK_SEMICOLON
+//                [ TOK_VAR TOK_IDENT TOK_COLON ( TOK_INTEGER | TOK_REAL ) TOK_SEMICOLON { ... } ] <compound> TOK_SEMICOLON
+// <params> → TOK_OPENPAREN TOK_IDENT TOK_COLON ( TOK_INTEGER | TOK_REAL ) { TOK_SEMICOLON TOK_IDENT TOK_COLON ( TOK_INTEGER | TOK_REAL ) } TOK_CLOSEPAREN
+SubprogramNode* subprogram() {
+  if (nextToken != TOK_PROCEDURE && nextToken != TOK_FUNCTION)
     error();
-  
-  string id = string(yytext); // Save the identifier
 
   if(printParse) {
     indent();
-    cout << "Enter <assignment>" << endl;
+    cout << "Enter <subprogram>" << endl;
   }
   level = level + 1;
 
-  if (printParse) output();
-  lex(); // Read past the identifier
+  bool function = (nextToken == TOK_FUNCTION);
+  int line = tokenLine;
+  if(printParse) output();
+  lex(); // Read past TOK_PROCEDURE or TOK_FUNCTION
 
-  if (nextToken == TOK_ASSIGN) {
+  string id;
+  if (nextToken == TOK_IDENT) {
     if(printParse) output();
-    lex(); // Read past the assignment operator
+    id = string(lexeme);
+    if (inSymbolTable(id) || inArrayTable(id) || inSubprogramTable(id))
+      error();
+    lex(); // Read past the identifier
   } else {
     error();
   }
 
-  ExpressionNode* expr = expression();
-  AssignmentNode* newAssignmentNode = new AssignmentNode(level, id, expr);
-  
-  level = level - 1;
+  unique_ptr<SubprogramNode> newSubprogramNode(new SubprogramNode(level, id, function));
+  newSubprogramNode->line = line;
+  subprogramTable[id] = newSubprogramNode.get(); // the body may call itself
+  currentSubprogram = newSubprogramNode.get();
+  localTable.clear();
 
-  if(printParse) {
-    indent();
-    cout << "Exit <assignment>" << endl;
+  if (nextToken == TOK_OPENPAREN) {
+    if(printParse) output();
+    lex(); // Read past TOK_OPENPAREN
+    local_declaration();
+    while (nextToken == TOK_SEMICOLON) {
+      if(printParse) output();
+      lex(); // Read past the semicolon
+      local_declaration();
+    }
+    if (nextToken == TOK_CLOSEPAREN) {
+      if(printParse) output();
+      lex(); // Read past TOK_CLOSEPAREN
+    } else {
+      error();
+    }
   }
+  newSubprogramNode->paramCount = localTable.size();
 
-  return newAssignmentNode;
-}
+  if (function) {
+    if (nextToken == TOK_COLON) {
+      if(printParse) output();
+      lex(); // Read past the colon
+    } else {
+      error();
+    }
+    if (nextToken == TOK_INTEGER || nextToken == TOK_REAL) {
+      if(printParse) output();
+      lex(); // Read past the result type
+    } else {
+      error();
+    }
+  }
 
-//*****************************************************************************
-// Parses strings in the language generated by the rule:
-// <compound> → TOK_BEGIN <statement> { TOK_SEMICOLON <statement> } TOK_END
-CompoundNode* compound_statement() 
-{
-  if (!first_of_compound_statement())
+  if (nextToken == TOK_SEMICOLON) {
+    if(printParse) output();
+    lex(); // Read past the semicolon
+  } else {
     error();
-
-  if(printParse) {
-    indent();
-    cout << "Enter <compound>" << endl;
   }
 
-  level = level + 1;
-
-  CompoundNode* newCompoundNode = new CompoundNode(level);
+  if (nextToken == TOK_VAR) {
+    if(printParse) output();
+    lex(); // Read past TOK_VAR
+    while (nextToken == TOK_IDENT) {
+      local_declaration();
+      if (nextToken == TOK_SEMICOLON) {
+        if(printParse) output();
+        lex(); // Read past the semicolon
+      } else {
+        error();
+      }
+    }
+  }
 
-  lex(); // Read past TOK_BEGIN
+  // A function's result lives in the slot after its locals
+  newSubprogramNode->frameSize = localTable.size();
+  if (function)
+    newSubprogramNode->resultSlot = newSubprogramNode->frameSize++;
 
-  newCompoundNode->addStatement(statement()); // Add the first statement
+  newSubprogramNode->body.reset(compound_statement());
 
-  while (nextToken == TOK_SEMICOLON) {
+  if (nextToken == TOK_SEMICOLON) {
     if(printParse) output();
     lex(); // Read past the semicolon
-    newCompoundNode->addStatement(statement());
-  }
-
-  if (nextToken == TOK_END) {
-    if(printParse) output();
-    lex(); // Read past TOK_END
   } else {
     error();
   }
 
+  currentSubprogram = nullptr;
+  localTable.clear();
+
   level = level - 1;
   if(printParse) {
     indent();
-    cout << "Exit <compound>" << endl;
+    cout << "Exit <subprogram>" << endl;
   }
-  
-  return newCompoundNode;
-}
-bool first_of_compound_statement() 
-{
-  return nextToken == TOK_BEGIN;
+
+  return newSubprogramNode.release();
 }
 
 //*****************************************************************************
-// Parses strings in the language generated by the rule:
-// <if> → TOK_IF <expression> TOK_THEN <statement> [ TOK_ELSE <statement> ]
-IfNode* if_statement() 
-{
-  if (nextToken != TOK_IF)
-    error();
-
-  if(printParse) {
-    indent();
-    cout << "Enter <if>" << endl;
-  }
-  level = level + 1;
-
-  lex(); // Read past TOK_IF
-
-  ExpressionNode* expr = expression();
-  StatementNode* thenStatement = nullptr;
-  StatementNode* elseStatement = nullptr;
-
-  if (nextToken == TOK_THEN) {
+// Parses the arguments of a call to callee:
+// [ TOK_OPENPAREN <expression> { TOK_COMMA <expression> } TOK_CLOSEPAREN ],
+// present exactly when callee has parameters
+static void call_arguments(SubprogramNode* callee, vector<unique_ptr<ExpressionNode> >& args) {
+  globalsWritten(); // the callee may assign any global
+  if (callee->paramCount == 0)
+    return;
+  if (nextToken == TOK_OPENPAREN) {
+    nest();
     if(printParse) output();
-    lex(); // Read past TOK_THEN
-    thenStatement = statement();
+    lex(); // Read past TOK_OPENPAREN
   } else {
     error();
   }
-
-  if (nextToken == TOK_ELSE) {
+  args.emplace_back(expression());
+  while (nextToken == TOK_COMMA) {
     if(printParse) output();
-    lex(); // Read past TOK_ELSE
-    elseStatement = statement();
+    lex(); // Read past the comma
+    args.emplace_back(expression());
   }
-
-  IfNode* newIfNode = new IfNode(level, expr, thenStatement, elseStatement);
-
-  level = level - 1;
-  if(printParse) {
-    indent();
-    cout << "Exit <if>" << endl;
+  if (args.size() != callee->paramCount)
+    error();
+  if (nextToken == TOK_CLOSEPAREN) {
+    if(printParse) output();
+    lex(); // Read past TOK_CLOSEPAREN
+  } else {
+    error();
   }
-  
-  return newIfNode;
+  --nesting;
 }
 
 //*****************************************************************************
 // Parses strings in the language generated by the rule:
-// <while> → TOK_WHILE <expression> <statement>
-WhileNode* while_statement() {
-  if (nextToken != TOK_WHILE)
+// <call> → TOK_IDENT [ <args> ]
+CallNode* call_statement() {
+  if (nextToken != TOK_IDENT || !inSubprogramTable(lexeme))
     error();
 
   if(printParse) {
     indent();
-    cout << "Enter <while>" << endl;
+    cout << "Enter <call>" << endl;
   }
   level = level + 1;
 
-  lex(); // Read past TOK_WHILE
-
-  ExpressionNode* expr = expression();
-
-  StatementNode* stmt = statement();
+  SubprogramNode* callee = subprogramTable[lexeme];
+  if (callee->isFunction) // a function's value may not be thrown away
+    error();
+  if(printParse) output();
+  lex(); // Read past the identifier
 
-  WhileNode* newWhileNode = new WhileNode(level, expr, stmt);
+  unique_ptr<CallNode> newCallNode(new CallNode(level, callee));
+  call_arguments(callee, newCallNode->args);
 
   level = level - 1;
   if(printParse) {
     indent();
-    cout << "Exit <while>" << endl;
+    cout << "Exit <call>" << endl;
   }
-  
-  return newWhileNode;
+
+  return newCallNode.release();
+}
+
+//*****************************************************************************
+// Parses an array bound: [ TOK_MINUS ] TOK_INTLIT
+static int array_bound() {
+  int sign = 1;
+  if (nextToken == TOK_MINUS) {
+    if(printParse) output();
+    sign = -1;
+    lex(); // Read past the minus sign
+  }
+  if (nextToken != TOK_INTLIT)
+    error();
+  if(printParse) output();
+  long long value = sign * atoll(lexeme);
+  if (value < INT_MIN || value > INT_MAX)
+    error();
+  lex(); // Read past the literal
+  return static_cast<int>(value);
 }
 
 //*****************************************************************************
 // Parses strings in the language generated by the rule:
-// <read> → TOK_READ TOK_OPENPAREN TOK_IDENT TOK_CLOSEPAREN
-ReadNode* read_statement() {
-  if (nextToken != TOK_READ)
+// TOK_ARRAY TOK_OPENBRACKET bound TOK_DOTDOT bound TOK_CLOSEBRACKET TOK_OF ( TOK_INTEGER | TOK_REAL )
+// and declares the array name.
+void array_type(string name)
+{
+  if (nextToken != TOK_ARRAY)
     error();
 
   if(printParse) {
     indent();
-    cout << "Enter <read>" << endl;
+    cout << "Enter <array_type>" << endl;
   }
   level = level + 1;
 
-  lex(); // Read past TOK_READ
+  if(printParse) output();
+  lex(); // Read past TOK_ARRAY
 
-  if (nextToken == TOK_OPENPAREN) {
+  if (nextToken == TOK_OPENBRACKET) {
     if(printParse) output();
-    lex(); // Read past TOK_OPENPAREN
+    lex(); // Read past TOK_OPENBRACKET
   } else {
     error();
   }
 
-  std::string id;
-  if (nextToken == TOK_IDENT) {
+  int low = array_bound();
+
+  if (nextToken == TOK_DOTDOT) {
     if(printParse) output();
-    id = std::string(yytext);
-    lex(); // Read past the identifier
+    lex(); // Read past TOK_DOTDOT
   } else {
     error();
   }
 
-  if (nextToken == TOK_CLOSEPAREN) {
+  int high = array_bound();
+  if (low > high || static_cast<long long>(high) - low >= INT_MAX)
+    error();
+
+  if (nextToken == TOK_CLOSEBRACKET) {
     if(printParse) output();
-    lex(); // Read past TOK_CLOSEPAREN
+    lex(); // Read past TOK_CLOSEBRACKET
   } else {
     error();
   }
 
-  ReadNode* newReadNode = new ReadNode(level, id);
+  if (nextToken == TOK_OF) {
+    if(printParse) output();
+    lex(); // Read past TOK_OF
+  } else {
+    error();
+  }
+
+  if (nextToken != TOK_INTEGER && nextToken != TOK_REAL)
+    error();
+  if(printParse) output();
+
+  int number = arrayTable.size(); // next free buffer in State
+  ArrayT& array = arrayTable[name];
+  array.low = low;
+  array.high = high;
+  array.type = nextToken;
+  array.number = number;
+
+  lex(); // Read past the element type
 
   level = level - 1;
   if(printParse) {
     indent();
-    cout << "Exit <read>" << endl;
+    cout << "Exit <array_type>" << endl;
   }
+}
+
+//*****************************************************************************
+// Parses strings in the language generated by the rule:
+// <statement> → <assignment> | <call> | <compound> | <if> | <while> | <for> | <read> | <write> | <break> | <continue>
+StatementNode* statement() 
+{
+  if (!first_of_statement())
+    error();
   
-  return newReadNode;
+  if(printParse) {
+    indent();
+    cout << "Enter <statement>" << endl;
+  }
+
+  level = level + 1;
+
+  int line = tokenLine;
+  unique_ptr<StatementNode> newStatementNode;
+
+  switch (nextToken) {
+    case TOK_IDENT:
+      // A procedure name starts a call; anything else is assigned to
+      if (inSubprogramTable(lexeme) && !subprogramTable[lexeme]->isFunction)
+        newStatementNode.reset(call_statement());
+      else
+        newStatementNode.reset(assignment_statement());
+      break;
+    case TOK_BEGIN:
+      newStatementNode.reset(compound_statement());
+      break;
+    case TOK_IF:
+      newStatementNode.reset(if_statement());
+      break;
+    case TOK_WHILE:
+      newStatementNode.reset(while_statement());
+      break;
+    case TOK_FOR:
+      newStatementNode.reset(for_statement());
+      break;
+    case TOK_READ:
+      newStatementNode.reset(read_statement());
+      break;
+    case TOK_WRITE:
+      newStatementNode.reset(write_statement());
+      break;
+    case TOK_BREAK:
+      newStatementNode.reset(break_statement());
+      break;
+    case TOK_CONTINUE:
+      newStatementNode.reset(continue_statement());
+      break;
+    default:
+      error();
+  }
+  newStatementNode->line = line;
+
+  level = level - 1;
+  if(printParse) {
+    indent();
+    cout << "Exit <statement>" << endl;
+  }
+
+  return newStatementNode.release();
+}
+bool first_of_statement() 
+{
+  switch (nextToken) {
+    case TOK_IDENT:
+      return true;
+    case TOK_BEGIN:
+      return true;
+    case TOK_IF:
+      return true;
+    case TOK_WHILE:
+      return true;
+    case TOK_FOR:
+      return true;
+    case TOK_READ:
+      return true;
+    case TOK_WRITE:
+      return true;
+    case TOK_BREAK:
+      return true;
+    case TOK_CONTINUE:
+      return true;
+    default:
+      return false;
+    }
 }
 
 //*****************************************************************************
 // Parses strings in the language generated by the rule:
-// <write> → TOK_WRITE TOK_OPENPAREN ( TOK_IDENT | TOK_STRINGLIT ) TOK_CLOSEPAREN
-WriteNode* write_statement() {
-  if (nextToken != TOK_WRITE)
+// <assignment> → TOK_IDENT [ TOK_OPENBRACKET <expression> TOK_CLOSEBRACKET ] TOK_ASSIGN <expression>
+StatementNode* assignment_statement() 
+{
+  if (nextToken != TOK_IDENT)
     error();
+  
+  string id = string(lexeme); // Save the identifier
 
   if(printParse) {
     indent();
-    cout << "Enter <write>" << endl;
+    cout << "Enter <assignment>" << endl;
   }
   level = level + 1;
 
-  lex(); // Read past TOK_WRITE
+  if (printParse) output();
+  lex(); // Read past the identifier
 
-  if (nextToken == TOK_OPENPAREN) {
+  // An array element is the target when a subscript follows
+  unique_ptr<ExpressionNode> index;
+  int slot = 0;
+  bool local = false;
+  if (currentSubprogram && id == currentSubprogram->id) {
+    // Inside a function, its name is the result to return
+    if (!currentSubprogram->isFunction)
+      error();
+    slot = currentSubprogram->resultSlot;
+    local = true;
+  } else if (isArray(id)) {
+    if (nextToken == TOK_OPENBRACKET) {
+      if(printParse) output();
+      lex(); // Read past TOK_OPENBRACKET
+    } else {
+      error();
+    }
+    index.reset(expression());
+    if (nextToken == TOK_CLOSEBRACKET) {
+      if(printParse) output();
+      lex(); // Read past TOK_CLOSEBRACKET
+    } else {
+      error();
+    }
+  } else if (lookupVariable(id, slot, local)) {
+    counterWritten(id);
+  } else {
+    error(); // undeclared variable
+  }
+
+  if (nextToken == TOK_ASSIGN) {
     if(printParse) output();
-    lex(); // Read past TOK_OPENPAREN
+    lex(); // Read past the assignment operator
   } else {
     error();
   }
 
-  string id;
-  string str;
-
-  if (nextToken == TOK_IDENT) {
-    id = string(yytext);
-    if(printParse) output();
-    lex(); // Read past the identifier
-  } else if (nextToken == TOK_STRINGLIT) {
-    str = string(yytext);
-    if(printParse) output();
-    lex(); // Read past the string literal
+  unique_ptr<ExpressionNode> expr(expression());
+  StatementNode* newAssignmentNode = nullptr;
+  if (index) {
+    ArrayT* array = &arrayTable[id];
+    ExpressionNode* subscript = index.get();
+    ArrayAssignmentNode* element = new ArrayAssignmentNode(level, id, array, index.release(), expr.release());
+    proveIndex(array, subscript, &element->checked);
+    newAssignmentNode = element;
   } else {
+    AssignmentNode* scalar = new AssignmentNode(level, id, slot, expr.release());
+    scalar->local = local;
+    newAssignmentNode = scalar;
+  }
+  
+  level = level - 1;
+
+  if(printParse) {
+    indent();
+    cout << "Exit <assignment>" << endl;
+  }
+
+  return newAssignmentNode;
+}
+
+//*****************************************************************************
+// Parses strings in the language generated by the rule:
+// <compound> → TOK_BEGIN <statement> { TOK_SEMICOLON <statement> } TOK_END
+CompoundNode* compound_statement(bool stream, bool parallel) 
+{
+  if (!first_of_compound_statement())
     error();
+
+  if(printParse) {
+    indent();
+    cout << "Enter <compound>" << endl;
   }
 
-  if (nextToken == TOK_CLOSEPAREN) {
+  level = level + 1;
+
+  unique_ptr<CompoundNode> newCompoundNode(new CompoundNode(level));
+  newCompoundNode->line = tokenLine; // a block's BEGIN is not a <statement>
+
+  lex(); // Read past TOK_BEGIN
+
+  if (parallel) {
+    // Lexed here, parsed in chunks on other threads; stops at the END
+    parallel_statements(newCompoundNode.get(), level);
+  } else {
+    // Streamed statements run as soon as they are parsed and are never
+    // added, so the compound stays empty
+    if (stream)
+      streamStatement(statement()); // Run the first statement
+    else
+      newCompoundNode->addStatement(statement()); // Add the first statement
+
+    while (nextToken == TOK_SEMICOLON) {
+      if(printParse) output();
+      lex(); // Read past the semicolon
+      if (stream)
+        streamStatement(statement());
+      else
+        newCompoundNode->addStatement(statement());
+    }
+  }
+
+  if (nextToken == TOK_END) {
     if(printParse) output();
-    lex(); // Read past TOK_CLOSEPAREN
+    lex(); // Read past TOK_END
   } else {
     error();
   }
 
-  WriteNode* newWriteNode = new WriteNode(level, id, str);
-
   level = level - 1;
   if(printParse) {
     indent();
-    cout << "Exit <write>" << endl;
+    cout << "Exit <compound>" << endl;
   }
   
-  return newWriteNode;
+  return newCompoundNode.release();
+}
+bool first_of_compound_statement() 
+{
+  return nextToken == TOK_BEGIN;
+}
+
+//*****************************************************************************
+// Parses <statement> { TOK_SEMICOLON <statement> } from tokens alone, at
+// the main block's level, on the calling thread
+bool parse_statements(TokenRun* tokens, int atLevel, vector<StatementNode*>& statements)
+{
+  lex_from(tokens);
+  speculative = true;
+  level = atLevel;
+  nesting = 0;
+  loopDepth = 0;
+  forContexts.clear(); // a failed chunk may have left its loops open
+  bool ok = true;
+  try {
+    lex(); // Prime the pump
+    statements.push_back(statement());
+    while (nextToken == TOK_SEMICOLON) {
+      lex(); // Read past the semicolon
+      statements.push_back(statement());
+    }
+    ok = nextToken == TOK_EOF; // every token used
+  } catch (SyntaxError&) {
+    ok = false;
+  }
+  speculative = false;
+  run = nullptr;
+  return ok;
 }
 
 //*****************************************************************************
 // Parses strings in the language generated by the rule:
-// <expression> → <simple_expression> [ ( TOK_EQUALTO | TOK_LESSTHAN | TOK_GREATERTHAN | TOK_NOTEQUALTO ) <simple_expression> ]
-ExpressionNode* expression() {
-  // Check that the <expr> starts with a valid token 
-  if(!first_of_expression())
+// <if> → TOK_IF <expression> TOK_THEN <statement> [ TOK_ELSE <statement> ]
+IfNode* if_statement() 
+{
+  if (nextToken != TOK_IF)
     error();
 
   if(printParse) {
     indent();
-    cout << "Enter <expr>" << endl;
+    cout << "Enter <if>" << endl;
   }
   level = level + 1;
-  ExpressionNode* newExprNode = new ExpressionNode(level);
 
-  /* Parse the first term */
-  newExprNode->firstSimpleExpr = simple_expression();
+  lex(); // Read past TOK_IF
 
-  if(nextToken == TOK_EQUALTO || nextToken == TOK_LESSTHAN || nextToken == TOK_GREATERTHAN || nextToken == TOK_NOTEQUALTO) {
+  unique_ptr<ExpressionNode> expr(expression());
+  unique_ptr<StatementNode> thenStatement;
+  unique_ptr<StatementNode> elseStatement;
+
+  if (nextToken == TOK_THEN) {
     if(printParse) output();
-    newExprNode->relop = nextToken;
-    lex();
-    newExprNode->secondSimpleExpr = simple_expression();
+    lex(); // Read past TOK_THEN
+    thenStatement.reset(statement());
+  } else {
+    error();
   }
 
+  if (nextToken == TOK_ELSE) {
+    if(printParse) output();
+    lex(); // Read past TOK_ELSE
+    elseStatement.reset(statement());
+  }
+
+  IfNode* newIfNode = new IfNode(level, expr.release(), thenStatement.release(), elseStatement.release());
+
   level = level - 1;
   if(printParse) {
     indent();
-    cout << "Exit <expr>" << endl;
+    cout << "Exit <if>" << endl;
   }
-  return newExprNode;
+  
+  return newIfNode;
 }
-bool first_of_expression(void) 
-{
-  switch (nextToken) {
-    case TOK_IDENT:
-      return true;
-    case TOK_INTLIT:
-      return true;
-    case TOK_FLOATLIT:
-      return true;
-    case TOK_OPENPAREN:
-      return true;
-    case TOK_NOT:
-      return true;
-    case TOK_MINUS:
-      return true;
-    default:
-      return false;
+
+//*****************************************************************************
+// Parses strings in the language generated by the rule:
+// <while> → TOK_WHILE <expression> <statement>
+WhileNode* while_statement() {
+  if (nextToken != TOK_WHILE)
+    error();
+
+  if(printParse) {
+    indent();
+    cout << "Enter <while>" << endl;
+  }
+  level = level + 1;
+
+  lex(); // Read past TOK_WHILE
+
+  unique_ptr<ExpressionNode> expr(expression());
+
+  loopDepth = loopDepth + 1;
+  unique_ptr<StatementNode> stmt(statement());
+  loopDepth = loopDepth - 1;
+
+  WhileNode* newWhileNode = new WhileNode(level, expr.release(), stmt.release());
+
+  level = level - 1;
+  if(printParse) {
+    indent();
+    cout << "Exit <while>" << endl;
   }
+  
+  return newWhileNode;
 }
 
 //*****************************************************************************
 // Parses strings in the language generated by the rule:
-// <simple_expression> → <term> { ( TOK_PLUS | TOK_MINUS | TOK_OR ) <term> }
-SimpleExpressionNode* simple_expression() {
-  if(!first_of_simple_expression())
+// <for> → TOK_FOR TOK_IDENT TOK_ASSIGN <expression> ( TOK_TO | TOK_DOWNTO ) <expression> TOK_DO <statement>
+ForNode* for_statement() {
+  if (nextToken != TOK_FOR)
     error();
 
   if(printParse) {
     indent();
-    cout << "Enter <simple_expression>" << endl;
+    cout << "Enter <for>" << endl;
   }
   level = level + 1;
-  SimpleExpressionNode* newSimpleExprNode = new SimpleExpressionNode(level);
 
-  newSimpleExprNode->firstTerm = term();
+  lex(); // Read past TOK_FOR
 
-  while (nextToken == TOK_PLUS || nextToken == TOK_MINUS || nextToken == TOK_OR) {
+  string id;
+  int slot = 0;
+  bool local = false;
+  if (nextToken == TOK_IDENT) {
     if(printParse) output();
-    newSimpleExprNode->restSmplExprOps.push_back(nextToken);
-    lex();
-    newSimpleExprNode->restTerms.push_back(term());
+    id = string(lexeme);
+    if (!lookupVariable(id, slot, local)) // the counter must be a declared variable
+      error();
+    lex(); // Read past the identifier
+  } else {
+    error();
   }
 
+  if (nextToken == TOK_ASSIGN) {
+    if(printParse) output();
+    lex(); // Read past the assignment operator
+  } else {
+    error();
+  }
+
+  unique_ptr<ExpressionNode> startExpr(expression());
+
+  bool downto = false;
+  if (nextToken == TOK_TO || nextToken == TOK_DOWNTO) {
+    if(printParse) output();
+    downto = (nextToken == TOK_DOWNTO);
+    lex(); // Read past TOK_TO or TOK_DOWNTO
+  } else {
+    error();
+  }
+
+  unique_ptr<ExpressionNode> endExpr(expression());
+
+  if (nextToken == TOK_DO) {
+    if(printParse) output();
+    lex(); // Read past TOK_DO
+  } else {
+    error();
+  }
+
+  // The counter itself is written by this loop, which must stop an
+  // enclosing loop with the same counter from trusting it
+  counterWritten(id);
+
+  ForContext context;
+  context.counter = id;
+  context.constantBounds = constantInteger((downto ? endExpr : startExpr).get(), context.low)
+                        && constantInteger((downto ? startExpr : endExpr).get(), context.high);
+  context.counterWritten = false;
+  context.local = local;
+  forContexts.push_back(context);
+
+  loopDepth = loopDepth + 1;
+  unique_ptr<StatementNode> stmt(statement());
+  loopDepth = loopDepth - 1;
+
+  // Every counter value lies in [low, high]; accesses that fit need no check
+  ForContext& done = forContexts.back();
+  if (done.constantBounds && !done.counterWritten) {
+    for (int i = 0; i < done.uses.size(); ++i) {
+      ArrayT* array = done.uses[i].array;
+      if (done.low >= array->low && done.high <= array->high)
+        *done.uses[i].checked = false;
+    }
+  }
+  forContexts.pop_back();
+
+  ForNode* newForNode = new ForNode(level, id, slot, startExpr.release(), endExpr.release(), downto, stmt.release());
+  newForNode->local = local;
+
   level = level - 1;
   if(printParse) {
     indent();
-    cout << "Exit <simple_expression>" << endl;
+    cout << "Exit <for>" << endl;
   }
-  return newSimpleExprNode;
+  
+  return newForNode;
 }
-bool first_of_simple_expression(void) 
-{
-  switch (nextToken) {
-    case TOK_IDENT:
-      return true;
-    case TOK_INTLIT:
-      return true;
-    case TOK_FLOATLIT:
-      return true;
-    case TOK_OPENPAREN:
-      return true;
-    case TOK_NOT:
-      return true;
-    case TOK_MINUS:
-      return true;
-    default:
-      return false;
+
+//*****************************************************************************
+// Parses strings in the language generated by the rule:
+// <break> → TOK_BREAK
+BreakNode* break_statement() {
+  if (nextToken != TOK_BREAK || loopDepth == 0) // only legal inside a loop
+    error();
+
+  if(printParse) {
+    indent();
+    cout << "Enter <break>" << endl;
   }
+  level = level + 1;
+
+  if(printParse) output();
+  lex(); // Read past TOK_BREAK
+
+  BreakNode* newBreakNode = new BreakNode(level);
+
+  level = level - 1;
+  if(printParse) {
+    indent();
+    cout << "Exit <break>" << endl;
+  }
+
+  return newBreakNode;
 }
 
 //*****************************************************************************
 // Parses strings in the language generated by the rule:
-// <term> → <factor> { ( TOK_MULTIPLY | TOK_DIVIDE | TOK_MOD ) <factor> }
-TermNode* term() {
-  /* Check that the <term> starts with a valid token */
-  if(!first_of_term())
+// <continue> → TOK_CONTINUE
+ContinueNode* continue_statement() {
+  if (nextToken != TOK_CONTINUE || loopDepth == 0) // only legal inside a loop
     error();
 
   if(printParse) {
     indent();
-    cout << "Enter <term>" << endl;
+    cout << "Enter <continue>" << endl;
   }
   level = level + 1;
-  TermNode* newTermNode = new TermNode(level);
 
-  /* Parse the first factor */
-  newTermNode->firstFactor = factor();
+  if(printParse) output();
+  lex(); // Read past TOK_CONTINUE
+
+  ContinueNode* newContinueNode = new ContinueNode(level);
 
-  /* As long as the next token is * or /, get the
-     next token and parse the next factor */
-  while(nextToken == TOK_MULTIPLY || nextToken == TOK_DIVIDE || nextToken == TOK_MOD) {
+  level = level - 1;
+  if(printParse) {
+    indent();
+    cout << "Exit <continue>" << endl;
+  }
+
+  return newContinueNode;
+}
+
+//*****************************************************************************
+// Parses strings in the language generated by the rule:
+// <read> → TOK_READ TOK_OPENPAREN TOK_IDENT TOK_CLOSEPAREN
+ReadNode* read_statement() {
+  if (nextToken != TOK_READ)
+    error();
+
+  if(printParse) {
+    indent();
+    cout << "Enter <read>" << endl;
+  }
+  level = level + 1;
+
+  lex(); // Read past TOK_READ
+
+  if (nextToken == TOK_OPENPAREN) {
     if(printParse) output();
-    newTermNode->restTermOps.push_back(nextToken);
-    lex();
-    newTermNode->restFactors.push_back(factor());
+    lex(); // Read past TOK_OPENPAREN
+  } else {
+    error();
+  }
+
+  std::string id;
+  int slot = 0;
+  bool local = false;
+  if (nextToken == TOK_IDENT) {
+    if(printParse) output();
+    id = std::string(lexeme);
+    if (!lookupVariable(id, slot, local)) // READ fills declared scalars only
+      error();
+    counterWritten(id);
+    lex(); // Read past the identifier
+  } else {
+    error();
+  }
+
+  if (nextToken == TOK_CLOSEPAREN) {
+    if(printParse) output();
+    lex(); // Read past TOK_CLOSEPAREN
+  } else {
+    error();
   }
 
+  ReadNode* newReadNode = new ReadNode(level, id, slot);
+  newReadNode->local = local;
+
   level = level - 1;
   if(printParse) {
     indent();
-    cout << "Exit <term>" << endl;
+    cout << "Exit <read>" << endl;
   }
-  return newTermNode;
+  
+  return newReadNode;
 }
-bool first_of_term(void) 
-{
-  switch (nextToken) {
-    case TOK_IDENT:
-      return true;
-    case TOK_INTLIT:
-      return true;
-    case TOK_FLOATLIT:
-      return true;
-    case TOK_OPENPAREN:
-      return true;
-    case TOK_NOT:
-      return true;
-    case TOK_MINUS:
-      return true;
-    default:
-      return false;
+
+//*****************************************************************************
+// Parses one argument of a write statement into its plan:
+// <write_arg> → TOK_IDENT | TOK_STRINGLIT
+static void write_argument(WriteNode* write) {
+  if (nextToken == TOK_IDENT) {
+    string id(lexeme);
+    int slot = -1;
+    bool local = false;
+    if (!lookupVariable(id, slot, local))
+      error();
+    if(printParse) output();
+    write->addVariable(id, slot, local);
+    lex(); // Read past the identifier
+  } else if (nextToken == TOK_STRINGLIT) {
+    write->addLiteral(lexeme);
+    if(printParse) output();
+    lex(); // Read past the string literal
+  } else {
+    error();
   }
 }
 
 //*****************************************************************************
 // Parses strings in the language generated by the rule:
-// <factor> → TOK_IDENT | TOK_INTLIT | TOK_FLOATLIT | TOK_OPENPAREN <expression> TOK_CLOSEPAREN | TOK_NOT <factor> | TOK_MINUS <factor>
-FactorNode* factor() {
-  // Check that the <factor> starts with a valid token
-  if(!first_of_factor())
+// <write> → TOK_WRITE TOK_OPENPAREN <write_arg> { TOK_COMMA <write_arg> } TOK_CLOSEPAREN
+WriteNode* write_statement() {
+  if (nextToken != TOK_WRITE)
     error();
 
   if(printParse) {
-  indent();
-  cout << "Enter <factor>" << endl;
+    indent();
+    cout << "Enter <write>" << endl;
   }
   level = level + 1;
-  FactorNode* newFactorNode = nullptr;
 
-  // Determine which RHS token we have
-  switch(nextToken) {
+  lex(); // Read past TOK_WRITE
 
-    case TOK_IDENT:
-      if(printParse) output();
-      newFactorNode = new IdentifierNode(level, string(yytext));
-      nextToken = lex(); // Read past what we have found
-      break;
+  if (nextToken == TOK_OPENPAREN) {
+    if(printParse) output();
+    lex(); // Read past TOK_OPENPAREN
+  } else {
+    error();
+  }
 
-    case TOK_INTLIT:
-      if(printParse) output();
-      newFactorNode = new IntLitNode(level, atoi(yytext));
-      nextToken = lex();
-      break;
-    
-    case TOK_FLOATLIT:
-      if(printParse) output();
-      newFactorNode = new FloatLitNode(level, atof(yytext));
-      nextToken = lex();
-      break;
+  unique_ptr<WriteNode> newWriteNode(new WriteNode(level));
+  write_argument(newWriteNode.get());
+  while (nextToken == TOK_COMMA) {
+    if(printParse) output();
+    lex(); // Read past the comma
+    write_argument(newWriteNode.get());
+  }
 
-    case TOK_OPENPAREN:
-      // We expect ( <expr> ) parse it
-      if(printParse) output();
-      nextToken = lex();
-      if (!first_of_expression()) 
-        error();
+  if (nextToken == TOK_CLOSEPAREN) {
+    if(printParse) output();
+    lex(); // Read past TOK_CLOSEPAREN
+  } else {
+    error();
+  }
+  newWriteNode->finish();
 
-      newFactorNode = new NestedExpressionNode(level, expression());
+  level = level - 1;
+  if(printParse) {
+    indent();
+    cout << "Exit <write>" << endl;
+  }
+  
+  return newWriteNode.release();
+}
+//*****************************************************************************
+// An expression being parsed by expression(): the whole one, or one
+// inside parentheses, a subscript or a call's argument list. The frame
+// owns what it has built until it is handed to the enclosing one, so a
+// syntax error frees every frame's nodes.
+struct ExprFrame {
+  int base = 0;                    // level the expression is parsed at
+  int opened = 0;                  // TOK_OPENPAREN, TOK_OPENBRACKET, TOK_COMMA (an argument) or 0
+  unique_ptr<ExpressionNode> expr;
+  SimpleExpressionNode* simple = nullptr; // the simple expression being built, inside expr
+  TermNode* term = nullptr;        // the term being built, inside expr
+  vector<int> prefixes;            // NOTs and MINUSes before the next factor
+  string name;                     // the array it indexes
+  ArrayT* array = nullptr;
+  unique_ptr<FunctionCallNode> call; // the call it is an argument of, with the arguments before it
+};
+
+// Start a frame's expression with an empty first term
+static void open_expression(ExprFrame& frame) {
+  frame.expr.reset(new ExpressionNode(frame.base + 1));
+  frame.simple = new SimpleExpressionNode(frame.base + 2);
+  frame.term = new TermNode(frame.base + 3);
+  frame.expr->firstSimpleExpr.reset(frame.simple);
+  frame.simple->firstTerm.reset(frame.term);
+}
 
-      if (nextToken == TOK_CLOSEPAREN) {
-        if(printParse) output();
-        nextToken = lex();
-      }
-      else
-        error();
-      break;
-    
-    case TOK_NOT:
-      if(printParse) output();
-      nextToken = lex();
-      newFactorNode = new NotNode(level, factor());
-      break;
+static void open_frame(vector<ExprFrame>& frames, int opened) {
+  frames.emplace_back();
+  frames.back().base = level;
+  frames.back().opened = opened;
+  open_expression(frames.back());
+}
 
-    case TOK_MINUS:
-      if(printParse) output();
-      nextToken = lex();
-      newFactorNode = new MinusNode(level, factor());
-      break;
+// The grammar rules an expression is made of, outermost first; -p traces
+// entering and leaving each of them
+static const char* const expressionRules[] = { "expr", "simple_expression", "term", "factor" };
 
-    default:
-      // If we made it to here, syntax error
-      error();
-	}
+static void enter_rule(const char* rule) {
+  if(printParse) {
+    indent();
+    cout << "Enter <" << rule << ">" << endl;
+  }
+  level = level + 1;
+}
 
+static void exit_rule(const char* rule) {
   level = level - 1;
-  
   if(printParse) {
     indent();
-    cout << "Exit <factor>" << endl;
+    cout << "Exit <" << rule << ">" << endl;
   }
-  return newFactorNode;
 }
-bool first_of_factor(void) 
+
+//*****************************************************************************
+// Parses strings in the language generated by the rules:
+// <expression> → <simple_expression> [ ( TOK_EQUALTO | TOK_LESSTHAN | TOK_GREATERTHAN | TOK_NOTEQUALTO ) <simple_expression> ]
+// <simple_expression> → <term> { ( TOK_PLUS | TOK_MINUS | TOK_OR ) <term> }
+// <term> → <factor> { ( TOK_MULTIPLY | TOK_DIVIDE | TOK_MOD | TOK_AND ) <factor> }
+// <factor> → TOK_IDENT [ TOK_OPENBRACKET <expression> TOK_CLOSEBRACKET | <args> ] | TOK_INTLIT | TOK_FLOATLIT | TOK_OPENPAREN <expression> TOK_CLOSEPAREN | TOK_NOT <factor> | TOK_MINUS <factor>
+//
+// without recursion. Operators are attached as they are read, to the
+// term or simple expression their precedence puts them in; a
+// parenthesis, subscript or argument list pushes a frame and its closing
+// token pops it, so only MAX_NESTING limits how deep an expression may
+// nest. The nodes, their levels and the -p trace are those of a
+// recursive descent with one function per rule.
+ExpressionNode* expression() {
+  vector<ExprFrame> frames;
+  open_frame(frames, 0);
+  int entering = 4; // how many of expressionRules the next factor starts
+  for (;;) {
+    // A factor: any NOTs and MINUSes, then what they apply to
+    if (!first_of_expression())
+      error();
+    for (int r = 4 - entering; r < 4; ++r)
+      enter_rule(expressionRules[r]);
+    ExprFrame* frame = &frames.back();
+    while (nextToken == TOK_NOT || nextToken == TOK_MINUS) {
+      nest();
+      if(printParse) output();
+      frame->prefixes.push_back(nextToken);
+      lex();
+      if (!first_of_expression())
+        error();
+      enter_rule("factor");
+    }
+    unique_ptr<FactorNode> operand;
+    switch (nextToken) {
+      case TOK_IDENT: {
+        if(printParse) output();
+        int slot = 0;
+        bool local = false;
+        if (lookupVariable(lexeme, slot, local)) {
+          IdentifierNode* variable = new IdentifierNode(level, string(lexeme), slot);
+          variable->local = local;
+          operand.reset(variable);
+          lex();
+          break;
+        }
+        if (inSubprogramTable(lexeme)) {
+          // Only a function has a value to use
+          SubprogramNode* callee = subprogramTable[lexeme];
+          if (!callee->isFunction)
+            error();
+          lex(); // Read past the function name
+          unique_ptr<FunctionCallNode> call(new FunctionCallNode(level, callee));
+          globalsWritten(); // the callee may assign any global
+          if (callee->paramCount == 0) {
+            operand = std::move(call);
+            break;
+          }
+          if (nextToken != TOK_OPENPAREN)
+            error();
+          nest();
+          if(printParse) output();
+          lex();
+          open_frame(frames, TOK_COMMA);
+          frames.back().call = std::move(call);
+          entering = 4;
+          continue;
+        }
+        if (inArrayTable(lexeme)) {
+          // An array name must be followed by a subscript
+          string id = string(lexeme);
+          lex(); // Read past the identifier
+          if (nextToken != TOK_OPENBRACKET)
+            error();
+          nest();
+          if(printParse) output();
+          lex();
+          open_frame(frames, TOK_OPENBRACKET);
+          frames.back().name = id;
+          frames.back().array = &arrayTable[id];
+          entering = 4;
+          continue;
+        }
+        error(); // undeclared variable
+        break;
+      }
+      case TOK_INTLIT:
+        if(printParse) output();
+        operand.reset(new IntLitNode(level, atoi(lexeme)));
+        lex();
+        break;
+      case TOK_FLOATLIT:
+        if(printParse) output();
+        operand.reset(new FloatLitNode(level, atof(lexeme)));
+        lex();
+        break;
+      default: // TOK_OPENPAREN
+        nest();
+        if(printParse) output();
+        lex();
+        open_frame(frames, TOK_OPENPAREN);
+        entering = 4;
+        continue;
+    }
+
+    // Attach the factor, then read the operator after it; every
+    // expression that ends here hands its enclosing one another factor
+    for (;;) {
+      frame = &frames.back();
+      for (int i = frame->prefixes.size() - 1; i >= 0; --i) {
+        exit_rule("factor");
+        if (frame->prefixes[i] == TOK_NOT)
+          operand.reset(new NotNode(level, operand.release()));
+        else
+          operand.reset(new MinusNode(level, operand.release()));
+      }
+      exit_rule("factor");
+      nesting -= frame->prefixes.size();
+      frame->prefixes.clear();
+      if (!frame->term->firstFactor)
+        frame->term->firstFactor = std::move(operand);
+      else
+        frame->term->restFactors.push_back(std::move(operand));
+
+      if (nextToken == TOK_MULTIPLY || nextToken == TOK_DIVIDE || nextToken == TOK_MOD || nextToken == TOK_AND) {
+        if(printParse) output();
+        frame->term->restTermOps.push_back(nextToken);
+        lex();
+        entering = 1;
+        break;
+      }
+      exit_rule("term");
+      if (nextToken == TOK_PLUS || nextToken == TOK_MINUS || nextToken == TOK_OR) {
+        if(printParse) output();
+        frame->simple->restSmplExprOps.push_back(nextToken);
+        frame->term = new TermNode(frame->base + 3);
+        frame->simple->restTerms.emplace_back(frame->term);
+        lex();
+        entering = 2;
+        break;
+      }
+      exit_rule("simple_expression");
+      if ((nextToken == TOK_EQUALTO || nextToken == TOK_LESSTHAN || nextToken == TOK_GREATERTHAN || nextToken == TOK_NOTEQUALTO)
+          && frame->expr->relop == 0) {
+        if(printParse) output();
+        frame->expr->relop = nextToken;
+        frame->simple = new SimpleExpressionNode(frame->base + 2);
+        frame->term = new TermNode(frame->base + 3);
+        frame->expr->secondSimpleExpr.reset(frame->simple);
+        frame->simple->firstTerm.reset(frame->term);
+        lex();
+        entering = 3;
+        break;
+      }
+      exit_rule("expr");
+
+      // The frame's expression is complete
+      if (frames.size() == 1)
+        return frame->expr.release();
+      ExprFrame closed = std::move(frames.back());
+      frames.pop_back();
+      ExpressionNode* done = closed.expr.get();
+      if (closed.opened == TOK_COMMA) {
+        closed.call->args.push_back(std::move(closed.expr));
+        if (nextToken == TOK_COMMA) {
+          if(printParse) output();
+          lex(); // Read past the comma
+          open_frame(frames, TOK_COMMA);
+          frames.back().call = std::move(closed.call);
+          entering = 4;
+          break;
+        }
+        if (closed.call->args.size() != closed.call->callee->paramCount || nextToken != TOK_CLOSEPAREN)
+          error();
+        operand = std::move(closed.call);
+      } else if (closed.opened == TOK_OPENBRACKET) {
+        if (nextToken != TOK_CLOSEBRACKET)
+          error();
+        operand.reset(new IndexedIdentifierNode(level, closed.name, closed.array, closed.expr.release()));
+      } else {
+        if (nextToken != TOK_CLOSEPAREN)
+          error();
+        operand.reset(new NestedExpressionNode(level, closed.expr.release()));
+      }
+      if(printParse) output();
+      lex(); // Read past the closing token
+      --nesting;
+      if (closed.opened == TOK_OPENBRACKET)
+        proveIndex(closed.array, done, &static_cast<IndexedIdentifierNode*>(operand.get())->checked);
+    }
+  }
+}
+bool first_of_expression(void)
 {
   switch (nextToken) {
     case TOK_IDENT:
@@ -846,4 +1690,3 @@ bool first_of_factor(void)
       return false;
   }
 }
-
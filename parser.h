@@ -18,29 +18,93 @@
 extern "C" {
   extern FILE *yyin;       // input stream
   extern int   yylex();    // the generated lexical analyzer
+  extern int   yylex_destroy(); // free the lexer's buffers and start over
   extern char *yytext;     // text of current lexeme
+  extern int   line_number; // line the lexer is on
+  extern int   lexer_buffer_bytes(); // size of flex's input buffer
 }
-extern int nextToken;        // next token returned by lexer
+extern thread_local int nextToken; // next token returned by lexer
+extern thread_local const char* lexeme; // its text
+extern thread_local int tokenLine; // the line it is on
 
-typedef std::map<std::string, float> symbolTableT;
-extern symbolTableT symbolTable; // Holds variable names and their types and values
+typedef std::map<std::string, int> symbolTableT;
+
+// Declaration of one ARRAY variable. Its elements live in a contiguous
+// buffer of the element type in State::ints or State::reals.
+struct ArrayT {
+  int low = 0;             // declared lowest index
+  int high = 0;            // declared highest index
+  int type = TOK_REAL;     // TOK_INTEGER or TOK_REAL
+  int number = 0;          // which buffer of State holds the elements
+};
+typedef std::map<std::string, ArrayT> arrayTableT;
+
+typedef std::map<std::string, SubprogramNode*> subprogramTableT;
+
+// The declarations of one program. The parser fills parsedTables, and
+// program() hands them to the ProgramNode it returns, so each parsed
+// program keeps its own and the next parse starts empty.
+struct ProgramTables {
+  symbolTableT symbols;         // variable names and their slots in State::vars
+  arrayTableT arrays;           // array names and their declarations
+  subprogramTableT subprograms; // procedure and function names, owned by the BlockNode
+};
+extern ProgramTables parsedTables;
+extern symbolTableT& symbolTable;         // parsedTables.symbols
+extern arrayTableT& arrayTable;           // parsedTables.arrays
+extern subprogramTableT& subprogramTable; // parsedTables.subprograms
+
+// A syntax error, with the text tips prints for it
+struct SyntaxError {
+  std::string message;
+};
+
+// When set, every statement of the main block is handed to this as soon
+// as it is parsed instead of being kept in the tree. It takes ownership.
+extern void (*streamStatement)(StatementNode* stmt);
+
+// Tokens lexed ahead of parsing, with their text and lines
+struct TokenRun {
+  std::vector<int> tokens;     // token codes
+  std::vector<int> lines;      // line of each token
+  std::vector<int> starts;     // where each lexeme begins in lexemes
+  std::string lexemes;         // the lexemes, each ending in '\0'
+  int next = 0;                // next token lex() hands out
+  void add(int token, const char* text, int line);
+};
+
+// Threads that parse the main block (--parse-threads); 0 or 1 parse it
+// in line
+extern int parseThreads;
+
+// Deepest an expression may nest parentheses, subscripts, arguments, NOT
+// and MINUS. Parsing and freeing the tree need no stack for them; what
+// walks it recursively is given a stack for the depth (see onStackFor).
+#define MAX_NESTING 50000
 
 /* Function declarations */
 int lex();                   // return the next token
+void lex_from(TokenRun* tokens); // take tokens from here, then from the lexer again
+bool parse_statements(TokenRun* tokens, int level, std::vector<StatementNode*>& statements); // parse a chunk; false on a syntax error
+int deepest_nesting();       // deepest nesting in the program parsed so far
 
+ProgramNode* parse_program(FILE* source); // parse source with a fresh parser; throws SyntaxError
 ProgramNode* program();      // parse a program
 BlockNode* block();        // parse a block
+void array_type(std::string name); // parse an array type and allocate name
+SubprogramNode* subprogram(); // parse a procedure or function declaration
+CallNode* call_statement();  // parse a procedure call
 StatementNode* statement();  // parse a statement
-AssignmentNode* assignment_statement(); // parse an assignment statement
-CompoundNode* compound_statement(); // parse a compound statement
+StatementNode* assignment_statement(); // parse an assignment to a variable or array element
+CompoundNode* compound_statement(bool stream = false, bool parallel = false); // parse a compound statement, streaming its statements or parsing them in chunks if asked
 IfNode* if_statement();      // parse an if statement
 WhileNode* while_statement(); // parse a while statement
+ForNode* for_statement();    // parse a for statement
+BreakNode* break_statement(); // parse a break statement
+ContinueNode* continue_statement(); // parse a continue statement
 ReadNode* read_statement();  // parse a read statement
 WriteNode* write_statement(); // parse a write statement
 ExpressionNode* expression(); // parse an expression
-SimpleExpressionNode* simple_expression(); // parse a simple expression
-TermNode* term();           // parse a term
-FactorNode* factor();       // parse a factor
 
 
 #endif /* PARSER_H */
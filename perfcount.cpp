@@ -0,0 +1,162 @@
+//*****************************************************************************
+// purpose: Hardware performance counters for --perf-counters
+//          Instructions, cycles, branch and cache misses per phase of a run
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#include "perfcount.h"
+#include <iomanip>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static const char* eventNames[PERF_EVENTS] = {
+  "instructions", "cycles", "branch-misses", "cache-misses"
+};
+
+// ---------------------------------------------------------------------
+#ifdef __linux__
+static const uint64_t eventConfigs[PERF_EVENTS] = {
+  PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES
+};
+
+// A counter's value with the time it was enabled and actually counting;
+// the two differ when the kernel multiplexes more events than the PMU has
+struct Reading {
+  uint64_t value = 0;
+  uint64_t enabled = 0;
+  uint64_t running = 0;
+};
+static Reading readings[PERF_EVENTS]; // at the start of the running phase
+
+static bool readCounter(int fd, Reading& r) {
+  uint64_t data[3];
+  if (read(fd, data, sizeof(data)) != sizeof(data))
+    return false;
+  r.value = data[0];
+  r.enabled = data[1];
+  r.running = data[2];
+  return true;
+}
+#endif
+
+PerfCounters::PerfCounters() {
+  for (int i = 0; i < PERF_EVENTS; ++i)
+    fds[i] = -1;
+#ifdef __linux__
+  int failure = 0;
+  for (int i = 0; i < PERF_EVENTS; ++i) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = eventConfigs[i];
+    attr.exclude_kernel = 1; // allowed at the default perf_event_paranoid
+    attr.exclude_hv = 1;
+    attr.inherit = 1;        // parsing and READ prefetch threads too
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fds[i] < 0)
+      failure = errno;
+  }
+  bool any = false;
+  for (int i = 0; i < PERF_EVENTS; ++i)
+    any = any || counting(i);
+  if (!any) {
+    unavailable = strerror(failure);
+    if (failure == EACCES || failure == EPERM)
+      unavailable += " (see /proc/sys/kernel/perf_event_paranoid)";
+    else if (failure == ENOENT || failure == EOPNOTSUPP)
+      unavailable += " (no hardware counters, as in many virtual machines)";
+  }
+#else
+  unavailable = "perf_event_open is only on Linux";
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+  for (int i = 0; i < PERF_EVENTS; ++i)
+    if (counting(i))
+      close(fds[i]);
+#endif
+}
+
+// ---------------------------------------------------------------------
+void PerfCounters::start(const char* phase) {
+  running = -1;
+  for (int p = 0; p < phases.size(); ++p)
+    if (phases[p].name == phase)
+      running = p;
+  if (running < 0) {
+    running = phases.size();
+    phases.push_back(Phase());
+    phases.back().name = phase;
+  }
+#ifdef __linux__
+  for (int i = 0; i < PERF_EVENTS; ++i)
+    if (counting(i) && !readCounter(fds[i], readings[i])) {
+      close(fds[i]);
+      fds[i] = -1;
+    }
+#endif
+  began = chrono::steady_clock::now(); // last, so opening is not timed
+}
+
+void PerfCounters::stop() {
+  if (running < 0)
+    return;
+  Phase& phase = phases[running];
+  phase.seconds += chrono::duration<double>(chrono::steady_clock::now() - began).count();
+#ifdef __linux__
+  for (int i = 0; i < PERF_EVENTS; ++i) {
+    Reading now;
+    if (!counting(i) || !readCounter(fds[i], now))
+      continue;
+    double value = now.value - readings[i].value;
+    uint64_t enabled = now.enabled - readings[i].enabled;
+    uint64_t ran = now.running - readings[i].running;
+    if (ran > 0 && ran < enabled)
+      value = value * enabled / ran; // estimate the time it was swapped out
+    phase.counts[i] += static_cast<long long>(value);
+  }
+#endif
+  running = -1;
+}
+
+// ---------------------------------------------------------------------
+void PerfCounters::report(ostream& os) {
+  os << "*** Performance Counters ***" << endl;
+  if (!unavailable.empty())
+    os << "WARNING - hardware counters unavailable: " << unavailable
+       << "; only times are reported" << endl;
+  os << left << setw(12) << "phase" << right << setw(12) << "seconds";
+  for (int i = 0; i < PERF_EVENTS; ++i)
+    if (counting(i))
+      os << setw(16) << eventNames[i];
+  if (counting(0) && counting(1))
+    os << setw(8) << "IPC";
+  os << endl;
+  for (Phase& phase : phases) {
+    os << left << setw(12) << phase.name << right
+       << setw(12) << fixed << setprecision(6) << phase.seconds;
+    for (int i = 0; i < PERF_EVENTS; ++i)
+      if (counting(i))
+        os << setw(16) << phase.counts[i];
+    if (counting(0) && counting(1)) {
+      os << setw(8) << setprecision(2);
+      if (phase.counts[1] > 0)
+        os << static_cast<double>(phase.counts[0]) / phase.counts[1];
+      else
+        os << "-";
+    }
+    os << defaultfloat << setprecision(6) << endl;
+  }
+}
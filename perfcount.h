@@ -0,0 +1,50 @@
+//*****************************************************************************
+// purpose: Hardware performance counters for --perf-counters
+//          Instructions, cycles, branch and cache misses per phase of a run
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#ifndef PERFCOUNT_H
+#define PERFCOUNT_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <ostream>
+
+using namespace std;
+
+// instructions, cycles, branch-misses, cache-misses
+#define PERF_EVENTS 4
+
+// ---------------------------------------------------------------------
+// Counts hardware events of this process (user mode only, threads it
+// starts included) through Linux perf_event_open, one phase at a time.
+// A counter the kernel or the machine refuses is left out of the report;
+// when none can be opened, only the phases' wall-clock times are.
+class PerfCounters {
+public:
+  PerfCounters();
+  ~PerfCounters();
+  string unavailable;           // why no counter is counting, or ""
+
+  // Phases run one after another; a phase started again adds to its row
+  void start(const char* phase);
+  void stop();
+  void report(ostream& os);     // a row per phase, in the order first started
+
+private:
+  struct Phase {
+    string name;
+    double seconds = 0;
+    long long counts[PERF_EVENTS] = {};
+  };
+  int fds[PERF_EVENTS];         // -1 for a counter that is off
+  vector<Phase> phases;
+  int running = -1;             // index of the phase counting now
+  chrono::steady_clock::time_point began;
+  bool counting(int event) { return fds[event] >= 0; }
+};
+
+#endif /* PERFCOUNT_H */
@@ -0,0 +1,248 @@
+//*****************************************************************************
+// purpose: Profile-guided optimization of IF chains and WHILE loops
+//          Counts branches and loop trips, then reshapes the tree with them
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#include "profile.h"
+#include "parser.h"
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <set>
+
+// ---------------------------------------------------------------------
+Profile::Profile(ProgramNode* root) {
+  number(root->block.get());
+  counts.assign(2 * sites.size(), 0);
+}
+
+// Source order: a block's subprograms come before its statement
+void Profile::number(BlockNode* block) {
+  for (auto& sub : block->subprograms)
+    number(sub->body.get());
+  number(block->compound.get());
+}
+
+void Profile::number(StatementNode* stmt) {
+  if (CompoundNode* n = dynamic_cast<CompoundNode*>(stmt)) {
+    for (auto& s : n->statements)
+      number(s.get());
+  } else if (IfNode* n = dynamic_cast<IfNode*>(stmt)) {
+    n->site = sites.size();
+    sites.push_back(n);
+    number(n->thenStatement.get());
+    if (n->elseStatement)
+      number(n->elseStatement.get());
+  } else if (WhileNode* n = dynamic_cast<WhileNode*>(stmt)) {
+    n->site = sites.size();
+    sites.push_back(n);
+    number(n->statement.get());
+  } else if (ForNode* n = dynamic_cast<ForNode*>(stmt)) {
+    number(n->statement.get());
+  }
+}
+
+// ---------------------------------------------------------------------
+// File format: a header naming the program and the number of sites,
+// then one line per site:
+//   IF <line> <then taken> <else taken>
+//   WHILE <line> <entries> <iterations>
+bool Profile::save(const char* fileName, const string& program) {
+  ofstream file(fileName);
+  if (!file)
+    return false;
+  file << "TIPS profile " << program << " " << sites.size() << endl;
+  for (int i = 0; i < sites.size(); ++i) {
+    if (IfNode* n = dynamic_cast<IfNode*>(sites[i]))
+      file << "IF " << n->line;
+    else
+      file << "WHILE " << static_cast<WhileNode*>(sites[i])->line;
+    file << " " << counts[2 * i] << " " << counts[2 * i + 1] << endl;
+  }
+  return static_cast<bool>(file);
+}
+
+string Profile::load(const char* fileName, const string& program) {
+  ifstream file(fileName);
+  if (!file)
+    return string("cannot open ") + fileName;
+  string magic, kind, name;
+  int size = -1;
+  file >> magic >> kind >> name >> size;
+  if (magic != "TIPS" || kind != "profile")
+    return string(fileName) + " is not a profile";
+  if (name != program)
+    return string(fileName) + " was recorded for another program";
+  if (size != sites.size())
+    return string(fileName) + " was recorded for another version of the program";
+  vector<long long> loaded(2 * sites.size(), 0);
+  for (int i = 0; i < sites.size(); ++i) {
+    int line = 0;
+    file >> kind >> line >> loaded[2 * i] >> loaded[2 * i + 1];
+    IfNode* n = dynamic_cast<IfNode*>(sites[i]);
+    bool matches = n ? kind == "IF" && line == n->line
+                     : kind == "WHILE" && line == static_cast<WhileNode*>(sites[i])->line;
+    if (!file || !matches || loaded[2 * i] < 0 || loaded[2 * i + 1] < 0)
+      return string(fileName) + " was recorded for another version of the program";
+  }
+  counts = loaded;
+  return "";
+}
+
+// ---------------------------------------------------------------------
+// The only factor of simple, if it has no operators
+static FactorNode* loneFactor(SimpleExpressionNode* simple) {
+  if (!simple || !simple->restTerms.empty() || !simple->firstTerm->restFactors.empty())
+    return nullptr;
+  return simple->firstTerm->firstFactor.get();
+}
+
+static bool literal(FactorNode* factor, float& value) {
+  if (IntLitNode* n = dynamic_cast<IntLitNode*>(factor)) {
+    value = n->int_literal;
+    return true;
+  }
+  if (FloatLitNode* n = dynamic_cast<FloatLitNode*>(factor)) {
+    value = n->float_literal;
+    return true;
+  }
+  return false;
+}
+
+// The variable of a comparison "V = literal" or "literal = V"
+static IdentifierNode* equalityTest(ExpressionNode* expr, float& constant) {
+  if (expr->relop != TOK_EQUALTO)
+    return nullptr;
+  FactorNode* first = loneFactor(expr->firstSimpleExpr.get());
+  FactorNode* second = loneFactor(expr->secondSimpleExpr.get());
+  if (IdentifierNode* v = dynamic_cast<IdentifierNode*>(first))
+    return literal(second, constant) ? v : nullptr;
+  if (IdentifierNode* v = dynamic_cast<IdentifierNode*>(second))
+    return literal(first, constant) ? v : nullptr;
+  return nullptr;
+}
+
+// A ScalarTest equivalent to expr, or null if expr is not a comparison
+// of a variable with a variable or a literal
+static ScalarTest* scalarTest(ExpressionNode* expr) {
+  if (expr->relop == 0)
+    return nullptr;
+  FactorNode* first = loneFactor(expr->firstSimpleExpr.get());
+  FactorNode* second = loneFactor(expr->secondSimpleExpr.get());
+  int relop = expr->relop;
+  if (!dynamic_cast<IdentifierNode*>(first)) {
+    // literal < V is V > literal
+    swap(first, second);
+    if (relop == TOK_LESSTHAN)
+      relop = TOK_GREATERTHAN;
+    else if (relop == TOK_GREATERTHAN)
+      relop = TOK_LESSTHAN;
+  }
+  IdentifierNode* left = dynamic_cast<IdentifierNode*>(first);
+  if (!left)
+    return nullptr;
+  ScalarTest* t = new ScalarTest;
+  t->relop = relop;
+  t->leftLocal = left->local;
+  t->leftSlot = left->slot;
+  if (IdentifierNode* right = dynamic_cast<IdentifierNode*>(second)) {
+    t->rightIsVar = true;
+    t->rightLocal = right->local;
+    t->rightSlot = right->slot;
+  } else if (!literal(second, t->constant)) {
+    delete t;
+    return nullptr;
+  }
+  return t;
+}
+
+// ---------------------------------------------------------------------
+// One arm of an IF ... ELSE IF chain, while the chain is taken apart
+struct Arm {
+  unique_ptr<ExpressionNode> expr;
+  unique_ptr<StatementNode> thenStatement;
+  int site = 0;
+  int line = 0;
+  long long taken = 0;
+};
+
+// Reorder the arms at the start of the chain at head that all compare
+// the same variable with different literals. At most one of those tests
+// can be true and none has a side effect or can stop the run, so testing
+// them in any order picks the same arm. Returns how many IFs of the
+// chain that covers.
+int Profile::reorder(IfNode* head) {
+  vector<IfNode*> chain;
+  vector<float> constants;
+  IdentifierNode* var = nullptr;
+  for (IfNode* n = head; n; n = dynamic_cast<IfNode*>(n->elseStatement.get())) {
+    float constant = 0.0f;
+    IdentifierNode* v = equalityTest(n->expr.get(), constant);
+    if (!v || (var && (v->local != var->local || v->slot != var->slot)))
+      break;
+    bool distinct = true;
+    for (float c : constants)
+      distinct = distinct && fabs(c - constant) > 0.01; // well apart for truth()
+    if (!distinct)
+      break;
+    var = v;
+    constants.push_back(constant);
+    chain.push_back(n);
+  }
+  if (chain.size() < 2)
+    return 1;
+
+  vector<Arm> arms(chain.size());
+  for (int i = 0; i < chain.size(); ++i) {
+    arms[i].expr = std::move(chain[i]->expr);
+    arms[i].thenStatement = std::move(chain[i]->thenStatement);
+    arms[i].site = chain[i]->site;
+    arms[i].line = chain[i]->line;
+    arms[i].taken = counts[2 * chain[i]->site];
+  }
+  bool sorted = true;
+  for (int i = 1; i < arms.size(); ++i)
+    sorted = sorted && arms[i - 1].taken >= arms[i].taken;
+  if (!sorted) {
+    stable_sort(arms.begin(), arms.end(),
+                [](const Arm& a, const Arm& b) { return a.taken > b.taken; });
+    ++reordered;
+  }
+  for (int i = 0; i < chain.size(); ++i) {
+    chain[i]->expr = std::move(arms[i].expr);
+    chain[i]->thenStatement = std::move(arms[i].thenStatement);
+    chain[i]->site = arms[i].site;
+    chain[i]->line = arms[i].line;
+  }
+  return chain.size();
+}
+
+void Profile::apply() {
+  // Every IF of a chain is a site of its own; skip those already covered
+  set<IfNode*> inChain;
+  vector<StatementNode*> found = sites;
+  for (StatementNode* site : found) {
+    if (IfNode* n = dynamic_cast<IfNode*>(site)) {
+      if (inChain.count(n))
+        continue;
+      IfNode* m = n;
+      for (int covered = reorder(n); covered > 0; --covered) {
+        inChain.insert(m);
+        m = dynamic_cast<IfNode*>(m->elseStatement.get());
+      }
+    } else {
+      WhileNode* w = static_cast<WhileNode*>(site);
+      if (counts[2 * w->site + 1] >= HOT_TRIPS) {
+        w->fast.reset(scalarTest(w->expr.get()));
+        if (w->fast)
+          ++specialized;
+      }
+    }
+  }
+  // Site numbers moved with the arms; keep sites indexed by them
+  for (StatementNode* site : found)
+    if (IfNode* n = dynamic_cast<IfNode*>(site))
+      sites[n->site] = n;
+}
@@ -0,0 +1,47 @@
+//*****************************************************************************
+// purpose: Profile-guided optimization of IF chains and WHILE loops
+//          Counts branches and loop trips, then reshapes the tree with them
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "nodes.h"
+
+// Hot WHILE loops: this many iterations in the profiled run
+#define HOT_TRIPS 1000
+
+// ---------------------------------------------------------------------
+// The IF and WHILE statements of one parsed program, numbered in source
+// order, and two counters for each: THEN and ELSE taken for an IF,
+// entries and iterations for a WHILE.
+class Profile {
+public:
+  vector<StatementNode*> sites;  // IfNode or WhileNode, by site number
+  vector<long long> counts;      // 2 per site; State::profile points here
+  int reordered = 0;             // IF chains apply() reordered
+  int specialized = 0;           // WHILE loops apply() gave a ScalarTest
+  Profile(ProgramNode* root);    // number the sites and zero the counts
+
+  // Write the counts to fileName; false if it cannot be written
+  bool save(const char* fileName, const string& program);
+  // Read counts saved for this program. Returns an empty string, or why
+  // the file was not used; then every count stays zero.
+  string load(const char* fileName, const string& program);
+
+  // With loaded counts, put the arms of each IF ... ELSE IF chain of
+  // mutually exclusive tests in order of how often they were taken, and
+  // give hot WHILE loops with a simple comparison a ScalarTest. Both
+  // keep the program's meaning for any input, so a run that behaves
+  // unlike the profiled one is only slower, never wrong.
+  void apply();
+
+private:
+  void number(BlockNode* block);
+  void number(StatementNode* stmt);
+  int reorder(IfNode* head);
+};
+
+#endif /* PROFILE_H */
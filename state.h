@@ -0,0 +1,137 @@
+//*****************************************************************************
+// purpose: Run-time state of a TIPS program
+//          Everything interpret() changes, kept apart from the parse tree
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#ifndef STATE_H
+#define STATE_H
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <streambuf>
+#include <chrono>
+#include <functional>
+#include <memory>
+
+using namespace std;
+
+class InputReader;
+class Checkpointer;
+class Tracer;
+struct ProgramTables;
+
+// Exit codes of a run stopped by a limit; errors exit with EXIT_FAILURE
+#define EXIT_STEP_LIMIT   3
+#define EXIT_TIME_LIMIT   4
+#define EXIT_OUTPUT_LIMIT 5
+
+// How many statements run between looks at the clock
+#define CHECK_INTERVAL (1 << 14)
+
+// Define truth for a floating-point number:
+// falsehood == F is within EPSILON of 0.0
+// truth == not falsehood
+// Every engine tests conditions with this; batch.cpp's lane version
+// compares against the same EPSILON.
+#define EPSILON 0.001
+inline bool truth(float F) {
+  return !((EPSILON > F) && (F > -EPSILON));
+}
+
+// Size of the frame stack in floats, and how deep calls may nest before
+// the run stops (the interpreter itself recurses once per call)
+#define STACK_SLOTS    (1 << 20)
+#define MAX_CALL_DEPTH 10000
+
+// One update "V := V + t" or "V := V - t" of a sum that a worker of a
+// parallel WHILE logs instead of storing; the loop applies them in
+// iteration order, so the sum is rounded exactly as a sequential run's
+struct Reduction {
+  int slot = 0;        // the global V
+  bool minus = false;  // subtract value rather than add it
+  float value = 0.0f;  // t
+};
+
+// Resource limits of one run; 0 means no limit
+struct Limits {
+  long long maxSteps = 0;  // statements executed
+  double timeout = 0;      // seconds of wall-clock time
+  long long maxOutput = 0; // bytes written by WRITE
+};
+
+// ---------------------------------------------------------------------
+// Values and I/O of one execution of a program. The parse tree is never
+// written while running, so any number of threads may interpret the same
+// tree at once, each through its own State.
+struct State {
+  vector<float> vars;           // scalar variables, by symbol table slot
+  vector<vector<int> > ints;    // INTEGER array elements, by array number
+  vector<vector<float> > reals; // REAL array elements, by array number
+  InputReader* input = nullptr; // READ source; null prompts on cin
+  // READ source when input is null and this is set (libtips): stores
+  // the value for the variable named, or returns false at end of input
+  function<bool(const string& name, float& value)> read;
+  long long* profile = nullptr; // two counters per IF and WHILE site (--profile-gen)
+  Tracer* trace = nullptr;      // records executed statements (--trace)
+  streambuf* out = nullptr;     // WRITE destination
+  void reset(const ProgramTables& tables); // size for a program, all zero
+
+  // A worker of a parallel WHILE (--auto-parallel) has its own scalars
+  // but uses the arrays of owner, and logs sums into reductions
+  State* owner = nullptr;
+  vector<Reduction>* reductions = nullptr;
+  State* arrays() { return owner ? owner : this; }
+
+  // Activation records of running procedures and functions, one
+  // contiguous frame each. Allocated once so references into it stay
+  // valid across calls, and left uninitialized: a call zeroes the frame
+  // it claims, so only the pages calls reach ever become resident.
+  unique_ptr<float[]> stack;
+  int stackSlots = 0;           // floats in stack
+  int frame = 0;                // base of the running subprogram's frame
+  int top = 0;                  // first slot past the last frame
+  int depth = 0;                // calls in progress
+  // A variable: a local of the running subprogram or a global
+  float& var(bool local, int slot) {
+    return local ? stack[frame + slot] : vars[slot];
+  }
+
+  // Budget accounting. Statements and WRITE bytes are only counted as
+  // they run; the limits are compared on loop back-edges, the only way a
+  // program can run for long.
+  Limits limits;
+  Checkpointer* checkpoint = nullptr; // saves the run periodically (--checkpoint)
+  bool checkpointDue = false;   // set by checkLimits; the next loop back-edge saves
+  long long steps = 0;          // statements executed so far
+  long long written = 0;        // bytes written so far
+  long long checkAt = 0;        // steps at which the next full check is due
+  long long outputCap = 0;      // written may not pass this
+  chrono::steady_clock::time_point deadline;
+  void startClock();            // begin counting against limits
+  void checkLimits(const char* where, int line); // throws if a limit is exceeded
+  // Called by every loop before it repeats its body, and by every call.
+  // A tree-walking loop then looks at checkpointDue.
+  void backEdge(const char* where, int line) {
+    ++steps;
+    if (steps >= checkAt || written > outputCap)
+      checkLimits(where, line);
+  }
+};
+
+// The State the current thread is interpreting with
+extern thread_local State* state;
+
+// Thrown when a running program must stop (bad input, index out of
+// range). Whoever started the run decides how to report it.
+struct RuntimeError {
+  string message;
+  int status = EXIT_FAILURE; // exit code for the run
+};
+
+// The framing used when a run stops with message
+string errorBanner(const string& message);
+
+#endif /* STATE_H */
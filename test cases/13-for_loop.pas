@@ -0,0 +1,28 @@
+PROGRAM FORLOOP;
+{ Counting up and down with FOR loops. }
+VAR
+  I: INTEGER;
+  J: INTEGER;
+  SUM: INTEGER;
+BEGIN
+  SUM := 0;
+  FOR I := 1 TO 10 DO
+    SUM := SUM + I;
+  WRITE('Sum of 1 to 10:');
+  WRITE(SUM);
+
+  WRITE('Countdown:');
+  FOR I := 3 DOWNTO 1 DO
+    WRITE(I);
+
+  { A loop whose bounds are reversed runs zero times }
+  FOR I := 5 TO 1 DO
+    WRITE('never printed');
+
+  FOR I := 1 TO 3 DO
+    FOR J := I TO 3 DO
+    BEGIN
+      WRITE(I);
+      WRITE(J)
+    END
+END
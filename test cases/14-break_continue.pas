@@ -0,0 +1,26 @@
+PROGRAM EARLYOUT;
+{ Leaving loops early with BREAK and skipping ahead with CONTINUE. }
+VAR
+  I: INTEGER;
+  N: INTEGER;
+BEGIN
+  WRITE('Odd numbers below 10:');
+  FOR I := 1 TO 100 DO
+  BEGIN
+    IF I > 9 THEN
+      BREAK;
+    IF I MOD 2 = 0 THEN
+      CONTINUE;
+    WRITE(I)
+  END;
+
+  WRITE('First multiple of 7 above 50:');
+  N := 51;
+  WHILE 1
+  BEGIN
+    IF N MOD 7 = 0 THEN
+      BREAK;
+    N := N + 1
+  END;
+  WRITE(N)
+END
@@ -0,0 +1,26 @@
+PROGRAM ANDOR;
+{ AND binds like *, OR binds like +, and both stop early. }
+VAR
+  I: INTEGER;
+  D: INTEGER;
+BEGIN
+  D := 0;
+  { 10 MOD D would crash with D = 0, but AND never looks at its right side }
+  IF (D <> 0) AND (10 MOD D = 1) THEN
+    WRITE('unreachable')
+  ELSE
+    WRITE('AND skipped the MOD');
+
+  IF (D = 0) OR (10 MOD D = 1) THEN
+    WRITE('OR skipped the MOD');
+
+  WRITE('Numbers from 1 to 20 divisible by 2 and 3:');
+  FOR I := 1 TO 20 DO
+    IF (I MOD 2 = 0) AND (I MOD 3 = 0) THEN
+      WRITE(I);
+
+  WRITE('Numbers from 1 to 10 outside 3..8:');
+  FOR I := 1 TO 10 DO
+    IF (I < 3) OR (I > 8) THEN
+      WRITE(I)
+END
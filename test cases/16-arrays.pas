@@ -0,0 +1,35 @@
+PROGRAM ARRAYS;
+{ Squares, a running total, and a reversed copy in ARRAYs. }
+VAR
+  I: INTEGER;
+  SQUARES: ARRAY [1..10] OF INTEGER;
+  TOTALS: ARRAY [0..10] OF REAL;
+  BACK: ARRAY [-10..-1] OF INTEGER;
+  X: REAL;
+BEGIN
+  TOTALS[0] := 0;
+  FOR I := 1 TO 10 DO
+  BEGIN
+    SQUARES[I] := I * I;
+    TOTALS[I] := TOTALS[I - 1] + SQUARES[I] / 2
+  END;
+
+  FOR I := 1 TO 10 DO
+    BACK[-I] := SQUARES[I];
+
+  WRITE('Half the sum of the first ten squares:');
+  X := TOTALS[10];
+  WRITE(X);
+
+  WRITE('Squares, largest first:');
+  FOR I := -10 TO -1 DO
+  BEGIN
+    X := BACK[I];
+    WRITE(X)
+  END;
+
+  { Out of range: the program stops with an error }
+  I := 11;
+  SQUARES[I] := 0;
+  WRITE('never printed')
+END
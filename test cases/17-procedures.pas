@@ -0,0 +1,67 @@
+PROGRAM SUBPROGS;
+{ Procedures and functions with value parameters and local variables. }
+VAR
+  N: INTEGER;
+  TOTAL: REAL;
+  I: INTEGER;
+
+PROCEDURE BANNER;
+BEGIN
+  WRITE('--------')
+END;
+
+PROCEDURE SHOWSUM(A: REAL; B: REAL);
+VAR
+  S: REAL;
+BEGIN
+  S := A + B;
+  WRITE(S);
+  { Parameters are copies: this does not change the caller's value }
+  A := 0
+END;
+
+FUNCTION FACT(K: INTEGER): INTEGER;
+BEGIN
+  IF K < 2 THEN
+    FACT := 1
+  ELSE
+    FACT := K * FACT(K - 1)
+END;
+
+FUNCTION FIB(K: INTEGER): INTEGER;
+BEGIN
+  IF K < 2 THEN
+    FIB := K
+  ELSE
+    FIB := FIB(K - 1) + FIB(K - 2)
+END;
+
+FUNCTION ADDTOTAL(X: REAL): REAL;
+{ Locals hide globals: this I is not the loop counter below }
+VAR
+  I: INTEGER;
+BEGIN
+  I := 100;
+  TOTAL := TOTAL + X;
+  ADDTOTAL := TOTAL
+END;
+
+BEGIN
+  BANNER;
+  N := 3;
+  SHOWSUM(N, 0.5);
+  WRITE(N);
+  BANNER;
+  N := FACT(6);
+  WRITE(N);
+  N := FIB(15);
+  WRITE(N);
+  N := FACT(FIB(4)) + 1;
+  WRITE(N);
+  BANNER;
+  TOTAL := 0;
+  FOR I := 1 TO 4 DO
+    N := ADDTOTAL(I);
+  WRITE(N);
+  WRITE(I)
+END
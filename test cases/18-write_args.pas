@@ -0,0 +1,20 @@
+PROGRAM WRITEARG;
+{ WRITE with several arguments prints them on one line. }
+VAR
+  I: INTEGER;
+  J: INTEGER;
+  AREA: REAL;
+BEGIN
+  AREA := 2.5;
+  WRITE('Area is ', AREA, ' square units');
+  WRITE(AREA, AREA);
+  WRITE('one', ' ', 'line');
+
+  FOR I := 1 TO 3 DO
+  BEGIN
+    J := I * I;
+    WRITE(I, ' squared is ', J)
+  END;
+
+  WRITE('Done')
+END
@@ -0,0 +1,473 @@
+//*****************************************************************************
+// purpose: libtips, the interpreter as a library
+//          Compiles TIPS source once and runs it in process, any number of times
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#include "tips.h"
+#include "parser.h"
+#include "input.h"
+#include "closure.h"
+#include "ir.h"
+#include "irexec.h"
+#include "checkpoint.h"
+#include "batch.h"
+#include "parallel.h"
+#include "autopar.h"
+#include "fiber.h"
+#include <cstring>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+
+// The parser and the lexer keep their state in globals
+static mutex compiling;
+
+// ---------------------------------------------------------------------
+TipsProgram* TipsProgram::compile(const string& source, TipsResult& result) {
+  // fmemopen only reads the text; a size of 0 is not accepted everywhere
+  static char empty[] = "\n";
+  FILE* file = source.empty() ? fmemopen(empty, 1, "r")
+                              : fmemopen(const_cast<char*>(source.data()), source.size(), "r");
+  if (!file) {
+    result.status = EXIT_FAILURE;
+    result.message = "ERROR - cannot read the source";
+    return nullptr;
+  }
+  TipsProgram* program = compile(file, result);
+  fclose(file);
+  return program;
+}
+
+TipsProgram* TipsProgram::compile(FILE* source, TipsResult& result) {
+  lock_guard<mutex> guard(compiling);
+  return parse(source, result);
+}
+
+// A streamed main block runs in the State installed as state, which is
+// sized on the first statement, when every declaration has been seen
+static function<void()> streamBegin;
+static bool streamStarted;
+
+static void runStreamed(StatementNode* stmt) {
+  unique_ptr<StatementNode> owned(stmt);
+  if (!streamStarted) {
+    state->reset(parsedTables);
+    if (streamBegin)
+      streamBegin();
+    streamStarted = true;
+  }
+  // A long run of statements is a loop in disguise, so the limits are
+  // checked between them as well
+  state->backEdge("main block", line_number);
+  onStackFor(deepest_nesting(), [&] { owned->interpret(); });
+}
+
+TipsProgram* TipsProgram::stream(FILE* source, State& into, function<void()> begin,
+                                 TipsResult& result) {
+  lock_guard<mutex> guard(compiling);
+  State* outer = ::state;
+  ::state = &into;
+  streamBegin = std::move(begin);
+  streamStarted = false;
+  streamStatement = runStreamed;
+  TipsProgram* program = parse(source, result);
+  streamStatement = nullptr;
+  streamBegin = nullptr;
+  ::state = outer;
+  return program;
+}
+
+// Holding the lock
+TipsProgram* TipsProgram::parse(FILE* source, TipsResult& result) {
+  try {
+    result = TipsResult();
+    return new TipsProgram(parse_program(source));
+  } catch (SyntaxError& error) {
+    result.status = EXIT_FAILURE;
+    result.message = error.message;
+  } catch (RuntimeError& stop) {
+    // Only a statement streamed while parsing runs
+    result.status = stop.status;
+    result.message = stop.message;
+  }
+  return nullptr;
+}
+
+TipsProgram::TipsProgram(ProgramNode* r) {
+  root = r;
+}
+
+TipsProgram::~TipsProgram() {
+  delete root;
+}
+
+const string& TipsProgram::name() const {
+  return root->id;
+}
+
+vector<string> TipsProgram::variables() const {
+  vector<string> names;
+  for (auto& entry : root->tables->symbols)
+    names.push_back(entry.first);
+  return names;
+}
+
+vector<string> TipsProgram::arrays() const {
+  vector<string> names;
+  for (auto& entry : root->tables->arrays)
+    names.push_back(entry.first);
+  return names;
+}
+
+IRProgram* TipsProgram::ir() {
+  call_once(lowering, [this] {
+    onStackFor(root->nesting, [this] {
+      lowered.reset(lowerProgram(root));
+      optimize(lowered.get());
+    });
+  });
+  return lowered.get();
+}
+
+TipsResult TipsProgram::batch(const string& rowsPath) {
+  TipsResult result;
+  result.status = runBatch(root, rowsPath.c_str());
+  return result;
+}
+
+TipsResult TipsProgram::records(const string& recordsPath, int threads, const Limits& limits) {
+  TipsResult result;
+  result.status = runRecords(root, recordsPath.c_str(), threads, limits);
+  return result;
+}
+
+int TipsProgram::parallelize(int threads) {
+  return autoParallelize(root, threads);
+}
+
+// ---------------------------------------------------------------------
+// Hands what WRITE prints to a TipsWriter a block at a time
+class WriterBuf : public streambuf {
+public:
+  explicit WriterBuf(TipsWriter w) : write(std::move(w)) {
+    setp(block, block + sizeof(block));
+  }
+protected:
+  int overflow(int c) {
+    sync();
+    if (c != EOF) {
+      *pptr() = static_cast<char>(c);
+      pbump(1);
+    }
+    return c == EOF ? 0 : c;
+  }
+  streamsize xsputn(const char* s, streamsize n) {
+    if (n > epptr() - pptr()) {
+      sync();
+      if (n >= sizeof(block)) {
+        write(s, n); // too big to be worth copying
+        return n;
+      }
+    }
+    memcpy(pptr(), s, n);
+    pbump(static_cast<int>(n));
+    return n;
+  }
+  int sync() {
+    if (pptr() > pbase())
+      write(pbase(), pptr() - pbase());
+    setp(block, block + sizeof(block));
+    return 0;
+  }
+private:
+  TipsWriter write;
+  char block[4096];
+};
+
+// ---------------------------------------------------------------------
+TipsRun::TipsRun(TipsProgram& p) : program(p) {
+  values.out = cout.rdbuf();
+  values.reset(*program.tree()->tables);
+}
+
+TipsRun::~TipsRun() {
+  abandon();
+}
+
+void TipsRun::input(const string& t) {
+  text = t;
+  reader.reset(new InputReader());
+  reader->openBuffer(text.data(), text.size());
+  choose(reader.get(), nullptr);
+}
+
+void TipsRun::input(TipsReader read) {
+  reader.reset();
+  choose(nullptr, std::move(read));
+}
+
+// A waiting run reads from feed(); run() gets the source once it ends
+void TipsRun::choose(InputReader* input, TipsReader read) {
+  if (waiting()) {
+    chosenInput = input;
+    chosenRead = std::move(read);
+  } else {
+    values.input = input;
+    values.read = std::move(read);
+  }
+}
+
+void TipsRun::output(TipsWriter write) {
+  sink.reset(new WriterBuf(std::move(write)));
+  values.out = sink.get();
+}
+
+// ---------------------------------------------------------------------
+bool TipsRun::set(const string& name, float value) {
+  if (!program.tree()->tables->symbols.count(name))
+    return false;
+  scalars[name] = value;
+  return true;
+}
+
+bool TipsRun::set(const string& name, int index, float value) {
+  if (!arrayOf(name, index))
+    return false;
+  elements[make_pair(name, index)] = value;
+  return true;
+}
+
+bool TipsRun::get(const string& name, float& value) const {
+  const symbolTableT& symbols = program.tree()->tables->symbols;
+  symbolTableT::const_iterator it = symbols.find(name);
+  if (it == symbols.end())
+    return false;
+  value = values.vars[it->second];
+  return true;
+}
+
+bool TipsRun::get(const string& name, int index, float& value) const {
+  const ArrayT* array = arrayOf(name, index);
+  if (!array)
+    return false;
+  int i = index - array->low;
+  value = array->type == TOK_INTEGER ? values.ints[array->number][i] : values.reals[array->number][i];
+  return true;
+}
+
+const ArrayT* TipsRun::arrayOf(const string& name, int index) const {
+  const arrayTableT& arrays = program.tree()->tables->arrays;
+  arrayTableT::const_iterator it = arrays.find(name);
+  if (it == arrays.end() || index < it->second.low || index > it->second.high)
+    return nullptr;
+  return &it->second;
+}
+
+// ---------------------------------------------------------------------
+void TipsRun::reset() {
+  values.limits = limits;
+  values.reset(*program.tree()->tables);
+  const ProgramTables& tables = *program.tree()->tables;
+  for (auto& bound : scalars)
+    values.vars[tables.symbols.at(bound.first)] = bound.second;
+  for (auto& bound : elements) {
+    const ArrayT& array = tables.arrays.at(bound.first.first);
+    int i = bound.first.second - array.low;
+    if (array.type == TOK_INTEGER)
+      values.ints[array.number][i] = static_cast<int>(bound.second);
+    else
+      values.reals[array.number][i] = bound.second;
+  }
+}
+
+void TipsRun::checkpointing(const char* sourceName) {
+  if (!checkpointer)
+    checkpointer.reset(new Checkpointer(program.tree(), fingerprintFile(sourceName)));
+}
+
+void TipsRun::checkpoint(const char* fileName, double period, const char* sourceName) {
+  checkpointing(sourceName);
+  checkpointer->start(fileName, period);
+  values.checkpoint = checkpointer.get();
+}
+
+string TipsRun::resume(const char* fileName, const char* sourceName) {
+  abandon();
+  checkpointing(sourceName);
+  // The checkpoint is loaded into a reset State, then continued
+  State* outer = ::state;
+  ::state = &values;
+  reset();
+  string problem = checkpointer->load(fileName);
+  ::state = outer;
+  resuming = problem.empty();
+  return problem;
+}
+
+static bool knownEngine(const string& engine, TipsResult& result) {
+  if (engine == "tree" || engine == "closure" || engine == "ir")
+    return true;
+  result.status = EXIT_FAILURE;
+  result.message = "ERROR - unknown engine " + engine;
+  return false;
+}
+
+TipsResult TipsRun::execute() {
+  TipsResult result;
+  try {
+    if (resuming) {
+      resuming = false;
+      checkpointer->resume();
+    }
+    else if (engine == "closure")
+      runClosures(program.tree());
+    else if (engine == "ir")
+      runIR(program.ir());
+    else
+      program.tree()->interpret();
+  } catch (RuntimeError& stop) {
+    result.status = stop.status;
+    result.message = stop.message;
+  }
+  return result;
+}
+
+TipsResult TipsRun::run() {
+  abandon();
+  TipsResult result;
+  if (!knownEngine(engine, result))
+    return result;
+  State* outer = ::state;
+  ::state = &values;
+  if (!resuming)
+    reset();
+  onStackFor(program.tree()->nesting, [&] { result = execute(); });
+  if (sink)
+    sink->pubsync();
+  ::state = outer;
+  return result;
+}
+
+// ---------------------------------------------------------------------
+TipsResult TipsRun::start() {
+  abandon();
+  outcome = TipsResult();
+  if (!knownEngine(engine, outcome))
+    return outcome;
+  if (!fiber) {
+    fiber.reset(new Fiber(stackFor(program.tree()->nesting)));
+    fed.reset(new InputReader());
+    fed->wait = [this] { awaitInput(); };
+  }
+  fed->openFed();
+  chosenInput = values.input;
+  chosenRead = std::move(values.read);
+  values.input = fed.get();
+  values.read = nullptr;
+  fiber->start([this] {
+    if (!resuming)
+      reset();
+    outcome = execute();
+  });
+  return proceed();
+}
+
+TipsResult TipsRun::feed(const string& text) {
+  if (!waiting())
+    return outcome;
+  fed->feed(text.data(), text.size());
+  return proceed();
+}
+
+TipsResult TipsRun::endInput() {
+  if (!waiting())
+    return outcome;
+  fed->finish();
+  return proceed();
+}
+
+bool TipsRun::waiting() const {
+  return fiber && fiber->suspended();
+}
+
+TipsResult TipsRun::proceed() {
+  State* outer = ::state;
+  ::state = &values;
+  try {
+    fiber->resume();
+  } catch (...) {
+    ::state = outer;
+    throw; // not a RuntimeError: the run is over
+  }
+  ::state = outer;
+  if (sink && !abandoning)
+    sink->pubsync();
+  if (fiber->suspended())
+    return TipsResult();
+  values.input = chosenInput;
+  values.read = std::move(chosenRead);
+  return outcome;
+}
+
+// Runs on the fiber, inside the READ
+void TipsRun::awaitInput() {
+  chrono::steady_clock::time_point since = chrono::steady_clock::now();
+  Fiber::suspend();
+  if (abandoning)
+    throw RuntimeError{"ERROR - run abandoned while waiting for input", EXIT_FAILURE};
+  values.deadline += chrono::steady_clock::now() - since; // waiting is not running
+}
+
+void TipsRun::abandon() {
+  if (!waiting())
+    return;
+  abandoning = true;
+  proceed();
+  abandoning = false;
+}
+
+// ---------------------------------------------------------------------
+void TipsLoop::add(TipsRun& run, int in, function<void(const TipsResult&)> done) {
+  TipsResult result = run.start();
+  if (!run.waiting()) {
+    done(result);
+    return;
+  }
+  Session session = { &run, in, std::move(done) };
+  sessions.push_back(std::move(session));
+}
+
+void TipsLoop::run() {
+  vector<pollfd> polled;
+  char block[4096];
+  while (!sessions.empty()) {
+    polled.resize(sessions.size());
+    for (int i = 0; i < sessions.size(); ++i) {
+      polled[i].fd = sessions[i].in;
+      polled[i].events = POLLIN;
+      polled[i].revents = 0;
+    }
+    bool failed = poll(polled.data(), polled.size(), -1) < 0;
+    if (failed && errno == EINTR)
+      continue;
+    // Back to front, so an ended session can be replaced by the last
+    for (int i = sessions.size() - 1; i >= 0; --i) {
+      if (!failed && polled[i].revents == 0)
+        continue;
+      Session& session = sessions[i];
+      ssize_t n = failed ? 0 : read(session.in, block, sizeof(block));
+      if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        continue;
+      TipsResult result = n > 0 ? session.run->feed(string(block, n)) : session.run->endInput();
+      if (session.run->waiting())
+        continue;
+      Session ended = std::move(session);
+      if (i + 1 < sessions.size())
+        sessions[i] = std::move(sessions.back());
+      sessions.pop_back();
+      ended.done(result); // may add() another
+    }
+  }
+}
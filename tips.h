@@ -0,0 +1,191 @@
+//*****************************************************************************
+// purpose: libtips, the interpreter as a library
+//          Compiles TIPS source once and runs it in process, any number of times
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#ifndef TIPS_H
+#define TIPS_H
+
+#include "nodes.h"
+#include <cstdio>
+#include <map>
+#include <mutex>
+
+class IRProgram;
+class InputReader;
+class Checkpointer;
+class Fiber;
+
+// How a compile or a run ended
+struct TipsResult {
+  int status = EXIT_SUCCESS; // what tips exits with: EXIT_FAILURE or a limit's code
+  string message;            // why it stopped, as tips prints it in its error banner
+  bool ok() const { return status == EXIT_SUCCESS; }
+};
+
+// Stores the value a READ of the variable name gets; false at end of input
+typedef function<bool(const string& name, float& value)> TipsReader;
+// Takes length bytes printed by WRITE
+typedef function<void(const char* text, size_t length)> TipsWriter;
+
+// ---------------------------------------------------------------------
+// A parsed program. Running never changes it, so any number of TipsRuns
+// on any threads may share one.
+class TipsProgram {
+public:
+  // Parse source text, or an open file that the caller closes. Returns
+  // null and the syntax error in result if it does not parse. Compiles
+  // one program at a time; the lexer is not reentrant.
+  static TipsProgram* compile(const string& source, TipsResult& result);
+  static TipsProgram* compile(FILE* source, TipsResult& result);
+  // Parse while running: each statement of the main block runs in into
+  // as soon as it is parsed, then is freed, so the program returned has
+  // an empty main block. into is reset once every declaration has been
+  // seen, and begin is called then, before the first statement runs. An
+  // error in a statement comes back in result like a syntax error.
+  static TipsProgram* stream(FILE* source, State& into, function<void()> begin,
+                             TipsResult& result);
+  ~TipsProgram();
+
+  const string& name() const;          // from the PROGRAM heading
+  vector<string> variables() const;    // scalar variables, by name
+  vector<string> arrays() const;       // array variables, by name
+
+  // For tools built on tips: the parse tree, which owns the program's
+  // tables, and the optimized IR, lowered on first use
+  ProgramNode* tree() { return root; }
+  IRProgram* ir();
+
+  // Run the program once per line of a file, each line holding the
+  // values its run READs, printing every run's output to cout in file
+  // order: batch() in lockstep, one vector lane per line; records() on
+  // threads threads (0: one per core), each line under its own limits.
+  // A line's errors are printed with its output; the result carries only
+  // the exit status.
+  TipsResult batch(const string& rowsPath);
+  TipsResult records(const string& recordsPath, int threads, const Limits& limits);
+  // Run every WHILE of the main block whose iterations are independent
+  // on threads threads (0: one per core) in the tree engine's later
+  // runs. Returns how many loops were found.
+  int parallelize(int threads);
+
+private:
+  ProgramNode* root;
+  unique_ptr<IRProgram> lowered;
+  once_flag lowering;
+  explicit TipsProgram(ProgramNode* root);
+  static TipsProgram* parse(FILE* source, TipsResult& result);
+};
+
+// ---------------------------------------------------------------------
+// One execution context of a program: its variables, where READ and
+// WRITE go, and its limits. A TipsRun may run its program again and
+// again; each run starts from zeroed variables and the values bound with
+// set(). Use each TipsRun from one thread at a time.
+class TipsRun {
+public:
+  explicit TipsRun(TipsProgram& program);
+  ~TipsRun();
+
+  Limits limits;                 // of each run; 0 means no limit
+  string engine = "tree";        // "tree", "closure" or "ir"
+
+  // Where READ takes its numbers: from text, from a callback, or by
+  // default by prompting on cin as tips does
+  void input(const string& text);
+  void input(TipsReader read);
+  // Where WRITE goes; cout by default. Output is handed over in blocks
+  // and all of it before run() returns.
+  void output(TipsWriter write);
+
+  // Bind a scalar variable or an array element for the following runs,
+  // or look at the value the last run left (all zero before any run).
+  // False if there is no such variable or the index is out of range.
+  bool set(const string& name, float value);
+  bool set(const string& name, int index, float value);
+  bool get(const string& name, float& value) const;
+  bool get(const string& name, int index, float& value) const;
+
+  // Run the program once. Errors and limits come back in the result.
+  TipsResult run();
+
+  // Run the program without blocking on READ, so one thread can serve
+  // many runs. start() begins a run on a stack of its own, whose READs
+  // take numbers only from feed(). A READ that finds none suspends the
+  // run: start() returns with waiting() true, everything written so far
+  // handed to output(). feed() and endInput() continue a waiting run the
+  // same way and return its result once it has ended. Time spent waiting
+  // does not count against limits.timeout. Continue a run on the thread
+  // that started it; starting or running again abandons a waiting run.
+  TipsResult start();
+  TipsResult feed(const string& text);
+  TipsResult endInput();         // a READ still waiting fails as at end of input
+  bool waiting() const;
+
+  // Save the tree engine's runs to fileName every period seconds. A
+  // checkpoint is tied to sourceName, the file the program came from.
+  void checkpoint(const char* fileName, double period, const char* sourceName);
+  // Load the checkpoint in fileName, saved by a run of sourceName, for
+  // the next run() of the tree engine to continue from instead of
+  // starting over. Returns "", or why the file cannot be resumed.
+  string resume(const char* fileName, const char* sourceName);
+
+  // For tools built on tips (profiles, traces): the State the runs use,
+  // and reset(), which run() does first, zeroing the State and applying
+  // the bound values
+  State& state() { return values; }
+  void reset();
+
+private:
+  TipsProgram& program;
+  State values;
+  string text;                          // input(text), which the reader points into
+  unique_ptr<InputReader> reader;
+  unique_ptr<Checkpointer> checkpointer; // of checkpoint() and resume()
+  bool resuming = false;                // the next run continues a checkpoint
+  void checkpointing(const char* sourceName); // make the checkpointer
+  unique_ptr<streambuf> sink;           // output(write)
+  map<string, float> scalars;           // bound with set()
+  map<pair<string, int>, float> elements;
+  const ArrayT* arrayOf(const string& name, int index) const; // null if no such element
+  // A run begun by start()
+  unique_ptr<Fiber> fiber;              // its stack, kept for the next start()
+  unique_ptr<InputReader> fed;          // what feed() handed over
+  InputReader* chosenInput = nullptr;   // input() of run(), put back when it ends
+  TipsReader chosenRead;
+  void choose(InputReader* input, TipsReader read); // set where run() reads
+  TipsResult outcome;                   // how it ended
+  bool abandoning = false;              // its waiting READ is to fail
+  TipsResult execute();                 // run the program on the current thread
+  TipsResult proceed();                 // continue it until it waits or ends
+  void awaitInput();                    // suspend a READ until input is fed
+  void abandon();                       // end a waiting run
+};
+
+// ---------------------------------------------------------------------
+// Serves started runs from one thread. Each run's READs take the numbers
+// arriving on a descriptor, such as a socket or a pipe. The loop waits in
+// poll() on the descriptors of all waiting runs and feeds every run what
+// arrives for it, so a waiting run costs no thread, only the touched
+// pages of its stack.
+class TipsLoop {
+public:
+  // Start run, feeding it what arrives on in until in reports end of
+  // file; the caller closes in. done gets the result once the run has
+  // ended, which may be before add() returns.
+  void add(TipsRun& run, int in, function<void(const TipsResult&)> done);
+  void run();                    // until every run added has ended
+  int waiting() const { return sessions.size(); }
+
+private:
+  struct Session {
+    TipsRun* run;
+    int in;
+    function<void(const TipsResult&)> done;
+  };
+  vector<Session> sessions;
+};
+
+#endif /* TIPS_H */
@@ -0,0 +1,224 @@
+//*****************************************************************************
+// purpose: Execution trace of a tree-walking run for postmortem analysis
+//          Keeps the last statements run in a ring, dumped when the run ends
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#include "trace.h"
+#include "format.h"
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Binary layout, in the machine's own byte order:
+//   "TIPSTRAC", version, exit status, events recorded (8 bytes)
+//   statement count, then "KIND NAME" of each statement, NUL terminated
+//   events kept, then each as node, line, value, oldest first
+// JSON has the same fields, each event as [node, line, value].
+#define TRACE_MAGIC   "TIPSTRAC"
+#define TRACE_VERSION 1
+
+// ---------------------------------------------------------------------
+Tracer::Tracer(ProgramNode* root, int events, bool j) {
+  unsigned long long size = 1;
+  while (size < events)
+    size <<= 1;
+  ring.resize(size);
+  mask = size - 1;
+  json = j;
+  program = root->id;
+  number(root->block.get());
+  if (json)
+    nodes += "]";
+}
+
+// Source order: a block's subprograms come before its statement
+void Tracer::number(BlockNode* block) {
+  for (auto& sub : block->subprograms)
+    number(sub->body.get());
+  number(block->compound.get());
+}
+
+void Tracer::number(StatementNode* stmt) {
+  if (CompoundNode* n = dynamic_cast<CompoundNode*>(stmt)) {
+    describe(n, "BEGIN", "");
+    for (auto& s : n->statements)
+      number(s.get());
+  } else if (IfNode* n = dynamic_cast<IfNode*>(stmt)) {
+    describe(n, "IF", "");
+    number(n->thenStatement.get());
+    if (n->elseStatement)
+      number(n->elseStatement.get());
+  } else if (WhileNode* n = dynamic_cast<WhileNode*>(stmt)) {
+    describe(n, "WHILE", "");
+    number(n->statement.get());
+  } else if (ForNode* n = dynamic_cast<ForNode*>(stmt)) {
+    describe(n, "FOR", n->id);
+    number(n->statement.get());
+  } else if (AssignmentNode* n = dynamic_cast<AssignmentNode*>(stmt)) {
+    describe(n, "ASSIGN", n->id);
+  } else if (ArrayAssignmentNode* n = dynamic_cast<ArrayAssignmentNode*>(stmt)) {
+    describe(n, "ASSIGN", n->id);
+  } else if (ReadNode* n = dynamic_cast<ReadNode*>(stmt)) {
+    describe(n, "READ", n->id);
+  } else if (CallNode* n = dynamic_cast<CallNode*>(stmt)) {
+    describe(n, "CALL", n->callee->id);
+  } else if (dynamic_cast<WriteNode*>(stmt)) {
+    describe(stmt, "WRITE", "");
+  } else if (dynamic_cast<BreakNode*>(stmt)) {
+    describe(stmt, "BREAK", "");
+  } else {
+    describe(stmt, "CONTINUE", "");
+  }
+}
+
+// Give stmt the next traceId and add it to the statement table
+void Tracer::describe(StatementNode* stmt, const char* kind, const string& name) {
+  stmt->traceId = statements++;
+  if (json) {
+    nodes += nodes.empty() ? "[" : ",";
+    nodes += string("{\"kind\":\"") + kind + "\",\"name\":\"" + name
+             + "\",\"line\":" + to_string(stmt->line) + "}";
+  } else {
+    nodes += kind;
+    if (!name.empty())
+      nodes += " " + name;
+    nodes += '\0';
+  }
+}
+
+// ---------------------------------------------------------------------
+// Everything below runs inside signal handlers: no allocation, no stdio.
+// (formatNumber hands the odd value it cannot round exactly to snprintf,
+// which allocates nothing for a float.)
+
+// Collects the dump and writes it to a file descriptor in large pieces
+struct DumpBuffer {
+  int fd;
+  bool ok = true;
+  int used = 0;
+  char text[4096];
+  void flush() {
+    for (int done = 0; ok && done < used; ) {
+      ssize_t n = write(fd, text + done, used - done);
+      ok = n > 0;
+      done += n;
+    }
+    used = 0;
+  }
+  void put(const void* data, int size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+      if (used == sizeof(text))
+        flush();
+      int n = size < sizeof(text) - used ? size : sizeof(text) - used;
+      memcpy(text + used, bytes, n);
+      used += n;
+      bytes += n;
+      size -= n;
+    }
+  }
+  void put(const char* s) { put(s, strlen(s)); }
+  void putNumber(long long n) {
+    char digits[24];
+    char* p = digits + sizeof(digits);
+    unsigned long long u = n < 0 ? -static_cast<unsigned long long>(n) : n;
+    do {
+      *--p = static_cast<char>('0' + u % 10);
+      u /= 10;
+    } while (u);
+    if (n < 0)
+      *--p = '-';
+    put(p, digits + sizeof(digits) - p);
+  }
+  void putValue(float value) {
+    if (!std::isfinite(value)) {
+      put("null"); // JSON has no infinity or NaN
+      return;
+    }
+    char number[FORMAT_BUFFER];
+    put(number, formatNumber(value, number));
+  }
+};
+
+bool Tracer::dump(int status) {
+  int fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return false;
+  DumpBuffer out;
+  out.fd = fd;
+  unsigned long long total = recorded;
+  unsigned long long first = total > ring.size() ? total - ring.size() : 0;
+  if (json) {
+    out.put("{\"program\":\"");
+    out.put(program.c_str());
+    out.put("\",\"status\":");
+    out.putNumber(status);
+    out.put(",\"recorded\":");
+    out.putNumber(total);
+    out.put(",\"statements\":");
+    out.put(nodes.data(), nodes.size());
+    out.put(",\"events\":[");
+    for (unsigned long long k = first; k < total; ++k) {
+      const TraceEvent& e = ring[k & mask];
+      out.put(k == first ? "[" : ",[");
+      out.putNumber(e.node);
+      out.put(",");
+      out.putNumber(e.line);
+      out.put(",");
+      out.putValue(e.value);
+      out.put("]");
+    }
+    out.put("]}\n");
+  } else {
+    int version = TRACE_VERSION;
+    int kept = total - first;
+    out.put(TRACE_MAGIC, strlen(TRACE_MAGIC));
+    out.put(&version, sizeof(version));
+    out.put(&status, sizeof(status));
+    out.put(&total, sizeof(total));
+    out.put(&statements, sizeof(statements));
+    out.put(nodes.data(), nodes.size());
+    out.put(&kept, sizeof(kept));
+    for (unsigned long long k = first; k < total; ++k)
+      out.put(&ring[k & mask], sizeof(TraceEvent));
+  }
+  out.flush();
+  return close(fd) == 0 && out.ok;
+}
+
+// ---------------------------------------------------------------------
+static Tracer* signalled = nullptr; // whose ring the handlers dump
+
+static void dumpAndGo(int sig) {
+  signalled->dump(sig == SIGUSR1 ? TRACE_RUNNING : 128 + sig);
+  if (sig != SIGUSR1) {
+    // Die of the signal as if it had never been caught
+    signal(sig, SIG_DFL);
+    raise(sig);
+  }
+}
+
+void Tracer::dumpOnSignals() {
+  signalled = this;
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = dumpAndGo;
+  action.sa_flags = SA_RESTART; // a READ waiting on input carries on
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+  sigaction(SIGUSR1, &action, nullptr);
+}
+
+Tracer::~Tracer() {
+  if (signalled != this)
+    return;
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  signal(SIGUSR1, SIG_DFL);
+  signalled = nullptr;
+}
@@ -0,0 +1,76 @@
+//*****************************************************************************
+// purpose: Execution trace of a tree-walking run for postmortem analysis
+//          Keeps the last statements run in a ring, dumped when the run ends
+// version: Spring 2025
+//  author: Delvin Buckley
+//*****************************************************************************
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "nodes.h"
+
+// Events the ring keeps unless --trace-events says otherwise
+#define TRACE_EVENTS (1 << 16)
+
+// Dump status of a run that has not ended (SIGUSR1)
+#define TRACE_RUNNING -1
+
+// One executed statement: its traceId, its line, and the value it
+// produced (see Tracer)
+struct TraceEvent {
+  int node;
+  int line;
+  float value;
+};
+
+// ---------------------------------------------------------------------
+// The last statements one run executed, in a fixed ring that is written
+// over once full. Recording is a store into the ring and nothing else,
+// so a long run can keep it on.
+//
+// Every statement of the program gets a traceId in source order (a
+// block's subprograms before its statement). The value recorded is
+//   assignment, READ  the value stored
+//   IF                1 if THEN was taken, else 0
+//   WHILE             the iteration starting, from 1
+//   FOR               the counter of the iteration starting
+//   WRITE, call       0
+class Tracer {
+public:
+  // Number root's statements and make room for at least events events;
+  // the dump is JSON instead of binary if json
+  Tracer(ProgramNode* root, int events, bool json);
+  ~Tracer(); // gives the signals back their default actions
+
+  void record(int node, int line, float value) {
+    TraceEvent& e = ring[recorded++ & mask];
+    e.node = node;
+    e.line = line;
+    e.value = value;
+  }
+  unsigned long long recorded = 0; // events so far, kept or overwritten
+
+  // Write the ring to fileName, oldest event first, with the run's exit
+  // status (or TRACE_RUNNING). Nothing is allocated and only open,
+  // write and close are called, so a signal handler may dump; false if
+  // it cannot write.
+  bool dump(int status);
+  // Dump on SIGINT and SIGTERM before dying of them, and on SIGUSR1
+  // without stopping. One Tracer at a time owns the handlers.
+  void dumpOnSignals();
+  string fileName;
+
+private:
+  vector<TraceEvent> ring;
+  unsigned long long mask;       // ring.size() - 1, a power of two less one
+  bool json;
+  string program;
+  int statements = 0;            // traceIds given out
+  string nodes;                  // the dump's statement table, ready to write
+  void number(BlockNode* block);
+  void number(StatementNode* stmt);
+  void describe(StatementNode* stmt, const char* kind, const string& name);
+};
+
+#endif /* TRACE_H */